@@ -0,0 +1,114 @@
+// Heap allocations of a warmed-up step, which has to be zero.
+// Usage: bench allocations [steps]
+// Counts every operator new of the bench binary. Each integrator takes a few
+// warm-up steps (buffers sized, forces cached), then `steps` more (default
+// 100) must not allocate: first through the stepper alone with the scalar
+// pair loop, then through Simulation with the SIMD rows. Exits with 1 and
+// names the case when a step allocated, so scripts can gate on it.
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include "bench.h"
+#include "physics/gravity.h"
+#include "physics/integrator.h"
+#include "physics/presets.h"
+#include "physics/simulation.h"
+
+static std::atomic<long long> allocations { 0 };
+
+void* operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace {
+
+constexpr int WarmUp = 3;
+
+bool report(const char* path, const char* name, long long count, long steps)
+{
+    printf("%-12s %-18s %10lld %s\n", path, name, count, count == 0 ? "ok" : "ALLOCATES");
+    if (count != 0)
+        fprintf(stderr, "%s %s: %lld allocations in %ld warmed-up steps\n", path, name, count, steps);
+    return count == 0;
+}
+
+}
+
+int allocationCheck(int argc, char** argv)
+{
+    const long steps = argc > 1 ? atol(argv[1]) : 100;
+    const IntegratorKind kinds[] = { IntegratorKind::RK4, IntegratorKind::Leapfrog, IntegratorKind::VelocityVerlet };
+    const BodyState start = plummerSphere(200, 1);
+    bool ok = true;
+
+    printf("%ld steps after %d warm-up steps, 200 bodies\n", steps, WarmUp);
+    printf("%-12s %-18s %10s\n", "path", "integrator", "allocs");
+
+    DirectGravity gravity;
+    gravity.setSimdLevel(SimdLevel::Scalar);
+    auto deriv = [&](const BodyState& X, BodyState& Xdot) {
+        Xdot.x = X.vx;
+        Xdot.y = X.vy;
+        Xdot.z = X.vz;
+        gravity.accelerations(X, PresetG, Xdot.vx.data(), Xdot.vy.data(), Xdot.vz.data());
+    };
+    for (IntegratorKind kind : kinds)
+    {
+        auto integrator = makeIntegrator(kind);
+        BodyState X = start;
+        for (int s = 0; s < WarmUp; ++s)
+            integrator->step(X, 0.01, deriv);
+
+        const long long before = allocations.load();
+        for (long s = 0; s < steps; ++s)
+            integrator->step(X, 0.01, deriv);
+        ok = report("stepper", integrator->name(), allocations.load() - before, steps) && ok;
+    }
+
+    for (IntegratorKind kind : kinds)
+    {
+        Simulation sim(start, PresetG);
+        sim.setForceThreads(1);
+        sim.setIntegrator(kind);
+        for (int s = 0; s < WarmUp; ++s)
+            sim.step(0.01);
+
+        const long long before = allocations.load();
+        for (long s = 0; s < steps; ++s)
+            sim.step(0.01);
+        ok = report("simulation", sim.activeIntegrator().name(), allocations.load() - before, steps) && ok;
+    }
+    return ok ? 0 : 1;
+}
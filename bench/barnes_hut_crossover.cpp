@@ -0,0 +1,65 @@
+// Barnes-Hut against direct summation.
+// Usage: bench barnes_hut [theta]
+// Times one force evaluation (tree build included) of both solvers on a
+// single thread for growing N, with the RMS relative force error of the tree,
+// and reports the first N where the tree is faster.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "bench.h"
+#include "physics/barnes_hut.h"
+#include "physics/gravity.h"
+
+template <class F>
+static double timeMs(int reps, F&& f)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < reps; ++r)
+        f();
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(stop - start).count() / reps;
+}
+
+int barnesHutCrossover(int argc, char** argv)
+{
+    const double theta = argc > 1 ? atof(argv[1]) : 0.5;
+    const int sizes[] = { 100, 300, 1000, 3000, 10000, 30000 };
+
+    DirectGravity direct;
+    BarnesHutGravity tree(theta);
+    int crossover = -1;
+
+    printf("theta = %g, direct kernel: %s\n", theta, simdLevelName(direct.simdLevel()));
+    printf("%8s %12s %12s %8s %12s %8s\n", "N", "direct ms", "tree ms", "ratio", "rms err", "nodes");
+    for (int n : sizes)
+    {
+        BodyState X = randomCloud(n, 3);
+        std::vector<double> dx(n), dy(n), dz(n), tx(n), ty(n), tz(n);
+        const int reps = n <= 1000 ? 50 : n <= 10000 ? 3 : 1;
+
+        double directMs = timeMs(reps, [&] { direct.accelerations(X, 0.1, dx.data(), dy.data(), dz.data()); });
+        tree.accelerations(X, 0.1, tx.data(), ty.data(), tz.data());
+        double treeMs = timeMs(reps, [&] { tree.accelerations(X, 0.1, tx.data(), ty.data(), tz.data()); });
+
+        double err = 0.0;
+        for (int i = 0; i < n; ++i) {
+            double ex = tx[i] - dx[i], ey = ty[i] - dy[i], ez = tz[i] - dz[i];
+            err += (ex * ex + ey * ey + ez * ez) / (dx[i] * dx[i] + dy[i] * dy[i] + dz[i] * dz[i]);
+        }
+        err = std::sqrt(err / n);
+
+        if (crossover < 0 && treeMs < directMs)
+            crossover = n;
+        printf("%8d %12.3f %12.3f %8.2f %12.3g %8d\n", n, directMs, treeMs, directMs / treeMs, err, tree.nodeCount());
+    }
+
+    if (crossover > 0)
+        printf("tree is faster from N = %d\n", crossover);
+    else
+        printf("tree never overtook direct summation in this range\n");
+    return 0;
+}
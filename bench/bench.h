@@ -0,0 +1,37 @@
+#pragma once
+
+#include <random>
+
+#include "physics/body_state.h"
+
+// Every benchmark is a named entry point, picked on the command line by bench/main.cpp
+using BenchFn = int (*)(int argc, char** argv);
+
+int forceScaling(int argc, char** argv);
+int simdCheck(int argc, char** argv);
+int barnesHutCrossover(int argc, char** argv);
+int fmmAccuracy(int argc, char** argv);
+int fmmThroughput(int argc, char** argv);
+int energyDrift(int argc, char** argv);
+int blockTimestep(int argc, char** argv);
+int collisionScaling(int argc, char** argv);
+int mixedPrecision(int argc, char** argv);
+int smallSystems(int argc, char** argv);
+int ensembleBench(int argc, char** argv);
+int closeEncounters(int argc, char** argv);
+int pmBench(int argc, char** argv);
+int diagnosticsCost(int argc, char** argv);
+int allocationCheck(int argc, char** argv);
+
+// Uniform random cube of bodies at rest, same seed -> same system
+inline BodyState randomCloud(int n, unsigned seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> pos(-1000.0, 1000.0);
+    std::uniform_real_distribution<double> mass(1.0, 100.0);
+    BodyState X;
+    X.reserve(n);
+    for (int i = 0; i < n; ++i)
+        X.push_back(pos(rng), pos(rng), pos(rng), 0.0, 0.0, 0.0, mass(rng));
+    return X;
+}
@@ -0,0 +1,95 @@
+// Block timesteps vs one global step.
+// Usage: bench block_timestep [steps] [dt]
+// Solar system with a moon on a tight orbit around Jupiter, and a Plummer
+// sphere. The block leapfrog runs with dt, the global leapfrog with the finest
+// step the block scheme ended up using, so both resolve the fastest orbit.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "bench.h"
+#include "physics/block_timestep.h"
+#include "physics/gravity.h"
+#include "physics/presets.h"
+
+static double totalEnergy(const BodyState& X, double G)
+{
+    const int N = X.size();
+    double e = 0.0;
+    for (int i = 0; i < N; ++i) {
+        e += 0.5 * X.mass[i] * (X.vx[i] * X.vx[i] + X.vy[i] * X.vy[i] + X.vz[i] * X.vz[i]);
+        for (int j = i + 1; j < N; ++j) {
+            double dx = X.x[j] - X.x[i], dy = X.y[j] - X.y[i], dz = X.z[j] - X.z[i];
+            e -= G * X.mass[i] * X.mass[j] / std::sqrt(dx * dx + dy * dy + dz * dz);
+        }
+    }
+    return e;
+}
+
+static void compare(const char* scene, const BodyState& initial, long steps, double dt)
+{
+    DirectGravity gravity;
+    long long evaluations = 0;
+    auto deriv = [&](const BodyState& X, BodyState& Xdot) {
+        Xdot.x = X.vx;
+        Xdot.y = X.vy;
+        Xdot.z = X.vz;
+        gravity.accelerations(X, PresetG, Xdot.vx.data(), Xdot.vy.data(), Xdot.vz.data());
+        evaluations += X.size();
+    };
+    auto subset = [&](const BodyState& X, const int* targets, int count, double* ax, double* ay, double* az) {
+        gravity.accelerationsFor(X, PresetG, targets, count, ax, ay, az);
+        evaluations += count;
+    };
+
+    const double e0 = totalEnergy(initial, PresetG);
+
+    BlockTimestepper block;
+    BodyState X = initial;
+    auto start = std::chrono::steady_clock::now();
+    for (long s = 0; s < steps; ++s)
+        block.advance(X, dt, deriv, subset);
+    double blockMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    const double blockErr = (totalEnergy(X, PresetG) - e0) / e0;
+    const long long blockEvals = evaluations;
+    const BlockStepStats& st = block.statistics();
+
+    // global leapfrog at the finest level the block run needed
+    const int sub = 1 << st.finestLevel;
+    auto global = makeIntegrator(IntegratorKind::Leapfrog);
+    X = initial;
+    evaluations = 0;
+    start = std::chrono::steady_clock::now();
+    for (long s = 0; s < steps * sub; ++s)
+        global->step(X, dt / sub, deriv);
+    double globalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    const double globalErr = (totalEnergy(X, PresetG) - e0) / e0;
+
+    printf("%s, %d bodies, %ld steps of dt = %g, finest level %d (dt/%d)\n", scene, (int)initial.size(), steps, dt,
+        st.finestLevel, sub);
+    printf("  bodies per level:");
+    for (int k = 0; k < (int)st.bodiesPerLevel.size(); ++k)
+        printf(" %d", st.bodiesPerLevel[k]);
+    printf("\n");
+    printf("  %-16s %14s %14s %10s\n", "integrator", "body evals", "final dE/E0", "ms");
+    printf("  %-16s %14lld %14.3e %10.1f\n", block.name(), blockEvals, blockErr, blockMs);
+    printf("  %-16s %14lld %14.3e %10.1f\n", global->name(), evaluations, globalErr, globalMs);
+    printf("  saved %.1f%% of the force evaluations\n", 100.0 * (1.0 - (double)blockEvals / evaluations));
+}
+
+int blockTimestep(int argc, char** argv)
+{
+    const long steps = argc > 1 ? atol(argv[1]) : 2000;
+    const double dt = argc > 2 ? atof(argv[2]) : 0.1;
+
+    // moon 2 units from Jupiter, period ~1.3 time units
+    BodyState solar = solarSystem();
+    const double r = 2.0, v = std::sqrt(PresetG * solar.mass[5] / r);
+    solar.push_back(solar.x[5] + r, solar.y[5], solar.z[5], solar.vx[5], solar.vy[5] + v, solar.vz[5], 0.01);
+    compare("solar system + close moon", solar, steps, dt);
+
+    compare("plummer sphere", plummerSphere(1000, 3), steps / 10, dt);
+    return 0;
+}
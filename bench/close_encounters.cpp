@@ -0,0 +1,88 @@
+// Softening and subcycled close pairs in a dense scene.
+// Usage: bench close_encounters [N] [eps]
+// A Plummer sphere of N bodies (default 2000) integrated with leapfrog to
+// t = 20, energy error against wall time:
+//   1. unsoftened, Plummer and spline softening of length eps (default 5)
+//      at dt = 1, where the close pairs decide the error
+//   2. spline softened: a global dt of 1/2, 1/4, 1/8 against dt = 1 with
+//      pairs closer than 12 eps on 2, 4, 8 substeps
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "bench.h"
+#include "physics/presets.h"
+#include "physics/simulation.h"
+
+static double totalEnergy(const Simulation& sim)
+{
+    const BodyState& X = sim.state();
+    const Softening& soft = sim.softening();
+    const int N = X.size();
+    double e = 0.0;
+    for (int i = 0; i < N; ++i) {
+        e += 0.5 * X.mass[i] * (X.vx[i] * X.vx[i] + X.vy[i] * X.vy[i] + X.vz[i] * X.vz[i]);
+        for (int j = i + 1; j < N; ++j) {
+            double dx = X.x[j] - X.x[i], dy = X.y[j] - X.y[i], dz = X.z[j] - X.z[i];
+            e += sim.gravity() * X.mass[i] * X.mass[j] * soft.potentialFactor(dx * dx + dy * dy + dz * dz);
+        }
+    }
+    return e;
+}
+
+struct CloseRun
+{
+    double error;
+    double ms;
+    long long rebuilds;
+};
+
+static CloseRun run(const BodyState& X, const Softening& soft, double dt, const Subcycling& sub)
+{
+    Simulation sim(X, PresetG);
+    sim.setIntegrator(IntegratorKind::Leapfrog);
+    sim.setSoftening(soft);
+    sim.setSubcycling(sub);
+
+    const double e0 = totalEnergy(sim);
+    const long steps = std::lround(20.0 / dt);
+    auto start = std::chrono::steady_clock::now();
+    for (long s = 0; s < steps; ++s)
+        sim.step(dt);
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return { std::fabs((totalEnergy(sim) - e0) / e0), ms, sim.neighborRebuilds() };
+}
+
+int closeEncounters(int argc, char** argv)
+{
+    const int n = argc > 1 ? atoi(argv[1]) : 2000;
+    const double eps = argc > 2 ? atof(argv[2]) : 5.0;
+    const BodyState X = plummerSphere(n, 1);
+
+    printf("Plummer sphere, %d bodies, leapfrog to t = 20, eps = %g\n", n, eps);
+    printf("%10s %8s %10s %12s %10s %10s\n", "softening", "dt", "substeps", "|dE/E|", "ms", "rebuilds");
+
+    const SofteningKind kinds[] = { SofteningKind::None, SofteningKind::Plummer, SofteningKind::Spline };
+    const char* names[] = { "none", "plummer", "spline" };
+    for (int k = 0; k < 3; ++k) {
+        const Softening soft { kinds[k], eps };
+        const CloseRun r = run(X, soft, 1.0, Subcycling());
+        printf("%10s %8g %10d %12.3e %10.0f %10s\n", names[k], 1.0, 1, r.error, r.ms, "-");
+    }
+
+    const Softening spline { SofteningKind::Spline, eps };
+    for (int sub = 2; sub <= 8; sub *= 2) {
+        const CloseRun global = run(X, spline, 1.0 / sub, Subcycling());
+        printf("%10s %8g %10d %12.3e %10.0f %10s\n", "spline", 1.0 / sub, 1, global.error, global.ms, "-");
+
+        Subcycling close;
+        close.cutoff = 12.0 * eps;
+        close.skin = 4.0 * eps;
+        close.substeps = sub;
+        const CloseRun cycled = run(X, spline, 1.0, close);
+        printf("%10s %8g %10d %12.3e %10.0f %10lld\n", "spline", 1.0, sub, cycled.error, cycled.ms, cycled.rebuilds);
+    }
+    return 0;
+}
@@ -0,0 +1,96 @@
+// Spatial hash collision detection, time per body from 10k to 1M bodies.
+// Usage: bench collisions [max_bodies]
+// Bodies of radius 1 fill a cube at constant density (box grows with N), so
+// the number of contacts per body stays the same and an O(N) broad phase
+// shows a flat ns/body column. The O(N^2) all-pairs check runs for
+// comparison while it takes reasonable time.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+#include "bench.h"
+#include "physics/collisions.h"
+
+static BodyState cloud(int n, double side, unsigned seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> pos(0.0, side);
+    std::uniform_real_distribution<double> vel(-1.0, 1.0);
+    BodyState X;
+    X.reserve(n);
+    for (int i = 0; i < n; ++i)
+        X.push_back(pos(rng), pos(rng), pos(rng), vel(rng), vel(rng), vel(rng), 1.0 + (i % 7));
+    return X;
+}
+
+static long allPairs(const BodyState& X, const double* radii)
+{
+    const int N = X.size();
+    long found = 0;
+    for (int i = 0; i < N; ++i)
+        for (int j = i + 1; j < N; ++j) {
+            double dx = X.x[j] - X.x[i], dy = X.y[j] - X.y[i], dz = X.z[j] - X.z[i];
+            double reach = radii[i] + radii[j];
+            found += dx * dx + dy * dy + dz * dz < reach * reach;
+        }
+    return found;
+}
+
+int collisionScaling(int argc, char** argv)
+{
+    const int maxBodies = argc > 1 ? atoi(argv[1]) : 1000000;
+    // about 0.5 contacts per body: 4/3 pi 2^3 / volume per body = 1
+    const double volumePerBody = 4.0 / 3.0 * 3.14159265358979 * 8.0;
+
+    printf("%10s %10s %12s %10s %12s %12s %12s\n", "bodies", "contacts", "detect ms", "ns/body", "merge ms", "removed", "pairs ms");
+    for (int n = 10000; n <= maxBodies; n *= 10)
+    {
+        const BodyState initial = cloud(n, std::cbrt(volumePerBody * n), 1);
+        std::vector<double> radii(n, 1.0);
+        CollisionDetector detector;
+        std::vector<std::pair<int, int>> contacts;
+
+        // warm up the buffers, then the best of 5
+        detector.findContacts(initial, radii.data(), false, contacts);
+        double detectMs = 1e30;
+        for (int r = 0; r < 5; ++r) {
+            auto start = std::chrono::steady_clock::now();
+            detector.findContacts(initial, radii.data(), false, contacts);
+            detectMs = std::min(detectMs, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+
+        BodyState X = initial;
+        std::vector<int> absorbed, kept;
+        auto start = std::chrono::steady_clock::now();
+        const int removed = detector.merge(X, radii, false, absorbed);
+        for (int i = 0, a = 0; i < n; ++i) {
+            if (a < removed && absorbed[a] == i) ++a;
+            else kept.push_back(i);
+        }
+        X.keep(kept);
+        const double mergeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        // momentum has to survive the merge
+        double p0 = 0.0, p1 = 0.0;
+        for (size_t i = 0; i < initial.size(); ++i)
+            p0 += initial.mass[i] * initial.vx[i];
+        for (size_t i = 0; i < X.size(); ++i)
+            p1 += X.mass[i] * X.vx[i];
+
+        char pairs[32] = "-";
+        if (n <= 100000) {
+            std::vector<double> ones(n, 1.0);
+            auto s = std::chrono::steady_clock::now();
+            long found = allPairs(initial, ones.data());
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - s).count();
+            snprintf(pairs, sizeof pairs, "%.1f%s", ms, found == (long)contacts.size() ? "" : " MISMATCH");
+        }
+
+        printf("%10d %10zu %12.2f %10.1f %12.2f %12d %12s   momentum x error %.1e\n", n, contacts.size(), detectMs,
+            detectMs * 1e6 / n, mergeMs, removed, pairs, std::fabs(p1 - p0) / std::max(std::fabs(p0), 1e-300));
+    }
+    return 0;
+}
@@ -0,0 +1,140 @@
+// Cost of the energy and momentum diagnostics.
+// Usage: bench diagnostics [N] [every] [steps] [repeats]
+// A Plummer sphere of N bodies (default 1000) per integrator and solver, the
+// direct sum plain and with spline softening (eps = 5, as in bench
+// close_encounters) and the tree. Prints ms per step with diagnostics off,
+// sampled every step and every `every` steps (default 10), and for comparison
+// the same cadence with the potential summed by a second O(N^2) sweep after
+// the step.
+//
+// The four runs of a row step in lockstep and are timed step by step, and
+// every step keeps its best time over `repeats` (default 5) runs of `steps`
+// steps (default 50, after one untimed step that takes the first sample and
+// fills the leapfrog's force cache). A slow spell of the machine thus hits the
+// runs alike and an interrupt only one repeat, which resolves a percent or so
+// where timing whole runs could not. The sampled runs have to end on the same
+// bits as the plain one, the last column checks it.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "bench.h"
+#include "physics/barnes_hut.h"
+#include "physics/presets.h"
+#include "physics/simulation.h"
+
+namespace {
+
+enum class Solver { Direct, Spline, Tree };
+
+// every > 0 samples through the simulation, sweep > 0 after the step with a direct sum
+struct CostRun
+{
+    int every = 0, sweep = 0;
+    std::vector<double> best; // ms of every timed step, best of the repeats
+    BodyState end;
+
+    double msPerStep() const
+    {
+        double sum = 0.0;
+        for (double ms : best)
+            sum += ms;
+        return sum / best.size();
+    }
+};
+
+std::unique_ptr<Simulation> start(const BodyState& X, IntegratorKind kind, Solver solver, const CostRun& r)
+{
+    auto sim = std::make_unique<Simulation>(X, PresetG,
+        solver == Solver::Tree ? std::make_unique<BarnesHutGravity>(0.5) : nullptr);
+    sim->setIntegrator(kind);
+    if (solver == Solver::Spline)
+        sim->setSoftening({ SofteningKind::Spline, 5.0 });
+    sim->setDiagnosticsInterval(r.every);
+    return sim;
+}
+
+void runRow(const BodyState& X, IntegratorKind kind, Solver solver, int steps, int repeats, CostRun* runs, int count)
+{
+    std::vector<double> pot(X.size());
+    Diagnostics separate;
+    for (int c = 0; c < count; ++c)
+        runs[c].best.assign(steps, 1e300);
+
+    for (int r = 0; r < repeats; ++r) {
+        std::vector<std::unique_ptr<Simulation>> sims;
+        for (int c = 0; c < count; ++c) {
+            sims.push_back(start(X, kind, solver, runs[c]));
+            sims.back()->step(1.0);
+        }
+        for (int s = 0; s < steps; ++s) {
+            // who goes first rotates, no run always follows the same one
+            for (int t = 0; t < count; ++t) {
+                const int c = (s + r + t) % count;
+                Simulation& sim = *sims[c];
+                auto t0 = std::chrono::steady_clock::now();
+                sim.step(1.0);
+                if (runs[c].sweep > 0 && sim.steps() % runs[c].sweep == 0) {
+                    ForceBackend::directPotential(sim.state(), PresetG, sim.softening(), pot.data());
+                    DiagnosticsSample d = Diagnostics::measure(sim.state(), sim.steps(), sim.time());
+                    d.potential = Diagnostics::potentialEnergy(sim.state(), pot.data());
+                    separate.add(d);
+                }
+                const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+                runs[c].best[s] = std::min(runs[c].best[s], ms);
+            }
+        }
+        for (int c = 0; c < count; ++c)
+            runs[c].end = sims[c]->state();
+    }
+}
+
+bool sameBits(const BodyState& a, const BodyState& b)
+{
+    const size_t bytes = a.size() * sizeof(double);
+    return memcmp(a.x.data(), b.x.data(), bytes) == 0 && memcmp(a.y.data(), b.y.data(), bytes) == 0
+        && memcmp(a.z.data(), b.z.data(), bytes) == 0 && memcmp(a.vx.data(), b.vx.data(), bytes) == 0
+        && memcmp(a.vy.data(), b.vy.data(), bytes) == 0 && memcmp(a.vz.data(), b.vz.data(), bytes) == 0;
+}
+
+}
+
+int diagnosticsCost(int argc, char** argv)
+{
+    const int n = argc > 1 ? atoi(argv[1]) : 1000;
+    const int every = argc > 2 ? atoi(argv[2]) : 10;
+    const int steps = argc > 3 ? atoi(argv[3]) : 50;
+    const int repeats = argc > 4 ? atoi(argv[4]) : 5;
+    const BodyState X = plummerSphere(n, 1);
+
+    printf("Plummer sphere, %d bodies, %d steps, best of %d per step, ms per step\n", n, steps, repeats);
+    printf("%-16s %-8s %10s %16s %16s %16s %6s\n", "integrator", "solver", "off", "every step",
+        "every K, pass", "every K, sweep", "bits");
+
+    const IntegratorKind kinds[] = { IntegratorKind::RK4, IntegratorKind::Leapfrog };
+    const char* names[] = { "RK4", "leapfrog" };
+    const Solver solvers[] = { Solver::Direct, Solver::Spline, Solver::Tree };
+    const char* solverNames[] = { "direct", "spline", "tree" };
+    for (int k = 0; k < 2; ++k) {
+        for (int v = 0; v < 3; ++v) {
+            CostRun runs[4];
+            runs[1].every = 1;
+            runs[2].every = every;
+            runs[3].sweep = every;
+            runRow(X, kinds[k], solvers[v], steps, repeats, runs, 4);
+
+            const double off = runs[0].msPerStep();
+            auto pct = [&](const CostRun& r) { return 100.0 * (r.msPerStep() - off) / off; };
+            printf("%-16s %-8s %10.2f %9.2f %+5.1f%% %9.2f %+5.1f%% %9.2f %+5.1f%% %6s\n", names[k], solverNames[v],
+                off, runs[1].msPerStep(), pct(runs[1]), runs[2].msPerStep(), pct(runs[2]), runs[3].msPerStep(),
+                pct(runs[3]), sameBits(runs[0].end, runs[1].end) && sameBits(runs[0].end, runs[2].end) ? "same" : "DIFF");
+        }
+    }
+    printf("K = %d\n", every);
+    return 0;
+}
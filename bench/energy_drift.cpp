@@ -0,0 +1,70 @@
+// Energy conservation of the integrators on the built-in solar system.
+// Usage: bench energy_drift [steps] [dt]
+// Runs every integrator for the same number of steps and prints the largest
+// relative energy error seen, the final one, force evaluations and run time.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "bench.h"
+#include "physics/gravity.h"
+#include "physics/integrator.h"
+#include "physics/presets.h"
+
+static double totalEnergy(const BodyState& X, double G)
+{
+    const int N = X.size();
+    double e = 0.0;
+    for (int i = 0; i < N; ++i) {
+        e += 0.5 * X.mass[i] * (X.vx[i] * X.vx[i] + X.vy[i] * X.vy[i] + X.vz[i] * X.vz[i]);
+        for (int j = i + 1; j < N; ++j) {
+            double dx = X.x[j] - X.x[i], dy = X.y[j] - X.y[i], dz = X.z[j] - X.z[i];
+            e -= G * X.mass[i] * X.mass[j] / std::sqrt(dx * dx + dy * dy + dz * dz);
+        }
+    }
+    return e;
+}
+
+int energyDrift(int argc, char** argv)
+{
+    const long steps = argc > 1 ? atol(argv[1]) : 200000;
+    const double dt = argc > 2 ? atof(argv[2]) : 0.1;
+    const IntegratorKind kinds[] = { IntegratorKind::RK4, IntegratorKind::Leapfrog, IntegratorKind::VelocityVerlet };
+    const long sampleEvery = steps / 1000 > 0 ? steps / 1000 : 1;
+
+    DirectGravity gravity;
+    gravity.setSimdLevel(SimdLevel::Scalar);
+    long evaluations = 0;
+    auto deriv = [&](const BodyState& X, BodyState& Xdot) {
+        Xdot.x = X.vx;
+        Xdot.y = X.vy;
+        Xdot.z = X.vz;
+        gravity.accelerations(X, PresetG, Xdot.vx.data(), Xdot.vy.data(), Xdot.vz.data());
+        ++evaluations;
+    };
+
+    printf("solar system, %ld steps of dt = %g\n", steps, dt);
+    printf("%-16s %14s %14s %12s %10s\n", "integrator", "max |dE/E0|", "final dE/E0", "force evals", "ms");
+    for (IntegratorKind kind : kinds)
+    {
+        auto integrator = makeIntegrator(kind);
+        BodyState X = solarSystem();
+        const double e0 = totalEnergy(X, PresetG);
+        double worst = 0.0;
+        evaluations = 0;
+
+        auto start = std::chrono::steady_clock::now();
+        for (long s = 1; s <= steps; ++s) {
+            integrator->step(X, dt, deriv);
+            if (s % sampleEvery == 0)
+                worst = std::fmax(worst, std::fabs((totalEnergy(X, PresetG) - e0) / e0));
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        double final = (totalEnergy(X, PresetG) - e0) / e0;
+        printf("%-16s %14.3e %14.3e %12ld %10.1f\n", integrator->name(), worst, final, evaluations, ms);
+    }
+    return 0;
+}
@@ -0,0 +1,94 @@
+// Monte-Carlo style sweep: perturbed copies of the solar system in an Ensemble.
+// Usage: bench ensemble [systems] [steps] [threads]
+// Steps `systems` nine-body systems with leapfrog, first one at a time through
+// Simulation (a few hundred, scaled up), then all of them through Ensemble at
+// every SIMD level, and prints system-steps per second and the spread of the
+// per-system energy error.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "physics/ensemble.h"
+#include "physics/presets.h"
+#include "physics/simulation.h"
+
+namespace
+{
+    BodyState perturbed(std::mt19937& rng)
+    {
+        std::uniform_real_distribution<double> jitter(-1e-3, 1e-3);
+        BodyState X = solarSystem();
+        for (size_t i = 1; i < X.size(); ++i) {
+            X.vy[i] *= 1.0 + jitter(rng);
+            X.vz[i] = X.vy[i] * jitter(rng);
+        }
+        return X;
+    }
+
+    double seconds(std::chrono::steady_clock::time_point since)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - since).count();
+    }
+}
+
+int ensembleBench(int argc, char** argv)
+{
+    const int systems = argc > 1 ? atoi(argv[1]) : 10000;
+    const int steps = argc > 2 ? atoi(argv[2]) : 1000;
+    const int threads = argc > 3 ? atoi(argv[3]) : (int)std::max(1u, std::thread::hardware_concurrency());
+    const double dt = 0.01;
+
+    printf("%d perturbed solar systems, %d leapfrog steps of %g, %d threads\n", systems, steps, dt, threads);
+
+    // one Simulation per system, the way a sweep was run before
+    {
+        const int sample = std::min(systems, 200);
+        std::mt19937 rng(1);
+        auto start = std::chrono::steady_clock::now();
+        for (int s = 0; s < sample; ++s)
+        {
+            Simulation sim(perturbed(rng), PresetG);
+            sim.setForceThreads(1);
+            sim.setIntegrator(IntegratorKind::Leapfrog);
+            for (int k = 0; k < steps; ++k)
+                sim.step(dt);
+        }
+        printf("%-22s %14.3g system-steps/s (one thread, %d systems)\n", "Simulation", (double)sample * steps / seconds(start), sample);
+    }
+
+    printf("%-22s %14s %12s %12s\n", "ensemble", "system-steps/s", "median dE/E", "worst dE/E");
+    for (SimdLevel level : { SimdLevel::Scalar, SimdLevel::AVX2, SimdLevel::AVX512 })
+    {
+        if (level > detectSimdLevel())
+            continue;
+
+        Ensemble ensemble(PresetG, threads);
+        ensemble.setIntegrator(IntegratorKind::Leapfrog);
+        ensemble.setSimdLevel(level);
+        std::mt19937 rng(1);
+        for (int s = 0; s < systems; ++s)
+            ensemble.add(perturbed(rng));
+
+        auto start = std::chrono::steady_clock::now();
+        ensemble.run(steps, dt);
+        const double rate = (double)systems * steps / seconds(start);
+
+        std::vector<double> err(systems);
+        for (int s = 0; s < systems; ++s)
+            err[s] = ensemble.stats(s).maxEnergyError;
+        std::nth_element(err.begin(), err.begin() + systems / 2, err.end());
+        const double median = err[systems / 2];
+        const double worst = *std::max_element(err.begin(), err.end());
+
+        char name[32];
+        snprintf(name, sizeof(name), "Ensemble %s", simdLevelName(level));
+        printf("%-22s %14.3g %12.2e %12.2e\n", name, rate, median, worst);
+    }
+    return 0;
+}
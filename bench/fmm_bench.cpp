@@ -0,0 +1,75 @@
+// Fast multipole backend.
+// Usage: bench fmm_accuracy [N] [max_order]
+//        bench fmm_throughput [order] [threads]
+// fmm_accuracy prints the force error against direct summation for every
+// expansion order, fmm_throughput times one evaluation at 10^5 and 10^6 bodies.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "bench.h"
+#include "physics/fmm.h"
+#include "physics/gravity.h"
+
+static double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int fmmAccuracy(int argc, char** argv)
+{
+    const int n = argc > 1 ? atoi(argv[1]) : 4000;
+    const int maxOrder = argc > 2 ? atoi(argv[2]) : 8;
+
+    BodyState X = randomCloud(n, 11);
+    std::vector<double> dx(n), dy(n), dz(n), fx(n), fy(n), fz(n);
+
+    DirectGravity direct;
+    auto start = std::chrono::steady_clock::now();
+    direct.accelerations(X, 0.1, dx.data(), dy.data(), dz.data());
+    printf("N = %d, direct summation %.2f ms\n", n, elapsedMs(start));
+    printf("%6s %6s %12s %12s %12s\n", "order", "depth", "rms err", "max err", "ms/eval");
+
+    for (int p = 1; p <= maxOrder && p <= FmmGravity::MaxOrder; ++p)
+    {
+        FmmGravity fmm(p);
+        start = std::chrono::steady_clock::now();
+        fmm.accelerations(X, 0.1, fx.data(), fy.data(), fz.data());
+        double ms = elapsedMs(start);
+
+        double sum = 0.0, worst = 0.0;
+        for (int i = 0; i < n; ++i) {
+            double ex = fx[i] - dx[i], ey = fy[i] - dy[i], ez = fz[i] - dz[i];
+            double rel = std::sqrt((ex * ex + ey * ey + ez * ez) / (dx[i] * dx[i] + dy[i] * dy[i] + dz[i] * dz[i]));
+            sum += rel * rel;
+            worst = rel > worst ? rel : worst;
+        }
+        printf("%6d %6d %12.3g %12.3g %12.2f\n", p, fmm.depth(), std::sqrt(sum / n), worst, ms);
+    }
+    return 0;
+}
+
+int fmmThroughput(int argc, char** argv)
+{
+    const int order = argc > 1 ? atoi(argv[1]) : 4;
+    const int threads = argc > 2 ? atoi(argv[2]) : 1;
+    const int sizes[] = { 100000, 1000000 };
+
+    FmmGravity fmm(order, 64, threads);
+    printf("order %d, %d thread(s)\n", fmm.order(), fmm.threads());
+    printf("%10s %6s %12s %16s\n", "N", "depth", "ms/eval", "bodies/s");
+    for (int n : sizes)
+    {
+        BodyState X = randomCloud(n, 13);
+        std::vector<double> ax(n), ay(n), az(n);
+
+        auto start = std::chrono::steady_clock::now();
+        fmm.accelerations(X, 0.1, ax.data(), ay.data(), az.data());
+        double ms = elapsedMs(start);
+        printf("%10d %6d %12.1f %16.3g\n", n, fmm.depth(), ms, n / (ms * 1e-3));
+    }
+    return 0;
+}
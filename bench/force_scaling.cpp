@@ -0,0 +1,54 @@
+// Thread scaling of the direct-summation force kernel.
+// Usage: bench force_scaling [max_threads]
+// Prints one line per (N, threads) with the time of one full force evaluation
+// and the speedup over the single threaded run.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "physics/gravity.h"
+
+int forceScaling(int argc, char** argv)
+{
+    int maxThreads = argc > 1 ? atoi(argv[1]) : (int)std::thread::hardware_concurrency();
+    if (maxThreads < 1)
+        maxThreads = 1;
+
+    const int sizes[] = { 1000, 10000, 50000 };
+    DirectGravity gravity;
+
+    printf("%8s %8s %12s %8s\n", "N", "threads", "ms/eval", "speedup");
+    for (int n : sizes)
+    {
+        BodyState X = randomCloud(n, 42);
+        std::vector<double> ax(n), ay(n), az(n);
+        // keep the total work per measurement roughly constant
+        const int reps = n <= 1000 ? 200 : n <= 10000 ? 4 : 1;
+        double base = 0.0;
+
+        // 1, 2, 4, ... and finally maxThreads itself
+        for (int t = 1;; t = t * 2 < maxThreads ? t * 2 : maxThreads)
+        {
+            gravity.setThreads(t);
+            gravity.accelerations(X, 0.1, ax.data(), ay.data(), az.data());
+
+            auto start = std::chrono::steady_clock::now();
+            for (int r = 0; r < reps; ++r)
+                gravity.accelerations(X, 0.1, ax.data(), ay.data(), az.data());
+            auto stop = std::chrono::steady_clock::now();
+
+            double ms = std::chrono::duration<double, std::milli>(stop - start).count() / reps;
+            if (t == 1)
+                base = ms;
+            printf("%8d %8d %12.3f %8.2f\n", n, t, ms, base / ms);
+
+            if (t == maxThreads)
+                break;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,45 @@
+// Benchmark driver: bench <name> [args...]
+
+#include <cstdio>
+#include <cstring>
+
+#include "bench.h"
+
+struct BenchEntry {
+    const char* name;
+    BenchFn fn;
+    const char* help;
+};
+
+static const BenchEntry benches[] = {
+    { "force_scaling", forceScaling, "[max_threads]  direct force kernel, 1..max threads at 1k/10k/50k bodies" },
+    { "simd", simdCheck, "               SIMD force kernels vs the scalar reference" },
+    { "barnes_hut", barnesHutCrossover, "[theta]        tree vs direct summation, crossover N" },
+    { "fmm_accuracy", fmmAccuracy, "[N] [max_order] FMM force error per expansion order" },
+    { "fmm_throughput", fmmThroughput, "[order] [threads] FMM evaluation time at 1e5 and 1e6 bodies" },
+    { "energy_drift", energyDrift, "[steps] [dt]   energy error of every integrator on the solar system" },
+    { "block_timestep", blockTimestep, "[steps] [dt]   block timestep leapfrog vs a global step, force evaluations" },
+    { "collisions", collisionScaling, "[max_bodies]   spatial hash collision detection, 10k..1M bodies" },
+    { "mixed_precision", mixedPrecision, "[steps] [dt] float force kernels vs double on the solar system" },
+    { "small_systems", smallSystems, "[systems] [steps] fixed size 2D/3D kernels vs the generic path, solar system" },
+    { "ensemble", ensembleBench, "[systems] [steps] [threads] perturbed solar systems stepped as one ensemble" },
+    { "close_encounters", closeEncounters, "[N] [eps]   softening and subcycled close pairs on a Plummer sphere" },
+    { "pm", pmBench, "[N] [grid] [max_threads] particle-mesh force law, 1e6 bodies on a 256^3 mesh" },
+    { "diagnostics", diagnosticsCost, "[N] [every] [steps] [repeats] diagnostics sampling cost against a plain step" },
+    { "allocations", allocationCheck, "[steps]      fails when a warmed-up RK4, leapfrog or Verlet step allocates" },
+};
+
+int main(int argc, char** argv)
+{
+    if (argc > 1) {
+        for (const auto& b : benches) {
+            if (strcmp(argv[1], b.name) == 0)
+                return b.fn(argc - 1, argv + 1);
+        }
+    }
+
+    printf("usage: bench <name> [args]\n");
+    for (const auto& b : benches)
+        printf("  %-16s %s\n", b.name, b.help);
+    return 1;
+}
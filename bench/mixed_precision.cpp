@@ -0,0 +1,133 @@
+// Accuracy report of the mixed precision force kernels.
+// Usage: bench mixed_precision [steps] [dt]
+// On the built-in solar system, against the all-double pair loop
+// (Simulation::derivative with one thread and SimdLevel::Scalar):
+//   1. relative acceleration error per body, every SIMD level
+//   2. a leapfrog run of `steps` steps in both precisions: energy error of
+//      each, and how far the planets drift apart after 10, 100, ... steps.
+//      Any difference in the forces grows along the orbits (mostly as a phase
+//      shift), so the drift says how long the two runs stay interchangeable.
+// then the time of one evaluation, double vs mixed, on a 10k Plummer sphere.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "bench.h"
+#include "physics/gravity.h"
+#include "physics/presets.h"
+#include "physics/simulation.h"
+
+static double totalEnergy(const BodyState& X, double G)
+{
+    const int N = X.size();
+    double e = 0.0;
+    for (int i = 0; i < N; ++i) {
+        e += 0.5 * X.mass[i] * (X.vx[i] * X.vx[i] + X.vy[i] * X.vy[i] + X.vz[i] * X.vz[i]);
+        for (int j = i + 1; j < N; ++j) {
+            double dx = X.x[j] - X.x[i], dy = X.y[j] - X.y[i], dz = X.z[j] - X.z[i];
+            e -= G * X.mass[i] * X.mass[j] / std::sqrt(dx * dx + dy * dy + dz * dz);
+        }
+    }
+    return e;
+}
+
+static void reference(Simulation& sim)
+{
+    sim.setForceThreads(1);
+    sim.setForceSimd(SimdLevel::Scalar);
+    sim.setForcePrecision(ForcePrecision::Double);
+}
+
+int mixedPrecision(int argc, char** argv)
+{
+    const long steps = argc > 1 ? atol(argv[1]) : 100000;
+    const double dt = argc > 2 ? atof(argv[2]) : 0.1;
+    const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2, SimdLevel::AVX512 };
+    const BodyState solar = solarSystem();
+    const int N = solar.size();
+
+    Simulation exact(solar, PresetG);
+    reference(exact);
+    BodyState ref(N), got(N);
+    exact.derivative(solar, ref);
+
+    printf("solar system, acceleration error vs the double pair loop\n");
+    printf("%8s %14s %14s\n", "level", "max rel err", "rms rel err");
+    for (SimdLevel level : levels)
+    {
+        if (level > detectSimdLevel())
+            break;
+        Simulation mixed(solar, PresetG);
+        mixed.setForceThreads(1);
+        mixed.setForceSimd(level);
+        mixed.setForcePrecision(ForcePrecision::Mixed);
+        mixed.derivative(solar, got);
+
+        double worst = 0.0, sum = 0.0;
+        for (int i = 0; i < N; ++i) {
+            double ex = got.vx[i] - ref.vx[i], ey = got.vy[i] - ref.vy[i], ez = got.vz[i] - ref.vz[i];
+            double r = std::sqrt(ex * ex + ey * ey + ez * ez)
+                / std::sqrt(ref.vx[i] * ref.vx[i] + ref.vy[i] * ref.vy[i] + ref.vz[i] * ref.vz[i]);
+            worst = std::max(worst, r);
+            sum += r * r;
+        }
+        printf("%8s %14.3e %14.3e\n", simdLevelName(level), worst, std::sqrt(sum / N));
+    }
+
+    // the same run in both precisions
+    Simulation mixed(solar, PresetG);
+    mixed.setForceThreads(1);
+    mixed.setForcePrecision(ForcePrecision::Mixed);
+    exact.setIntegrator(IntegratorKind::Leapfrog);
+    mixed.setIntegrator(IntegratorKind::Leapfrog);
+
+    printf("\nleapfrog, %ld steps of dt = %g (%s kernels)\n", steps, dt, simdLevelName(detectSimdLevel()));
+    printf("%10s %14s %14s %16s\n", "steps", "double dE/E0", "mixed dE/E0", "max planet diff");
+    const double e0 = totalEnergy(solar, PresetG);
+    double worstExact = 0.0, worstMixed = 0.0;
+    for (long s = 1, report = 10; s <= steps; ++s)
+    {
+        exact.step(dt);
+        mixed.step(dt);
+        if (s != report && s != steps)
+            continue;
+        report *= 10;
+        const BodyState& A = exact.state();
+        const BodyState& B = mixed.state();
+        worstExact = std::max(worstExact, std::fabs((totalEnergy(A, PresetG) - e0) / e0));
+        worstMixed = std::max(worstMixed, std::fabs((totalEnergy(B, PresetG) - e0) / e0));
+        // planet separation relative to its distance from the sun
+        double drift = 0.0;
+        for (int i = 1; i < N; ++i) {
+            double dx = B.x[i] - A.x[i], dy = B.y[i] - A.y[i], dz = B.z[i] - A.z[i];
+            double rx = A.x[i] - A.x[0], ry = A.y[i] - A.y[0], rz = A.z[i] - A.z[0];
+            drift = std::max(drift, std::sqrt((dx * dx + dy * dy + dz * dz) / (rx * rx + ry * ry + rz * rz)));
+        }
+        printf("%10ld %14.3e %14.3e %16.3e\n", s, (totalEnergy(A, PresetG) - e0) / e0, (totalEnergy(B, PresetG) - e0) / e0, drift);
+    }
+    printf("max |dE/E0|: double %.3e, mixed %.3e\n", worstExact, worstMixed);
+
+    // throughput, one thread, best level
+    const int n = 10000;
+    const BodyState cloud = plummerSphere(n, 1);
+    std::vector<double> ax(n), ay(n), az(n);
+    printf("\n%d body Plummer sphere, one evaluation on one thread\n", n);
+    double ms[2] = {};
+    for (int p = 0; p < 2; ++p)
+    {
+        DirectGravity gravity;
+        gravity.setPrecision(p == 0 ? ForcePrecision::Double : ForcePrecision::Mixed);
+        gravity.accelerations(cloud, PresetG, ax.data(), ay.data(), az.data());
+        ms[p] = 1e30;
+        for (int r = 0; r < 3; ++r) {
+            auto start = std::chrono::steady_clock::now();
+            gravity.accelerations(cloud, PresetG, ax.data(), ay.data(), az.data());
+            ms[p] = std::min(ms[p], std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+    }
+    printf("double %.1f ms, mixed %.1f ms, %.2fx\n", ms[0], ms[1], ms[0] / ms[1]);
+    return 0;
+}
@@ -0,0 +1,65 @@
+// Vectorized force kernels against the scalar reference.
+// Usage: bench simd
+// For every SIMD level this CPU supports prints the time of one force
+// evaluation and the worst relative error per body, and fails if the error
+// is above SimdTolerance. The last two clouds are scaled so squared distances
+// fall outside the float range, above 3e38 and below 1e-38.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "bench.h"
+#include "physics/gravity.h"
+
+int simdCheck(int, char**)
+{
+    struct Case { int n; double scale; };
+    const Case cases[] = { { 1003, 1.0 }, { 10000, 1.0 }, { 1003, 1e25 }, { 1003, 1e-25 } };
+    const SimdLevel levels[] = { SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2, SimdLevel::AVX512 };
+    int failures = 0;
+
+    printf("detected: %s, tolerance %g\n", simdLevelName(detectSimdLevel()), SimdTolerance);
+    printf("%8s %8s %8s %12s %12s\n", "N", "scale", "level", "ms/eval", "max rel err");
+    for (const Case& c : cases)
+    {
+        const int n = c.n;
+        BodyState X = randomCloud(n, 7);
+        for (int i = 0; i < n; ++i)
+        {
+            X.x[i] *= c.scale;
+            X.y[i] *= c.scale;
+            X.z[i] *= c.scale;
+        }
+        std::vector<double> rx(n), ry(n), rz(n);
+        DirectGravity::accelerationRows(X, 0.1, 0, n, rx.data(), ry.data(), rz.data());
+
+        std::vector<double> ax(n), ay(n), az(n);
+        const int reps = n <= 1003 ? 100 : 2;
+        for (SimdLevel level : levels)
+        {
+            if (level > detectSimdLevel())
+                break;
+
+            auto start = std::chrono::steady_clock::now();
+            for (int r = 0; r < reps; ++r)
+                simdAccelerationRows(level, X, 0.1, 0, n, ax.data(), ay.data(), az.data());
+            auto stop = std::chrono::steady_clock::now();
+            double ms = std::chrono::duration<double, std::milli>(stop - start).count() / reps;
+
+            double worst = 0.0;
+            for (int i = 0; i < n; ++i)
+            {
+                double ex = ax[i] - rx[i], ey = ay[i] - ry[i], ez = az[i] - rz[i];
+                double ref = std::sqrt(rx[i] * rx[i] + ry[i] * ry[i] + rz[i] * rz[i]);
+                worst = std::max(worst, std::sqrt(ex * ex + ey * ey + ez * ez) / ref);
+            }
+            bool ok = worst <= SimdTolerance;
+            failures += !ok;
+            printf("%8d %8.0e %8s %12.3f %12.3g%s\n", n, c.scale, simdLevelName(level), ms, worst, ok ? "" : "  FAIL");
+        }
+    }
+    return failures == 0 ? 0 : 1;
+}
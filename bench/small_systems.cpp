@@ -0,0 +1,83 @@
+// Many small planetary systems, the fixed size kernels against the generic path.
+// Usage: bench small_systems [systems] [steps]
+// Steps `systems` copies of the solar system (9 bodies) one after the other,
+// in 3D and in 2D, with RK4 and leapfrog: through SmallSystemStepper, through
+// the generic steppers with the scalar pair loop and with the SIMD kernels
+// (one thread each, a pool per system would cost more than it saves).
+// "fixed" is what Simulation picks with the fixed kernels on, so a 3D leapfrog
+// with AVX2 or AVX-512 shows the generic path twice. The last column is the
+// largest position difference between the fixed and the scalar path over
+// the orbit radius, 0 at SimdLevel::Scalar where they match bit for bit.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "bench.h"
+#include "physics/presets.h"
+#include "physics/simulation.h"
+
+namespace
+{
+    enum class Path { Fixed, Scalar, Simd };
+
+    double run(int systems, long steps, IntegratorKind kind, bool planar, Path path, BodyState& last)
+    {
+        std::mt19937 rng(7);
+        std::uniform_real_distribution<double> jitter(-1e-3, 1e-3);
+
+        double ms = 0.0;
+        for (int s = 0; s < systems; ++s)
+        {
+            BodyState X = solarSystem();
+            for (size_t i = 1; i < X.size(); ++i)
+                X.vy[i] += jitter(rng);
+
+            Simulation sim(X, PresetG);
+            sim.setForceThreads(1);
+            sim.setIntegrator(kind);
+            sim.setPlanar(planar);
+            sim.setFixedKernels(path == Path::Fixed);
+            if (path == Path::Scalar)
+                sim.setForceSimd(SimdLevel::Scalar);
+
+            auto start = std::chrono::steady_clock::now();
+            for (long k = 0; k < steps; ++k)
+                sim.step(0.1);
+            ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            last = sim.state();
+        }
+        return ms;
+    }
+}
+
+int smallSystems(int argc, char** argv)
+{
+    const int systems = argc > 1 ? atoi(argv[1]) : 1000;
+    const long steps = argc > 2 ? atol(argv[2]) : 1000;
+
+    printf("%d solar systems, %ld steps each, one thread (%s kernels)\n", systems, steps, simdLevelName(detectSimdLevel()));
+    printf("%-16s %4s %12s %12s %12s %9s %10s\n", "integrator", "dim", "fixed ms", "scalar ms", "simd ms", "speedup", "max diff");
+    for (IntegratorKind kind : { IntegratorKind::RK4, IntegratorKind::Leapfrog })
+        for (bool planar : { false, true })
+        {
+            BodyState a, b, c;
+            const double fixed = run(systems, steps, kind, planar, Path::Fixed, a);
+            const double scalar = run(systems, steps, kind, planar, Path::Scalar, b);
+            const double simd = run(systems, steps, kind, planar, Path::Simd, c);
+
+            double diff = 0.0;
+            for (size_t i = 1; i < a.size(); ++i)
+            {
+                const double dx = a.x[i] - b.x[i], dy = a.y[i] - b.y[i], dz = a.z[i] - b.z[i];
+                diff = std::max(diff, std::sqrt((dx * dx + dy * dy + dz * dz) / (b.x[i] * b.x[i] + b.y[i] * b.y[i] + b.z[i] * b.z[i])));
+            }
+
+            const double best = scalar < simd ? scalar : simd;
+            printf("%-16s %4s %12.1f %12.1f %12.1f %8.2fx %10.1e\n", makeIntegrator(kind)->name(), planar ? "2D" : "3D",
+                fixed, scalar, simd, best / fixed, diff);
+        }
+    return 0;
+}
@@ -176,6 +176,9 @@ if (downloadRaylib) then
         flags { "ShadowedVariables"}
         platform_defines()
 
+        -- frame profiler markers (F3 overlay), remove to compile them out
+        defines {"NBODY_PROFILE"}
+
         filter "action:vs*"
             defines{"_WINSOCK_DEPRECATED_NO_WARNINGS", "_CRT_SECURE_NO_WARNINGS"}
             dependson {"raylib"}
@@ -197,6 +200,86 @@ if (downloadRaylib) then
         filter{}
 		
 
+    project "bench"
+        kind "ConsoleApp"
+        location "build_files/"
+        targetdir "../bin/%{cfg.buildcfg}"
+
+        vpaths
+        {
+            ["Header Files/*"] = { "../bench/**.h", "../src/physics/**.h"},
+            ["Source Files/*"] = { "../bench/**.cpp", "../src/physics/**.cpp"},
+        }
+        files {"../bench/**.cpp", "../bench/**.h", "../src/physics/**.cpp", "../src/physics/**.h"}
+
+        includedirs { "../src" }
+
+        cdialect "C17"
+        cppdialect "C++17"
+
+        filter "action:vs*"
+            buildoptions { "/Zc:__cplusplus" }
+
+        filter "system:linux"
+            links {"pthread"}
+
+        filter{}
+
+    project "headless"
+        kind "ConsoleApp"
+        location "build_files/"
+        targetdir "../bin/%{cfg.buildcfg}"
+
+        vpaths
+        {
+            ["Header Files/*"] = { "../src/physics/**.h"},
+            ["Source Files/*"] = { "../headless/**.cpp", "../src/physics/**.cpp"},
+        }
+        files {"../headless/**.cpp", "../src/physics/**.cpp", "../src/physics/**.h"}
+
+        includedirs { "../src" }
+
+        cdialect "C17"
+        cppdialect "C++17"
+
+        filter "action:vs*"
+            defines{"_CRT_SECURE_NO_WARNINGS"}
+            buildoptions { "/Zc:__cplusplus" }
+
+        filter "system:linux"
+            links {"pthread"}
+
+        filter{}
+
+    project "gbench"
+        kind "ConsoleApp"
+        location "build_files/"
+        targetdir "../bin/%{cfg.buildcfg}"
+
+        vpaths
+        {
+            ["Header Files/*"] = { "../src/physics/**.h"},
+            ["Source Files/*"] = { "../gbench/**.cpp", "../src/physics/**.cpp"},
+        }
+        files {"../gbench/**.cpp", "../src/physics/**.cpp", "../src/physics/**.h"}
+
+        includedirs { "../src" }
+
+        cdialect "C17"
+        cppdialect "C++17"
+
+        -- needs Google Benchmark installed (libbenchmark-dev, vcpkg or brew "google-benchmark")
+        links {"benchmark"}
+
+        filter "action:vs*"
+            buildoptions { "/Zc:__cplusplus" }
+            links {"shlwapi"}
+
+        filter "system:linux"
+            links {"pthread"}
+
+        filter{}
+
     project "raylib"
         kind "StaticLib"
     
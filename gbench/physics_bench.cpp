@@ -0,0 +1,119 @@
+// Google Benchmark suite of the physics core, for tracking regressions between releases.
+// Usage: gbench [--benchmark_filter=REGEX] [any other Google Benchmark flag]
+// Results go to gbench.json (JSON) next to the console table, unless
+// --benchmark_out is given.
+//
+// StateDir and rk4 are the force evaluation and the RK4 step of the window
+// app, which live in Simulation::derivative() and Simulation::step() now.
+// Every case runs on the solar system padded with an asteroid belt and on a
+// Plummer sphere, at N = 10, 100, 1k and 10k, on one thread with the
+// original pair loop.
+
+#include <cstring>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "physics/presets.h"
+#include "physics/simulation.h"
+
+enum Input { Solar, Plummer };
+
+static BodyState makeInput(Input input, int n)
+{
+    return input == Solar ? solarSystemWithBelt(n, 1) : plummerSphere(n, 1);
+}
+
+static void setupPairLoop(Simulation& sim)
+{
+    sim.setForceThreads(1);
+    sim.setForceSimd(SimdLevel::Scalar);
+}
+
+static void BM_StateDir(benchmark::State& state, Input input)
+{
+    const int n = state.range(0);
+    Simulation sim(makeInput(input, n), PresetG);
+    setupPairLoop(sim);
+    BodyState Xdot(n);
+
+    for (auto _ : state) {
+        sim.derivative(sim.state(), Xdot);
+        benchmark::DoNotOptimize(Xdot.vx.data());
+        benchmark::ClobberMemory();
+    }
+    state.counters["pairs/s"] = benchmark::Counter((double)n * (n - 1) / 2, benchmark::Counter::kIsIterationInvariantRate);
+}
+
+static void BM_Rk4(benchmark::State& state, Input input)
+{
+    const int n = state.range(0);
+    Simulation sim(makeInput(input, n), PresetG);
+    setupPairLoop(sim);
+    sim.setIntegrator(IntegratorKind::RK4);
+
+    for (auto _ : state) {
+        sim.step(0.1f);
+        benchmark::DoNotOptimize(sim.state().x.data());
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+
+static void BM_Combinations(benchmark::State& state)
+{
+    const int n = state.range(0);
+    for (auto _ : state) {
+        auto pairs = Simulation::combinations(n);
+        benchmark::DoNotOptimize(pairs.data());
+    }
+    state.counters["pairs"] = (double)n * (n - 1) / 2;
+}
+
+// One Add_On_Click worth of work, a single body appended
+static void BM_Insert(benchmark::State& state, Input input)
+{
+    const int n = state.range(0);
+    const BodyState X = makeInput(input, n);
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        Simulation sim(X, PresetG);
+        state.ResumeTiming();
+
+        sim.addBody(10.0, 20.0, 0.0, 1.0, -1.0, 0.0, 50.0);
+        benchmark::DoNotOptimize(sim.state().x.data());
+    }
+}
+
+#define SIZES Arg(10)->Arg(100)->Arg(1000)->Arg(10000)
+
+BENCHMARK_CAPTURE(BM_StateDir, solar, Solar)->SIZES;
+BENCHMARK_CAPTURE(BM_StateDir, plummer, Plummer)->SIZES;
+BENCHMARK_CAPTURE(BM_Rk4, solar, Solar)->SIZES->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_Rk4, plummer, Plummer)->SIZES->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_Combinations)->SIZES->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_Insert, solar, Solar)->SIZES->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_Insert, plummer, Plummer)->SIZES->Unit(benchmark::kMicrosecond);
+
+int main(int argc, char** argv)
+{
+    // JSON file by default, so CI can keep and compare the numbers
+    std::vector<char*> args(argv, argv + argc);
+    bool out = false;
+    for (char* a : args)
+        out = out || strncmp(a, "--benchmark_out=", 16) == 0;
+    static char file[] = "--benchmark_out=gbench.json";
+    static char format[] = "--benchmark_out_format=json";
+    if (!out) {
+        args.push_back(file);
+        args.push_back(format);
+    }
+
+    int count = args.size();
+    benchmark::Initialize(&count, args.data());
+    if (benchmark::ReportUnrecognizedArguments(count, args.data()))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,322 @@
+// Headless runner: integrates a scene without a window as fast as the CPU allows.
+// Usage: headless [options]
+//   --preset solar|plummer|uniform
+//                            initial conditions (default solar), uniform is a cold box of side 2000
+//   --bodies N --seed S      Plummer sphere or box size and seed (default 1000, 1)
+//   --input FILE             initial conditions, one body per line: x y z vx vy vz m
+//   --load FILE              resume from a binary snapshot (G, time and step count included)
+//   --steps N --dt DT        number of steps and step size (default 10000, 0.1)
+//   --integrator NAME        rk4, leapfrog, verlet or block (default rk4)
+//   --solver NAME            direct, barnes-hut, fmm or pm (default direct)
+//   --grid N --box L         pm mesh size (default 64) and periodic box [0, L)^3
+//                            (default 2000 for the uniform preset, else fitted around the bodies)
+//   --threads N              force threads (default all cores)
+//   --precision NAME         double or mixed, direct solver only (default double)
+//   --softening NAME --eps E none, plummer or spline softening of length E (default none)
+//   --subcycle N --cutoff R --skin S
+//                            leapfrog only: pairs closer than R on N substeps, neighbor list skin S
+//   --G VALUE --2d           gravitational constant (default PresetG), planar mode
+//   --output FILE            final state and timing, same format as --input (default stdout)
+//   --save FILE              final state as a binary snapshot
+//   --checkpoint FILE --checkpoint-every N
+//                            snapshot every N-th step of the run's step count, which a
+//                            restart with --load FILE continues, so the cadence holds
+//   --record FILE --record-every K --quantum Q
+//                            trajectory of every K-th step, positions to Q (default 1, 1e-3)
+//   --diagnostics FILE --diagnostics-every K
+//                            energy, momentum, angular momentum and centre of mass of every
+//                            K-th step as CSV (default 100)
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#include "physics/barnes_hut.h"
+#include "physics/fmm.h"
+#include "physics/pm.h"
+#include "physics/presets.h"
+#include "physics/simulation.h"
+#include "physics/snapshot.h"
+#include "physics/trajectory.h"
+
+static bool loadBodies(const char* path, BodyState& X)
+{
+    FILE* f = fopen(path, "r");
+    if (!f)
+        return false;
+
+    char line[512];
+    while (fgets(line, sizeof line, f)) {
+        double b[7];
+        if (line[0] == '#')
+            continue;
+        if (sscanf(line, "%lf %lf %lf %lf %lf %lf %lf", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5], &b[6]) == 7)
+            X.push_back(b[0], b[1], b[2], b[3], b[4], b[5], b[6]);
+    }
+    fclose(f);
+    return true;
+}
+
+static void usage()
+{
+    fprintf(stderr,
+        "usage: headless [--preset solar|plummer|uniform] [--bodies N] [--seed S] [--input FILE]\n"
+        "                [--steps N] [--dt DT] [--integrator rk4|leapfrog|verlet|block]\n"
+        "                [--solver direct|barnes-hut|fmm|pm] [--grid N] [--box L] [--threads N]\n"
+        "                [--G VALUE] [--2d]\n"
+        "                [--precision double|mixed] [--softening none|plummer|spline] [--eps E]\n"
+        "                [--subcycle N --cutoff R] [--skin S]\n"
+        "                [--output FILE] [--load FILE] [--save FILE]\n"
+        "                [--checkpoint FILE --checkpoint-every N]\n"
+        "                [--record FILE] [--record-every K] [--quantum Q]\n"
+        "                [--diagnostics FILE] [--diagnostics-every K]\n");
+}
+
+int main(int argc, char** argv)
+{
+    const char* preset = "solar";
+    const char* input = nullptr;
+    const char* output = nullptr;
+    const char* solverName = "direct";
+    const char* load = nullptr;
+    const char* save = nullptr;
+    const char* checkpoint = nullptr;
+    long checkpointEvery = 0;
+    const char* record = nullptr;
+    TrajectoryWriter::Options recordOptions;
+    const char* diagnostics = nullptr;
+    int diagnosticsEvery = 100;
+    bool setG = false;
+    int bodies = 1000;
+    unsigned seed = 1;
+    long steps = 10000;
+    double dt = 0.1;
+    double G = PresetG;
+    int grid = 64;
+    double box = 0.0;
+    bool planar = false;
+    int threads = std::thread::hardware_concurrency();
+    IntegratorKind kind = IntegratorKind::RK4;
+    ForcePrecision precision = ForcePrecision::Double;
+    Softening softening;
+    Subcycling subcycling;
+
+    for (int a = 1; a < argc; ++a)
+    {
+        const char* opt = argv[a];
+        const char* val = a + 1 < argc ? argv[a + 1] : nullptr;
+        auto need = [&] {
+            if (!val) {
+                fprintf(stderr, "%s needs a value\n", opt);
+                exit(1);
+            }
+            ++a;
+            return val;
+        };
+
+        if (strcmp(opt, "--preset") == 0) preset = need();
+        else if (strcmp(opt, "--bodies") == 0) bodies = atoi(need());
+        else if (strcmp(opt, "--seed") == 0) seed = (unsigned)atol(need());
+        else if (strcmp(opt, "--input") == 0) input = need();
+        else if (strcmp(opt, "--steps") == 0) steps = atol(need());
+        else if (strcmp(opt, "--dt") == 0) dt = atof(need());
+        else if (strcmp(opt, "--solver") == 0) solverName = need();
+        else if (strcmp(opt, "--threads") == 0) threads = atoi(need());
+        else if (strcmp(opt, "--grid") == 0) grid = atoi(need());
+        else if (strcmp(opt, "--box") == 0) box = atof(need());
+        else if (strcmp(opt, "--G") == 0) G = atof(need()), setG = true;
+        else if (strcmp(opt, "--2d") == 0) planar = true;
+        else if (strcmp(opt, "--output") == 0) output = need();
+        else if (strcmp(opt, "--load") == 0) load = need();
+        else if (strcmp(opt, "--save") == 0) save = need();
+        else if (strcmp(opt, "--checkpoint") == 0) checkpoint = need();
+        else if (strcmp(opt, "--checkpoint-every") == 0) checkpointEvery = atol(need());
+        else if (strcmp(opt, "--record") == 0) record = need();
+        else if (strcmp(opt, "--record-every") == 0) recordOptions.every = atoi(need());
+        else if (strcmp(opt, "--quantum") == 0) recordOptions.quantum = atof(need());
+        else if (strcmp(opt, "--diagnostics") == 0) diagnostics = need();
+        else if (strcmp(opt, "--diagnostics-every") == 0) diagnosticsEvery = atoi(need());
+        else if (strcmp(opt, "--eps") == 0) softening.eps = atof(need());
+        else if (strcmp(opt, "--subcycle") == 0) subcycling.substeps = atoi(need());
+        else if (strcmp(opt, "--cutoff") == 0) subcycling.cutoff = atof(need());
+        else if (strcmp(opt, "--skin") == 0) subcycling.skin = atof(need());
+        else if (strcmp(opt, "--integrator") == 0) {
+            const char* name = need();
+            if (strcmp(name, "rk4") == 0) kind = IntegratorKind::RK4;
+            else if (strcmp(name, "leapfrog") == 0) kind = IntegratorKind::Leapfrog;
+            else if (strcmp(name, "verlet") == 0) kind = IntegratorKind::VelocityVerlet;
+            else if (strcmp(name, "block") == 0) kind = IntegratorKind::BlockLeapfrog;
+            else {
+                fprintf(stderr, "unknown integrator %s\n", name);
+                return 1;
+            }
+        }
+        else if (strcmp(opt, "--precision") == 0) {
+            const char* name = need();
+            if (strcmp(name, "double") == 0) precision = ForcePrecision::Double;
+            else if (strcmp(name, "mixed") == 0) precision = ForcePrecision::Mixed;
+            else {
+                fprintf(stderr, "unknown precision %s\n", name);
+                return 1;
+            }
+        }
+        else if (strcmp(opt, "--softening") == 0) {
+            const char* name = need();
+            if (strcmp(name, "none") == 0) softening.kind = SofteningKind::None;
+            else if (strcmp(name, "plummer") == 0) softening.kind = SofteningKind::Plummer;
+            else if (strcmp(name, "spline") == 0) softening.kind = SofteningKind::Spline;
+            else {
+                fprintf(stderr, "unknown softening %s\n", name);
+                return 1;
+            }
+        }
+        else {
+            usage();
+            return 1;
+        }
+    }
+
+    BodyState X;
+    Snapshot resume;
+    std::string error;
+    if (load) {
+        if (!loadSnapshot(load, resume, error)) {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        X = resume.state;
+        if (!setG)
+            G = resume.G;
+        planar = planar || resume.planar;
+    }
+    else if (input) {
+        if (!loadBodies(input, X)) {
+            fprintf(stderr, "cannot read %s\n", input);
+            return 1;
+        }
+    }
+    else if (strcmp(preset, "solar") == 0) {
+        X = solarSystem();
+    }
+    else if (strcmp(preset, "plummer") == 0) {
+        X = plummerSphere(bodies, seed, G);
+    }
+    else if (strcmp(preset, "uniform") == 0) {
+        X = uniformBox(bodies, seed);
+        if (box <= 0.0)
+            box = 2000.0;
+    }
+    else {
+        fprintf(stderr, "unknown preset %s\n", preset);
+        return 1;
+    }
+
+    std::unique_ptr<ForceBackend> solver;
+    if (strcmp(solverName, "barnes-hut") == 0)
+        solver = std::make_unique<BarnesHutGravity>();
+    else if (strcmp(solverName, "fmm") == 0)
+        solver = std::make_unique<FmmGravity>();
+    else if (strcmp(solverName, "pm") == 0) {
+        if (grid < 8 || (grid & (grid - 1)) != 0) {
+            fprintf(stderr, "--grid has to be a power of two from 8\n");
+            return 1;
+        }
+        auto pm = std::make_unique<PmGravity>(grid);
+        if (box > 0.0)
+            pm->setBox(0.0, 0.0, 0.0, box);
+        solver = std::move(pm);
+    }
+    else if (strcmp(solverName, "direct") != 0) {
+        fprintf(stderr, "unknown solver %s\n", solverName);
+        return 1;
+    }
+
+    Simulation sim(X, G, std::move(solver));
+    sim.setForceThreads(threads);
+    sim.setIntegrator(kind);
+    sim.setForcePrecision(precision);
+    sim.setSoftening(softening);
+    sim.setSubcycling(subcycling);
+    sim.setPlanar(planar);
+    if (load)
+        sim.reset(X, G, resume.time, resume.step);
+
+    auto writeSnapshot = [&](const char* path) {
+        if (!saveSnapshot(path, sim.state(), nullptr, nullptr, G, sim.time(), sim.steps(), planar, error)) {
+            fprintf(stderr, "%s\n", error.c_str());
+            return false;
+        }
+        return true;
+    };
+
+    TrajectoryWriter recorder;
+    if (record && !recorder.open(record, G, recordOptions, error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    recorder.record(sim.state(), sim.steps(), sim.time(), &sim.ids());
+
+    if (diagnostics) {
+        if (diagnosticsEvery < 1) {
+            fprintf(stderr, "--diagnostics-every has to be at least 1\n");
+            return 1;
+        }
+        if (!sim.diagnostics().open(diagnostics, error)) {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        sim.setDiagnosticsInterval(diagnosticsEvery);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (long s = 1; s <= steps; ++s) {
+        sim.step(dt);
+        recorder.record(sim.state(), sim.steps(), sim.time(), &sim.ids());
+        if (checkpoint && checkpointEvery > 0 && sim.steps() % checkpointEvery == 0 && !writeSnapshot(checkpoint))
+            return 1;
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    sim.finishDiagnostics();
+    sim.diagnostics().close();
+
+    recorder.close();
+    if (record) {
+        if (!recorder.error().empty()) {
+            fprintf(stderr, "%s\n", recorder.error().c_str());
+            return 1;
+        }
+        fprintf(stderr, "recorded %lld frames (%lld dropped), %lld bytes\n", recorder.framesWritten(),
+            recorder.framesDropped(), recorder.bytesWritten());
+    }
+
+    FILE* out = output ? fopen(output, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "cannot write %s\n", output);
+        return 1;
+    }
+
+    const BodyState& Y = sim.state();
+    fprintf(out, "# %d bodies, %s, %s solver, %d threads\n", (int)Y.size(), sim.activeIntegrator().name(), solverName,
+        sim.forceThreads());
+    fprintf(out, "# %lld steps of dt = %g to t = %.17g\n", sim.steps(), dt, sim.time());
+    fprintf(out, "# %.6f s, %.1f steps/s, %.1f ns per body step\n", seconds, steps / seconds,
+        1e9 * seconds / ((double)steps * (Y.size() > 0 ? Y.size() : 1)));
+    if (sim.usesSubcycling())
+        fprintf(out, "# %d substeps within %g, %lld neighbor list rebuilds\n", sim.subcycling().substeps,
+            sim.subcycling().cutoff, sim.neighborRebuilds());
+    if (diagnostics)
+        fprintf(out, "# %d diagnostics samples, dE/E0 = %.6e\n", (int)sim.diagnostics().samples().size(),
+            sim.diagnostics().energyError());
+    fprintf(out, "# x y z vx vy vz m\n");
+    for (int i = 0; i < (int)Y.size(); ++i) {
+        fprintf(out, "%.17g %.17g %.17g %.17g %.17g %.17g %.17g\n",
+            Y.x[i], Y.y[i], Y.z[i], Y.vx[i], Y.vy[i], Y.vz[i], Y.mass[i]);
+    }
+
+    if (out != stdout)
+        fclose(out);
+    return save && !writeSnapshot(save) ? 1 : 0;
+}
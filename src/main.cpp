@@ -1,376 +1,960 @@
-#include <iostream>
-#include <cmath>
-#include "raylib.h"
-#include <cassert>
-#include <utility>
-#include <vector>
-#include <string>
-#include <array>
-#include <raymath.h>
-using namespace std;
-
-//for matrices
-using Matrix2x2 = std::vector<std::vector<double>>;
-
-// The whole system class
-class NbodySimulation {
-public:
-    //Constructor to set start objects
-    NbodySimulation(const vector<vector<double>>& Xi,
-        const vector<double>& masses,
-        const vector<int>& radii,
-        const vector<Color>& colors,
-        double G = 6.674e-11)
-        : Xi(Xi), masses(masses), radii(radii), colors(colors), G(G),
-        pairs(combinations(Xi.size())),
-        trails(Xi.size())
-    {
-        assert(Xi.size() == masses.size() && masses.size() == radii.size() && radii.size() == colors.size());
-        for (const auto& x : Xi) {
-            assert(x.size() == 6);
-        }
-    }
-
-    //Useful variables
-    int getN() const { return Xi.size(); }
-    int totalCombs = Xi.size() - 1;
-
-    // NOTE: This variable needs to be updated from main
-    bool TwoD = false;
-
-    Color AllColors[21] = {
-       DARKGRAY, MAROON, ORANGE, DARKGREEN, DARKBLUE, DARKPURPLE, DARKBROWN,
-       GRAY, RED, GOLD, LIME, BLUE, VIOLET, BROWN, LIGHTGRAY, PINK, YELLOW,
-       GREEN, SKYBLUE, PURPLE, BEIGE };
-
-
-    //Calculating pairs
-    vector<pair<int, int>> combinations(int N)
-    {
-        vector<pair<int, int>> pairs;
-        for (int i = 0; i < N; ++i) {
-            for (int j = i + 1; j < N; ++j) {
-                pairs.emplace_back(i, j);
-            }
-        }
-        return pairs;
-    }
-
-    //Getting state derivative function 
-    Matrix2x2 StateDir(const vector<vector<double>>& Xi, vector<std::pair<int, int>>& pairs)
-    {
-        const int D = 3;
-        const int N = Xi.size();
-        Matrix2x2 Xdot(N, vector<double>(6, 0.0));
-
-        for (int i = 0; i < N; ++i) {
-            Xdot[i][0] = Xi[i][3];
-            Xdot[i][1] = Xi[i][4];
-            Xdot[i][2] = Xi[i][5];
-        }
-
-        for (const auto& [i, j] : pairs)
-        {
-            double dx = Xi[j][0] - Xi[i][0];
-            double dy = Xi[j][1] - Xi[i][1];
-            double dz = Xi[j][2] - Xi[i][2];
-            double r_squared = dx * dx + dy * dy + dz * dz;
-            double r = sqrt(r_squared);
-            double force_magnitude = G * masses[i] * masses[j] / r_squared;
-
-            double fx = force_magnitude * dx / r;
-            double fy = force_magnitude * dy / r;
-            double fz = force_magnitude * dz / r;
-
-            Xdot[i][3] += fx / masses[i];
-            Xdot[i][4] += fy / masses[i];
-            Xdot[i][5] += fz / masses[i];
-
-            Xdot[j][3] -= fx / masses[j];
-            Xdot[j][4] -= fy / masses[j];
-            Xdot[j][5] -= fz / masses[j];
-        }
-
-        return Xdot;
-    }
-
-
-    //rk4 itegral
-    Matrix2x2 rk4(vector<vector<double>>& Xi, const float dt, vector<pair<int, int>> pairs)
-    {
-        const int D = 3;
-        int N = Xi.size();
-
-        Matrix2x2 k1 = StateDir(Xi, pairs);
-        Matrix2x2 temp = Xi;
-
-        for (size_t i = 0; i < Xi.size(); ++i) {
-            for (size_t j = 0; j < Xi[i].size(); ++j) {
-                temp[i][j] = Xi[i][j] + k1[i][j] * (dt / 2);
-            }
-        }
-        Matrix2x2 k2 = StateDir(temp, pairs);
-
-        for (size_t i = 0; i < Xi.size(); ++i) {
-            for (size_t j = 0; j < Xi[i].size(); ++j) {
-                temp[i][j] = Xi[i][j] + k2[i][j] * (dt / 2);
-            }
-        }
-        Matrix2x2 k3 = StateDir(temp, pairs);
-
-        for (size_t i = 0; i < Xi.size(); ++i) {
-            for (size_t j = 0; j < Xi[i].size(); ++j) {
-                temp[i][j] = Xi[i][j] + k3[i][j] * dt;
-            }
-        }
-        Matrix2x2 k4 = StateDir(temp, pairs);
-
-        for (size_t i = 0; i < Xi.size(); ++i) {
-            for (size_t j = 0; j < Xi[i].size(); ++j) {
-                Xi[i][j] += (k1[i][j] + 2 * k2[i][j] + 2 * k3[i][j] + k4[i][j]) * (dt / 6);
-            }
-        }
-        return Xi;
-    }
-
-    void Add_On_Click(vector<vector<double>>& Xi)
-    {
-        int N = Xi.size();
-        // Change high and low bound to change range for possible masses for spawnes objects
-        int low_bound = -50, high_bound = 50;
-        int range = (high_bound - low_bound) + 1;
-
-        Xi.push_back({ (double)GetMouseX(), (double)GetMouseY(), low_bound + double(range * rand() /
-            (RAND_MAX + 1.0)), low_bound + double(range * rand() /
-            (RAND_MAX + 1.0)), low_bound + double(range * rand() / (RAND_MAX + 1.0)),  low_bound + double(range * rand() /
-            (RAND_MAX + 1.0)) });
-        masses.push_back(rand() % 100);
-        radii.push_back(rand() % 15);
-        colors.push_back({ AllColors[rand() % 21] });
-        pairs = combinations(Xi.size());
-        trails.resize(Xi.size());
-    }
-
-    void Draw_Trails()
-    {
-        int N = Xi.size();
-        vector<Color> trail_color(getN());
-        for (int i = 0; i < getN(); ++i)
-        {
-            trail_color[i] = colors[i];
-        }
-
-        trails.resize(N);
-
-        const float dt = 0.1f;
-        rk4(Xi, dt, pairs);
-
-        int maxTrailLength = 15;
-
-        for (int i = 0; i < Xi.size(); ++i)
-        {
-            trails[i].push_back({ (float)Xi[i][0], (float)Xi[i][1] ,(float)Xi[i][2] });
-            if (trails[i].size() > maxTrailLength)
-                trails[i].erase(trails[i].begin());
-
-            for (int j = 0; j < trails[i].size(); ++j)
-            {
-                if (masses[i] > 198900)
-                    continue;
-                float t = (float)j / trails[i].size();
-                float radius = (1.0f + 3.0f / (1.0f - t));
-
-                Color c = trail_color[i];
-                c.a = (unsigned char)(255 * (1.0f - t));
-
-                if (TwoD) {
-                    DrawCircleV({ trails[i][j].x, trails[i][j].y }, radius, c);
-                }
-                else {
-                    DrawSphereEx(trails[i][j], radius, 5, 10, c);
-                }
-            }
-        }
-    }
-
-    void draw2d()
-    {
-        int N = Xi.size();
-
-        if (TwoD) {
-            for (auto& body : Xi) {
-                body[2] = 0.0;
-                body[5] = 0.0;
-            }
-        }
-
-        Draw_Trails();
-
-        if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT))
-        {
-            Add_On_Click(Xi);
-        }
-
-        for (int i = 0; i < Xi.size(); ++i)
-        {
-            DrawCircle(Xi[i][0], Xi[i][1], radii[i], colors[i]);
-        }
-    }
-
-    void draw3d()
-    {
-        int N = Xi.size();
-        float dt = 0.1;
-
-
-        Draw_Trails();
-
-        if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT))
-        {
-            Add_On_Click(Xi);
-        }
-
-        for (int i = 0; i < Xi.size(); ++i)
-        {
-            Vector3 pos_i = { (float)Xi[i][0], (float)Xi[i][1], (float)Xi[i][2] };
-            DrawSphere(pos_i, radii[i], colors[i]);
-        }
-    }
-
-private:
-    vector<vector<double>> Xi;
-    vector<double> masses;
-    vector<int> radii;
-    vector<Color> colors;
-    vector<vector<Vector3>> trails;
-    double G;
-    std::vector<std::pair<int, int>> pairs;
-};
-
-int main()
-{
-    bool isTwoDMode = false; 
-
-    NbodySimulation rng_sys
-    (
-        {
-             { 0, 0, 0, 0, 0, 0 }, // Sun
-             { 31.95, 0, 0, 0, 95.8, 0 }, // Mercury
-             { 54.1, 0, 0, 0, 70, 0 }, // Venus
-             { 74.3, 0, 0, 0, 59.6, 0 }, // Earth
-             { 113.95, 0, 0, 0, 48.2, 0 }, // Mars
-             { 389.25, 0, 0, 0, 26.2, 0 }, // Jupiter
-             { 716.5, 0, 0, 0, 19.4, 0 }, // Saturn
-             { 1436, 0, 0, 0, 13.6, 0 }, // Uranus
-             { 2247.5, 0, 0, 0, 10.8, 0 }  // Neptune
-
-        },
-        //Masses
-        { 1989000, 0.330, 4.87, 5.97, 0.642, 1900, 568, 86.8, 102 },
-        //Radii
-        { 50, 5, 5, 5, 5, 20, 12, 10, 10 },
-        //Colors scheme
-        {
-            {YELLOW}, {DARKGRAY}, {BEIGE}, {BLUE}, {RED},
-            {ORANGE}, {GOLD}, {SKYBLUE}, {DARKBLUE}
-        },
-        0.1f
-    );
-
-    const int ScreenWidth = 1920;
-    const int ScreenHight = 1080;
-
-    SetConfigFlags(FLAG_MSAA_4X_HINT);
-    InitWindow(ScreenWidth, ScreenHight, "Universe");
-
-    Camera3D camera3D = { 0 };
-    camera3D.position = { 1000.0f, 1000.0f, 1000.0f };
-    camera3D.target = { 0.0, 0.0, 0.0 };
-    camera3D.up = { 0.0f, 1.0f, 0.0f };
-    camera3D.fovy = 90.0f;
-    camera3D.projection = CAMERA_PERSPECTIVE;
-
-
-    Camera2D camera2D = { 0 };
-
-    camera2D.target = { 0.0f, 0.0f };
-
-    camera2D.offset = { ScreenWidth / 2.0f, ScreenHight / 2.0f };
-    camera2D.rotation = 0.0f;
-    camera2D.zoom = 1.0f;
-
-    SetTargetFPS(120);
-
-    DisableCursor();
-
-    float radius = 2000.0f;
-
-    while (!WindowShouldClose())
-    {
-
-        float wheelMove = GetMouseWheelMove();
-
-        if (IsKeyPressed(KEY_SPACE))
-        {
-            isTwoDMode = !isTwoDMode;
-            rng_sys.TwoD = isTwoDMode; 
-        }
-
-        if (isTwoDMode)
-        {
-
-            camera2D.zoom += wheelMove * 0.1f;
-
-
-            if (camera2D.zoom < 0.1f) camera2D.zoom = 0.1f;
-            if (camera2D.zoom > 5.0f) camera2D.zoom = 5.0f;
-        }
-        else
-        {
-
-            static float yaw = 0.0f, pitch = 0.0f;
-            Vector2 d = GetMouseDelta();
-            yaw += d.x * 0.005f;
-            pitch = Clamp(pitch + d.y * 0.005f, -PI / 2 + 0.1f, PI / 2 - 0.1f);
-
-            camera3D.position.x = radius * cosf(pitch) * sinf(yaw);
-            camera3D.position.y = radius * sinf(pitch);
-            camera3D.position.z = radius * cosf(pitch) * cosf(yaw);
-            camera3D.target = { 0.0, 0.0, 0.0 };
-
-            float zoomSpeed = 50.0f;
-            radius -= wheelMove * zoomSpeed;
-            radius = Clamp(radius, 100.0f, 5000.0f);
-
-            UpdateCamera(&camera3D, CAMERA_CUSTOM);
-        }
-
-        BeginDrawing();
-
-        ClearBackground(BLACK);
-
-        if (isTwoDMode)
-        {
-            BeginMode2D(camera2D);
-            rng_sys.draw2d();
-            EndMode2D();
-        }
-        else
-        {
-            BeginMode3D(camera3D);
-            rng_sys.draw3d();
-            EndMode3D();
-        }
-
-        DrawFPS(10, 10);
-
-        // Optional: Draw instructions
-        if (isTwoDMode) DrawText("Mode: 2D", 10, 40, 20, WHITE);
-        else DrawText("Mode: 3D", 10, 40, 20, WHITE);
-
-        EndDrawing();
-    }
-
-    CloseWindow();
-    return 0;
-}
+#include <iostream>
+#include <cmath>
+#include "raylib.h"
+#include <cassert>
+#include <utility>
+#include <vector>
+#include <string>
+#include <array>
+#include <raymath.h>
+#include <algorithm>
+#include <thread>
+#include <memory>
+#include "physics/body_state.h"
+#include "physics/block_timestep.h"
+#include "physics/collisions.h"
+#include "physics/barnes_hut.h"
+#include "physics/simulation.h"
+#include "physics/simulation_thread.h"
+#include "physics/profiler.h"
+#include "physics/snapshot.h"
+#include "physics/trajectory.h"
+#include "physics/triple_buffer.h"
+#include "render/disc_batch.h"
+#include "render/trail_buffer.h"
+#include "render/view_culling.h"
+using namespace std;
+
+// What the simulation thread hands to the renderer after every tick
+struct FrameSnapshot
+{
+    vector<Vector3> prev, cur;  // positions before and after the tick
+    vector<int> ids;            // stable body ids, trails follow them
+    vector<int> radii;
+    vector<Color> colors;
+    vector<double> mass;
+    long long step = 0;
+    int scene = 0;              // changes when a snapshot was loaded
+    bool planar = false;        // TwoD, a loaded snapshot brings its own
+    bool recording = false;
+    long long recordedFrames = 0, droppedFrames = 0;
+    double tickTime = 0.0;      // wall clock when the tick finished
+    double tickPeriod = 0.0;
+    const char* integratorName = "";
+    bool collisions = false;
+    long long merges = 0;       // bodies absorbed so far
+    bool mixedPrecision = false;
+    bool softened = false;
+    bool hasBlockStats = false;
+    BlockStepStats blockStats;
+};
+
+// The whole system class
+class NbodySimulation {
+public:
+    //Constructor to set start objects
+    NbodySimulation(const vector<vector<double>>& Xi,
+        const vector<double>& masses,
+        const vector<int>& radii,
+        const vector<Color>& colors,
+        double G = 6.674e-11,
+        unique_ptr<ForceBackend> solver = nullptr)
+        : NbodySimulation(BodyState(Xi, masses), radii, colors, G, std::move(solver))
+    {
+    }
+
+    //solver replaces the pair list in the force evaluation, e.g. make_unique<BarnesHutGravity>(0.5)
+    NbodySimulation(const BodyState& Xi,
+        const vector<int>& bodyRadii,
+        const vector<Color>& bodyColors,
+        double G = 6.674e-11,
+        unique_ptr<ForceBackend> solver = nullptr)
+        : physics(Xi, G, std::move(solver)), radii(bodyRadii), colors(bodyColors)
+    {
+        assert(Xi.size() == radii.size() && radii.size() == colors.size());
+    }
+
+    //Useful variables
+    int getN() const { return physics.size(); }
+
+    // NOTE: This variable needs to be updated from main
+    bool TwoD = false;
+    // Touching bodies merge, set from main like TwoD
+    bool Collide = false;
+
+    Color AllColors[21] = {
+       DARKGRAY, MAROON, ORANGE, DARKGREEN, DARKBLUE, DARKPURPLE, DARKBROWN,
+       GRAY, RED, GOLD, LIME, BLUE, VIOLET, BROWN, LIGHTGRAY, PINK, YELLOW,
+       GREEN, SKYBLUE, PURPLE, BEIGE };
+
+    //Threads and SIMD level of the force evaluation, 1 thread + scalar keeps the serial pair loop
+    void setForceThreads(int n) { physics.setForceThreads(n); }
+    int forceThreads() const { return physics.forceThreads(); }
+    void setForceSimd(SimdLevel level) { physics.setForceSimd(level); }
+    //Float pair terms summed in double, about 2x the direct solver's speed at 1e-7 relative error
+    void setForcePrecision(ForcePrecision p) { physics.setForcePrecision(p); }
+    //Spline softening keeps a spawned body that lands on another one from being flung off
+    void setSoftening(const Softening& s) { physics.setSoftening(s); }
+
+    void setIntegrator(IntegratorKind kind) { physics.setIntegrator(kind); }
+
+    //Mouse position is passed in, this runs on the simulation thread where raylib input can't be read
+    void Add_On_Click(double mouseX, double mouseY)
+    {
+        // Change high and low bound to change range for possible masses for spawnes objects
+        int low_bound = -50, high_bound = 50;
+        int range = (high_bound - low_bound) + 1;
+
+        double vx = low_bound + double(range * rand() / (RAND_MAX + 1.0));
+        double vy = low_bound + double(range * rand() / (RAND_MAX + 1.0));
+        double vz = low_bound + double(range * rand() / (RAND_MAX + 1.0));
+        double z = low_bound + double(range * rand() / (RAND_MAX + 1.0));
+        BodyState body;
+        body.push_back(mouseX, mouseY, z, vx, vy, vz, rand() % 100);
+        Add_Bodies(body, { rand() % 15 }, { AllColors[rand() % 21] });
+    }
+
+    //Batch insert, the new bodies get the next ids. Nothing is rebuilt for the bodies already there.
+    void Add_Bodies(const BodyState& bodies, const vector<int>& r, const vector<Color>& c)
+    {
+        assert(bodies.size() == r.size() && r.size() == c.size());
+        physics.addBodies(bodies);
+        radii.insert(radii.end(), r.begin(), r.end());
+        colors.insert(colors.end(), c.begin(), c.end());
+    }
+
+    //Batch remove by id, the others keep their ids, order, looks and trails
+    void Remove_Bodies(const vector<int>& ids)
+    {
+        physics.removeBodies(ids, kept);
+        if (kept.size() == radii.size())
+            return;
+        keepBodies(radii, kept);
+        keepBodies(colors, kept);
+        layoutChanged = true;
+    }
+
+    //Undoes the newest spawns
+    void Remove_Newest(int count)
+    {
+        const vector<int>& ids = physics.ids();
+        Remove_Bodies(vector<int>(ids.end() - min(count, (int)ids.size()), ids.end()));
+    }
+
+    //Checkpoint of the whole scene, runs on the simulation thread between ticks
+    bool Save(const char* path, string& error) const
+    {
+        vector<float> r(radii.begin(), radii.end());
+        return saveSnapshot(path, physics.state(), r.data(), colors.empty() ? nullptr : &colors[0].r, physics.gravity(),
+            physics.time(), physics.steps(), TwoD, error);
+    }
+
+    //Files written by the headless runner have no radii and colors, those bodies get defaults
+    bool Load(const char* path, string& error)
+    {
+        Snapshot snap;
+        if (!loadSnapshot(path, snap, error))
+            return false;
+
+        const int N = snap.state.size();
+        radii.resize(N);
+        colors.resize(N);
+        for (int i = 0; i < N; ++i)
+        {
+            if (snap.radii.empty()) {
+                radii[i] = 5;
+                colors[i] = AllColors[i % 21];
+            }
+            else {
+                radii[i] = (int)snap.radii[i];
+                const unsigned char* c = &snap.colors[4 * i];
+                colors[i] = { c[0], c[1], c[2], c[3] };
+            }
+        }
+        TwoD = snap.planar;
+        physics.reset(snap.state, snap.G, snap.time, snap.step);
+        ++scene;
+        return true;
+    }
+
+    //One fixed physics step, called by the simulation thread
+    void Tick()
+    {
+        layoutChanged = false;
+        physics.setPlanar(TwoD);
+
+        const float dt = 0.1f;
+        physics.step(dt);
+        Merge_Collisions();
+        recorder.record(physics.state(), physics.steps(), physics.time(), &physics.ids());
+    }
+
+    //The drawn radii double as collision radii, the absorbed bodies are removed by id
+    void Merge_Collisions()
+    {
+        if (!Collide)
+            return;
+
+        collisionRadii.assign(radii.begin(), radii.end());
+        const int removed = collider.merge(physics.state(), collisionRadii, TwoD, absorbed);
+        if (removed == 0)
+            return;
+
+        physics.invalidate();
+        for (int i = 0; i < radii.size(); ++i)
+            radii[i] = (int)lround(collisionRadii[i]);
+        absorbedIds.clear();
+        for (int i : absorbed)
+            absorbedIds.push_back(physics.ids()[i]);
+        Remove_Bodies(absorbedIds);
+        merges += removed;
+    }
+
+    //Trajectory of every tick, written by the recorder's own thread
+    //Radii and colors go to path + ".nbs", the replay picks them up from there
+    bool StartRecording(const char* path, string& error)
+    {
+        if (!Save((string(path) + ".nbs").c_str(), error))
+            return false;
+        if (!recorder.open(path, physics.gravity(), TrajectoryWriter::Options(), error))
+            return false;
+        recorder.record(physics.state(), physics.steps(), physics.time(), &physics.ids());
+        return true;
+    }
+    void StopRecording() { recorder.close(); }
+    bool Recording() const { return recorder.isOpen(); }
+
+    //Copies what the renderer needs, the previous positions have to be captured before Tick()
+    void CapturePositions(vector<Vector3>& out) const
+    {
+        const BodyState& Xi = physics.state();
+        out.resize(Xi.size());
+        for (int i = 0; i < Xi.size(); ++i)
+            out[i] = { (float)Xi.x[i], (float)Xi.y[i], (float)Xi.z[i] };
+    }
+    void Publish(FrameSnapshot& f) const
+    {
+        CapturePositions(f.cur);
+        // the positions captured before the tick belong to other indices, nothing to blend
+        if (layoutChanged)
+            f.prev = f.cur;
+        f.ids = physics.ids();
+        f.radii = radii;
+        f.colors = colors;
+        f.mass = physics.state().mass;
+        f.step = physics.steps();
+        f.scene = scene;
+        f.planar = TwoD;
+        f.recording = recorder.isOpen();
+        f.recordedFrames = recorder.framesWritten();
+        f.droppedFrames = recorder.framesDropped();
+        f.integratorName = physics.activeIntegrator().name();
+        f.collisions = Collide;
+        f.merges = merges;
+        f.mixedPrecision = physics.forcePrecision() == ForcePrecision::Mixed;
+        f.softened = physics.softening().enabled();
+        auto block = dynamic_cast<const BlockTimestepper*>(&physics.activeIntegrator());
+        f.hasBlockStats = block != nullptr;
+        if (block)
+            f.blockStats = block->statistics();
+    }
+
+    //Everything below only runs on the render thread and reads snapshots
+
+    //Positions blended between the two last ticks, alpha = 0 is the older one
+    const vector<Vector3>& Interpolate(const FrameSnapshot& f, float alpha)
+    {
+        shown.resize(f.cur.size());
+        for (int i = 0; i < f.cur.size(); ++i)
+            shown[i] = i < f.prev.size() ? Vector3Lerp(f.prev[i], f.cur[i], alpha) : f.cur[i];
+        return shown;
+    }
+
+    int TrailLength() const { return trails.length(); }
+    void SetTrailLength(int n) { trails.setLength(n); }
+
+    //All trail points of all bodies go out as one batch of discs
+    void Draw_Trails(const FrameSnapshot& f)
+    {
+        int N = f.cur.size();
+
+        {
+            PROFILE_SCOPE(TrailUpdate);
+
+            // a loaded scene starts without trails
+            if (f.scene != trailScene)
+            {
+                trailScene = f.scene;
+                trails.clear();
+            }
+
+            // one trail point per physics tick seen
+            if (f.step != trailStep)
+            {
+                trailStep = f.step;
+                trails.push(f.cur.data(), f.ids.data(), N);
+            }
+        }
+
+        PROFILE_SCOPE(TrailDraw);
+        for (int i = 0; i < N; ++i)
+        {
+            if (f.mass[i] > 198900)
+                continue;
+            const int count = trails.size(i);
+            for (int j = 0; j < count; ++j)
+            {
+                float t = (float)j / count;
+                float radius = (1.0f + 3.0f / (1.0f - t));
+
+                const Vector3& p = trails.at(i, j);
+                if (!view.visible(p, radius)) {
+                    ++cull.trailPointsCulled;
+                    continue;
+                }
+                ++cull.trailPointsDrawn;
+
+                Color c = f.colors[i];
+                c.a = (unsigned char)(255 * (1.0f - t));
+
+                discs.add(p, radius, c);
+            }
+        }
+    }
+
+    // Releases the GPU side, before CloseWindow()
+    void Unload() { discs.unload(); }
+
+    //Bodies off screen are skipped, the rest gets fewer segments the smaller it is on screen
+    void draw2d(const FrameSnapshot& f, float alpha, const Camera2D& camera)
+    {
+        cull.reset();
+        view.setCamera(camera, GetScreenWidth(), GetScreenHeight());
+
+        discs.begin();
+        Draw_Trails(f);
+        discs.end();
+
+        PROFILE_SCOPE(BodyDraw);
+        const vector<Vector3>& pos = Interpolate(f, alpha);
+        pointBodies.clear();
+        for (int i = 0; i < pos.size(); ++i)
+        {
+            if (!view.visible(pos[i], f.radii[i])) {
+                ++cull.bodiesCulled;
+                continue;
+            }
+            LodLevel lod = view.lod(pos[i], f.radii[i]);
+            ++cull.bodiesPerLod[lod];
+
+            if (lod == LodHigh) DrawCircle(pos[i].x, pos[i].y, f.radii[i], f.colors[i]);
+            else if (lod == LodMedium) DrawCircleSector({ pos[i].x, pos[i].y }, f.radii[i], 0, 360, 16, f.colors[i]);
+            else if (lod == LodLow) DrawCircleSector({ pos[i].x, pos[i].y }, f.radii[i], 0, 360, 8, f.colors[i]);
+            else pointBodies.push_back(i);
+        }
+        Draw_Points(f, pos, nullptr);
+    }
+
+    void draw3d(const FrameSnapshot& f, float alpha, const Camera3D& camera)
+    {
+        cull.reset();
+        view.setCamera(camera, GetScreenWidth(), GetScreenHeight());
+
+        discs.begin(camera);
+        Draw_Trails(f);
+        discs.end();
+
+        PROFILE_SCOPE(BodyDraw);
+        const vector<Vector3>& pos = Interpolate(f, alpha);
+        pointBodies.clear();
+        for (int i = 0; i < pos.size(); ++i)
+        {
+            if (!view.visible(pos[i], f.radii[i])) {
+                ++cull.bodiesCulled;
+                continue;
+            }
+            LodLevel lod = view.lod(pos[i], f.radii[i]);
+            ++cull.bodiesPerLod[lod];
+
+            if (lod == LodHigh) DrawSphere(pos[i], f.radii[i], f.colors[i]);
+            else if (lod == LodMedium) DrawSphereEx(pos[i], f.radii[i], 8, 8, f.colors[i]);
+            else if (lod == LodLow) DrawSphereEx(pos[i], f.radii[i], 4, 6, f.colors[i]);
+            else pointBodies.push_back(i);
+        }
+        Draw_Points(f, pos, &camera);
+    }
+
+    //Sub-pixel bodies as one pixel sized point sprites, all in one batch.
+    //Without a camera they are 2D discs, which only survive back-face culling
+    //because DiscBatch::begin() winds them counter-clockwise in screen space.
+    void Draw_Points(const FrameSnapshot& f, const vector<Vector3>& pos, const Camera3D* camera)
+    {
+        if (pointBodies.empty())
+            return;
+        if (camera) discs.begin(*camera);
+        else discs.begin();
+        for (int i : pointBodies)
+            discs.add(pos[i], fmaxf(f.radii[i], view.pixelSize(pos[i])), f.colors[i]);
+        discs.end();
+    }
+
+    const CullStats& Culling() const { return cull; }
+
+private:
+    Simulation physics;
+    vector<int> radii;
+    vector<Color> colors;
+    int scene = 0;  // bumped by Load()
+    TrajectoryWriter recorder;
+    CollisionDetector collider;
+    vector<double> collisionRadii;
+    vector<int> absorbed, absorbedIds, kept;
+    bool layoutChanged = false;  // bodies removed during this tick
+    long long merges = 0;
+
+    // render thread only
+    TrailBuffer trails{ 15 };
+    long long trailStep = -1;
+    int trailScene = 0;
+    DiscBatch discs;
+    ViewCuller view;
+    CullStats cull;
+    vector<int> pointBodies;
+    vector<Vector3> shown;
+};
+
+//Plays a recorded trajectory back through NbodySimulation's drawing code, nothing is integrated.
+//Every displayed frame blends the two recorded frames around the playback time, so the cost
+//is decoding at most one chunk, whatever N is.
+class ReplayPlayer {
+public:
+    //1x plays as fast as the live simulation runs by default, 120 ticks of 0.1 per second
+    static constexpr double RealTime = 12.0;
+    static constexpr float Speeds[10] = { 0.1f, 0.25f, 0.5f, 1.0f, 2.0f, 5.0f, 10.0f, 25.0f, 50.0f, 100.0f };
+
+    //Bodies the recording's .nbs file does not describe get colors of the fallback palette
+    bool Open(const char* path, const Color* fallback, int fallbackSize, string& error)
+    {
+        if (!reader.open(path, error))
+            return false;
+        if (reader.frames() == 0) {
+            error = string(path) + ": no frames";
+            return false;
+        }
+
+        //The snapshot holds the bodies of the first frame, in the same order
+        Snapshot look;
+        string missing;
+        reader.read(0, x, y, z, &lookIds);
+        if (loadSnapshot((string(path) + ".nbs").c_str(), look, missing) && !look.radii.empty()
+            && look.state.size() == lookIds.size())
+        {
+            for (int i = 0; i < look.state.size(); ++i)
+            {
+                radii.push_back((int)look.radii[i]);
+                colors.push_back({ look.colors[4 * i], look.colors[4 * i + 1], look.colors[4 * i + 2], look.colors[4 * i + 3] });
+                mass.push_back(look.state.mass[i]);
+            }
+        }
+        palette = fallback;
+        paletteSize = fallbackSize;
+        t = Start();
+        frame.integratorName = "Replay";
+        return true;
+    }
+
+    double Start() const { return reader.entry(0).time; }
+    double End() const { return reader.entry(reader.frames() - 1).time; }
+    double Time() const { return t; }
+    int Frames() const { return reader.frames(); }
+
+    float Speed() const { return Speeds[speed]; }
+    void Faster() { speed = min(speed + 1, 9); }
+    void Slower() { speed = max(speed - 1, 0); }
+
+    bool Reverse() const { return reverse; }
+    void ToggleReverse() { reverse = !reverse; ++frame.scene; }
+    bool Paused() const { return paused; }
+    void TogglePause() { paused = !paused; }
+
+    //Jumps drop the trails, they would connect unrelated points
+    void Seek(double time)
+    {
+        t = Clamp(time, Start(), End());
+        ++frame.scene;
+    }
+
+    void Update(float seconds)
+    {
+        if (paused)
+            return;
+        t += (reverse ? -1.0 : 1.0) * Speeds[speed] * RealTime * seconds;
+        if (t <= Start() || t >= End()) {
+            t = Clamp(t, Start(), End());
+            paused = true;
+        }
+    }
+
+    const FrameSnapshot& Frame(float& alpha)
+    {
+        const int a = reader.frameAtTime(t);
+        const int b = min(a + 1, reader.frames() - 1);
+        if (a != loadedA || b != loadedB)
+        {
+            Load(a, frame.prev, prevIds);
+            Load(b, frame.cur, frame.ids);
+            // bodies came or went between the two frames, indices do not match
+            if (prevIds != frame.ids)
+                frame.prev = frame.cur;
+            loadedA = a;
+            loadedB = b;
+            frame.step = reader.entry(reverse ? a : b).step;
+            Appearance();
+        }
+
+        const double ta = reader.entry(a).time, tb = reader.entry(b).time;
+        alpha = tb > ta ? Clamp((float)((t - ta) / (tb - ta)), 0.0f, 1.0f) : 1.0f;
+        return frame;
+    }
+
+private:
+    void Load(int f, vector<Vector3>& out, vector<int>& ids)
+    {
+        reader.read(f, x, y, z, &ids);
+        out.resize(x.size());
+        for (int i = 0; i < x.size(); ++i)
+            out[i] = { (float)x[i], (float)y[i], (float)z[i] };
+    }
+
+    //Looks by id, bodies spawned after the first frame get defaults
+    void Appearance()
+    {
+        const int N = frame.ids.size();
+        frame.radii.resize(N);
+        frame.colors.resize(N);
+        frame.mass.resize(N);
+        for (int i = 0; i < N; ++i)
+        {
+            const int id = frame.ids[i];
+            auto it = lower_bound(lookIds.begin(), lookIds.end(), id);
+            const int k = it != lookIds.end() && *it == id ? (int)(it - lookIds.begin()) : -1;
+            bool known = k >= 0 && k < radii.size();
+            frame.radii[i] = known ? radii[k] : 5;
+            frame.colors[i] = known ? colors[k] : palette[id % paletteSize];
+            frame.mass[i] = known ? mass[k] : 0.0;
+        }
+    }
+
+    TrajectoryReader reader;
+    vector<double> x, y, z;
+    vector<int> lookIds, prevIds;  // ids of the first frame, of the older blended frame
+    vector<int> radii;
+    vector<Color> colors;
+    vector<double> mass;
+    const Color* palette = nullptr;
+    int paletteSize = 1;
+
+    double t = 0.0;
+    int speed = 3;
+    bool reverse = false;
+    bool paused = false;
+
+    FrameSnapshot frame;
+    int loadedA = -1, loadedB = -1;
+};
+
+// nbody [snapshot]: starts from a snapshot file instead of the solar system
+// nbody --replay trajectory.nbt: plays a recording back
+int main(int argc, char** argv)
+{
+    bool isTwoDMode = false; 
+    int shownScene = 0;  // scene of the frames drawn, a loaded one sets isTwoDMode
+    int integratorKind = (int)IntegratorKind::RK4;
+    bool collisions = false;
+    bool mixedPrecision = false;
+    bool softened = false;
+
+    NbodySimulation rng_sys
+    (
+        {
+             { 0, 0, 0, 0, 0, 0 }, // Sun
+             { 31.95, 0, 0, 0, 95.8, 0 }, // Mercury
+             { 54.1, 0, 0, 0, 70, 0 }, // Venus
+             { 74.3, 0, 0, 0, 59.6, 0 }, // Earth
+             { 113.95, 0, 0, 0, 48.2, 0 }, // Mars
+             { 389.25, 0, 0, 0, 26.2, 0 }, // Jupiter
+             { 716.5, 0, 0, 0, 19.4, 0 }, // Saturn
+             { 1436, 0, 0, 0, 13.6, 0 }, // Uranus
+             { 2247.5, 0, 0, 0, 10.8, 0 }  // Neptune
+
+        },
+        //Masses
+        { 1989000, 0.330, 4.87, 5.97, 0.642, 1900, 568, 86.8, 102 },
+        //Radii
+        { 50, 5, 5, 5, 5, 20, 12, 10, 10 },
+        //Colors scheme
+        {
+            {YELLOW}, {DARKGRAY}, {BEIGE}, {BLUE}, {RED},
+            {ORANGE}, {GOLD}, {SKYBLUE}, {DARKBLUE}
+        },
+        0.1f
+    );
+
+    rng_sys.setForceThreads(thread::hardware_concurrency());
+
+    ReplayPlayer player;
+    const bool replaying = argc > 2 && string(argv[1]) == "--replay";
+    if (replaying)
+    {
+        string error;
+        if (!player.Open(argv[2], rng_sys.AllColors, 21, error)) {
+            cout << error << endl;
+            return 1;
+        }
+    }
+
+    // F5 saves the running scene here, F9 loads it back
+    const char* snapshotPath = argc > 1 && !replaying ? argv[1] : "snapshot.nbs";
+    if (argc > 1 && !replaying)
+    {
+        string error;
+        if (!rng_sys.Load(snapshotPath, error)) {
+            cout << error << endl;
+            return 1;
+        }
+    }
+
+    // Physics runs on its own thread at a fixed rate, the render loop only
+    // picks up the newest snapshot and never waits for it
+    double tickRate = 120.0;
+    TripleBuffer<FrameSnapshot> frames;
+    SimulationThread simulation(tickRate);
+    auto tick = [&] {
+        FrameSnapshot& f = frames.back();
+        rng_sys.CapturePositions(f.prev);
+        rng_sys.Tick();
+        rng_sys.Publish(f);
+        f.tickTime = SimulationThread::now();
+        f.tickPeriod = 1.0 / simulation.tickRate();
+        frames.publish();
+    };
+
+    const int ScreenWidth = 1920;
+    const int ScreenHight = 1080;
+
+    SetConfigFlags(FLAG_MSAA_4X_HINT);
+    InitWindow(ScreenWidth, ScreenHight, "Universe");
+
+    Camera3D camera3D = { 0 };
+    camera3D.position = { 1000.0f, 1000.0f, 1000.0f };
+    camera3D.target = { 0.0, 0.0, 0.0 };
+    camera3D.up = { 0.0f, 1.0f, 0.0f };
+    camera3D.fovy = 90.0f;
+    camera3D.projection = CAMERA_PERSPECTIVE;
+
+
+    Camera2D camera2D = { 0 };
+
+    camera2D.target = { 0.0f, 0.0f };
+
+    camera2D.offset = { ScreenWidth / 2.0f, ScreenHight / 2.0f };
+    camera2D.rotation = 0.0f;
+    camera2D.zoom = 1.0f;
+
+    SetTargetFPS(120);
+
+    DisableCursor();
+
+    float radius = 2000.0f;
+
+    if (!replaying)
+        simulation.start(tick);
+
+    while (!WindowShouldClose())
+    {
+
+        float wheelMove = GetMouseWheelMove();
+
+        {
+            PROFILE_SCOPE(Input);
+
+            if (IsKeyPressed(KEY_SPACE))
+            {
+                isTwoDMode = !isTwoDMode;
+                if (!replaying)
+                    simulation.post([&, on = isTwoDMode] { rng_sys.TwoD = on; });
+            }
+
+            // Replay: P pause, R reverse, UP/DOWN speed, LEFT/RIGHT scrub
+            if (replaying)
+            {
+                if (IsKeyPressed(KEY_P)) player.TogglePause();
+                if (IsKeyPressed(KEY_R)) player.ToggleReverse();
+                if (IsKeyPressed(KEY_UP)) player.Faster();
+                if (IsKeyPressed(KEY_DOWN)) player.Slower();
+
+                // a full pass over the recording takes 4 s of holding the key
+                double scrub = (player.End() - player.Start()) * GetFrameTime() / 4.0;
+                if (IsKeyDown(KEY_RIGHT)) player.Seek(player.Time() + scrub);
+                if (IsKeyDown(KEY_LEFT)) player.Seek(player.Time() - scrub);
+            }
+            else
+            {
+                if (IsKeyPressed(KEY_I))
+                {
+                    integratorKind = (integratorKind + 1) % 4;
+                    simulation.post([&, kind = (IntegratorKind)integratorKind] { rng_sys.setIntegrator(kind); });
+                }
+
+                if (IsKeyPressed(KEY_BACKSPACE))
+                {
+                    simulation.post([&] { rng_sys.Remove_Newest(1); });
+                }
+
+                if (IsKeyPressed(KEY_C))
+                {
+                    collisions = !collisions;
+                    simulation.post([&, on = collisions] { rng_sys.Collide = on; });
+                }
+
+                if (IsKeyPressed(KEY_M))
+                {
+                    mixedPrecision = !mixedPrecision;
+                    simulation.post([&, on = mixedPrecision] {
+                        rng_sys.setForcePrecision(on ? ForcePrecision::Mixed : ForcePrecision::Double);
+                    });
+                }
+
+                if (IsKeyPressed(KEY_S))
+                {
+                    softened = !softened;
+                    simulation.post([&, on = softened] {
+                        rng_sys.setSoftening(on ? Softening { SofteningKind::Spline, 2.0 } : Softening());
+                    });
+                }
+
+                if (IsKeyPressed(KEY_EQUAL) || IsKeyPressed(KEY_MINUS))
+                {
+                    tickRate = Clamp(IsKeyPressed(KEY_EQUAL) ? tickRate * 2 : tickRate / 2, 15.0f, 1920.0f);
+                    simulation.setTickRate(tickRate);
+                }
+
+                if (IsKeyPressed(KEY_F5))
+                {
+                    simulation.post([&] {
+                        string error;
+                        if (rng_sys.Save(snapshotPath, error)) cout << "saved " << snapshotPath << endl;
+                        else cout << error << endl;
+                    });
+                }
+
+                if (IsKeyPressed(KEY_F9))
+                {
+                    simulation.post([&] {
+                        string error;
+                        if (rng_sys.Load(snapshotPath, error)) cout << "loaded " << snapshotPath << endl;
+                        else cout << error << endl;
+                    });
+                }
+
+                if (IsKeyPressed(KEY_R))
+                {
+                    simulation.post([&] {
+                        string error;
+                        if (rng_sys.Recording()) rng_sys.StopRecording();
+                        else if (!rng_sys.StartRecording("trajectory.nbt", error)) cout << error << endl;
+                    });
+                }
+            }
+
+            if (IsKeyPressed(KEY_LEFT_BRACKET) || IsKeyPressed(KEY_RIGHT_BRACKET))
+            {
+                int step = IsKeyPressed(KEY_RIGHT_BRACKET) ? 5 : -5;
+                rng_sys.SetTrailLength(clamp(rng_sys.TrailLength() + step, 0, 500));
+            }
+
+            if (IsMouseButtonPressed(MOUSE_BUTTON_LEFT) && !replaying)
+            {
+                simulation.post([&, x = (double)GetMouseX(), y = (double)GetMouseY()] { rng_sys.Add_On_Click(x, y); });
+            }
+
+#ifdef NBODY_PROFILE
+            // F3 profiler overlay, F4 writes the events kept so far as a Chrome trace
+            if (IsKeyPressed(KEY_F3))
+                Profiler::instance().setEnabled(!Profiler::instance().enabled());
+            if (IsKeyPressed(KEY_F4))
+            {
+                string error;
+                if (Profiler::instance().exportChromeTrace("profile.json", error)) cout << "wrote profile.json" << endl;
+                else cout << error << endl;
+            }
+#endif
+        }
+
+        // Newest tick, drawn blended with the one before. The picture lags one
+        // tick behind so it never has to extrapolate.
+        // Replays blend the two recorded frames around the playback time instead.
+        float alpha = 1.0f;
+        const FrameSnapshot* current;
+        if (replaying)
+        {
+            player.Update(GetFrameTime());
+            current = &player.Frame(alpha);
+        }
+        else
+        {
+            frames.update();
+            current = &frames.front();
+            if (current->tickPeriod > 0.0)
+                alpha = Clamp((float)((SimulationThread::now() - current->tickTime) / current->tickPeriod), 0.0f, 1.0f);
+            // a loaded snapshot switches to the mode it was saved in
+            if (current->scene != shownScene)
+            {
+                shownScene = current->scene;
+                isTwoDMode = current->planar;
+            }
+        }
+        const FrameSnapshot& frame = *current;
+
+        if (isTwoDMode)
+        {
+
+            camera2D.zoom += wheelMove * 0.1f;
+
+
+            if (camera2D.zoom < 0.1f) camera2D.zoom = 0.1f;
+            if (camera2D.zoom > 5.0f) camera2D.zoom = 5.0f;
+        }
+        else
+        {
+
+            static float yaw = 0.0f, pitch = 0.0f;
+            Vector2 d = GetMouseDelta();
+            yaw += d.x * 0.005f;
+            pitch = Clamp(pitch + d.y * 0.005f, -PI / 2 + 0.1f, PI / 2 - 0.1f);
+
+            camera3D.position.x = radius * cosf(pitch) * sinf(yaw);
+            camera3D.position.y = radius * sinf(pitch);
+            camera3D.position.z = radius * cosf(pitch) * cosf(yaw);
+            camera3D.target = { 0.0, 0.0, 0.0 };
+
+            float zoomSpeed = 50.0f;
+            radius -= wheelMove * zoomSpeed;
+            radius = Clamp(radius, 100.0f, 5000.0f);
+
+            UpdateCamera(&camera3D, CAMERA_CUSTOM);
+        }
+
+        BeginDrawing();
+
+        ClearBackground(BLACK);
+
+        if (isTwoDMode)
+        {
+            BeginMode2D(camera2D);
+            rng_sys.draw2d(frame, alpha, camera2D);
+            EndMode2D();
+        }
+        else
+        {
+            BeginMode3D(camera3D);
+            rng_sys.draw3d(frame, alpha, camera3D);
+            EndMode3D();
+        }
+
+        DrawFPS(10, 10);
+
+        // Optional: Draw instructions
+        if (isTwoDMode) DrawText("Mode: 2D", 10, 40, 20, WHITE);
+        else DrawText("Mode: 3D", 10, 40, 20, WHITE);
+        if (replaying)
+        {
+            DrawText(TextFormat("Replay: t = %.1f of %.1f, %d frames", player.Time(), player.End(), player.Frames()), 10, 70, 20, WHITE);
+            DrawText(TextFormat("%gx %s%s (UP/DOWN, R, P, LEFT/RIGHT)", player.Speed(), player.Reverse() ? "reverse" : "forward",
+                player.Paused() ? ", paused" : ""), 10, 100, 20, WHITE);
+
+            // timeline
+            float done = player.End() > player.Start() ? (float)((player.Time() - player.Start()) / (player.End() - player.Start())) : 1.0f;
+            DrawRectangleLines(10, ScreenHight - 30, ScreenWidth - 20, 10, GRAY);
+            DrawRectangle(10, ScreenHight - 30, (int)((ScreenWidth - 20) * done), 10, WHITE);
+        }
+        else
+        {
+            DrawText(TextFormat("Integrator: %s (I), collisions %s (C), %lld merged, softening %s (S)",
+                frame.integratorName, frame.collisions ? "on" : "off", frame.merges, frame.softened ? "on" : "off"),
+                10, 70, 20, WHITE);
+            DrawText(TextFormat("Physics: %.0f Hz (-/+), %lld ticks dropped, %s forces (M)", tickRate, simulation.droppedTicks(),
+                frame.mixedPrecision ? "mixed" : "double"), 10, 100, 20, WHITE);
+        }
+        DrawText(TextFormat("Trail: %d points ([ ])", rng_sys.TrailLength()), 10, 130, 20, WHITE);
+
+        if (frame.recording)
+            DrawText(TextFormat("Recording trajectory.nbt: %lld frames, %lld dropped (R)", frame.recordedFrames,
+                frame.droppedFrames), 10, ScreenHight - 30, 20, RED);
+
+        const CullStats& cull = rng_sys.Culling();
+        DrawText(TextFormat("Culled: %d bodies, %d of %d trail points", cull.bodiesCulled,
+            cull.trailPointsCulled, cull.trailPointsCulled + cull.trailPointsDrawn), 10, 160, 20, WHITE);
+        DrawText(TextFormat("LOD high/medium/low/point: %d/%d/%d/%d", cull.bodiesPerLod[LodHigh],
+            cull.bodiesPerLod[LodMedium], cull.bodiesPerLod[LodLow], cull.bodiesPerLod[LodPoint]), 10, 190, 20, WHITE);
+
+        // Block timestep stats: bodies per level and force evaluations vs a global dt
+        if (frame.hasBlockStats)
+        {
+            const BlockStepStats& st = frame.blockStats;
+            int y = 220;
+            for (int k = 0; k < (int)st.bodiesPerLevel.size(); ++k)
+            {
+                if (st.bodiesPerLevel[k] == 0)
+                    continue;
+                DrawText(TextFormat("dt/%d: %d bodies", 1 << k, st.bodiesPerLevel[k]), 10, y, 20, WHITE);
+                y += 25;
+            }
+            double saved = st.globalEvaluations > 0 ? 100.0 * (1.0 - (double)st.evaluations / st.globalEvaluations) : 0.0;
+            DrawText(TextFormat("Force evals: %lld of %lld with a global dt (%.0f%% saved)",
+                st.evaluations, st.globalEvaluations, saved), 10, y, 20, WHITE);
+        }
+
+#ifdef NBODY_PROFILE
+        // Per stage p50/p99 over the frame history, and how those frames spread up to 1.25 x p99
+        Profiler& profiler = Profiler::instance();
+        if (profiler.enabled())
+        {
+            const int px = ScreenWidth - 560;
+            int py = 10;
+            DrawText(TextFormat("Profiler: %d frames (F3, F4 saves profile.json)", profiler.historyFrames()), px, py, 20, WHITE);
+            for (int s = 0; s < (int)ProfileStage::Count; ++s)
+            {
+                py += 30;
+                const ProfileStage stage = (ProfileStage)s;
+                const double p99 = profiler.percentile(stage, 0.99);
+                DrawText(TextFormat("%s: p50 %.2f ms, p99 %.2f ms", profileStageName(stage),
+                    profiler.percentile(stage, 0.5), p99), px, py, 20, WHITE);
+
+                int bins[24];
+                profiler.histogram(stage, fmax(p99 * 1.25, 0.01), bins, 24);
+                const int fullest = *max_element(bins, bins + 24);
+                for (int b = 0; b < 24; ++b)
+                {
+                    int h = fullest > 0 ? 20 * bins[b] / fullest : 0;
+                    DrawRectangle(px + 400 + 6 * b, py + 20 - h, 5, h, SKYBLUE);
+                }
+            }
+            if (profiler.droppedEvents() > 0)
+                DrawText(TextFormat("%lld events dropped", profiler.droppedEvents()), px, py + 30, 20, RED);
+        }
+#endif
+
+        EndDrawing();
+
+#ifdef NBODY_PROFILE
+        if (Profiler::instance().enabled())
+            Profiler::instance().endFrame();
+#endif
+    }
+
+    simulation.stop();
+    rng_sys.Unload();
+    CloseWindow();
+    return 0;
+}
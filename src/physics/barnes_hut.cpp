@@ -0,0 +1,242 @@
+#include "barnes_hut.h"
+
+#include <algorithm>
+#include <cmath>
+
+void BarnesHutGravity::accelerations(const BodyState& X, double G, double* ax, double* ay, double* az)
+{
+    accelerationsWithPotential(X, G, ax, ay, az, nullptr);
+}
+
+void BarnesHutGravity::accelerationsWithPotential(const BodyState& X, double G, double* ax, double* ay, double* az,
+    double* pot)
+{
+    const int N = X.size();
+    if (N == 0)
+        return;
+
+    build(X);
+
+    const int blocks = (N + RowsPerBlock - 1) / RowsPerBlock;
+    auto task = [&](int b) {
+        int begin = b * RowsPerBlock;
+        int end = std::min(begin + RowsPerBlock, N);
+        for (int i = begin; i < end; ++i)
+            accelerationRow(X, G, i, ax[i], ay[i], az[i], pot ? pot + i : nullptr);
+    };
+    pool.run(blocks, task);
+}
+
+void BarnesHutGravity::accelerationsFor(const BodyState& X, double G, const int* targets, int count,
+    double* ax, double* ay, double* az)
+{
+    if (X.empty() || count == 0)
+        return;
+
+    build(X);
+
+    const int blocks = (count + RowsPerBlock - 1) / RowsPerBlock;
+    auto task = [&](int b) {
+        int begin = b * RowsPerBlock;
+        int end = std::min(begin + RowsPerBlock, count);
+        for (int k = begin; k < end; ++k)
+            accelerationRow(X, G, targets[k], ax[k], ay[k], az[k]);
+    };
+    pool.run(blocks, task);
+}
+
+void BarnesHutGravity::build(const BodyState& X)
+{
+    const int N = X.size();
+
+    double lo[3] = { X.x[0], X.y[0], planar ? 0.0 : X.z[0] };
+    double hi[3] = { lo[0], lo[1], lo[2] };
+    for (int i = 1; i < N; ++i) {
+        lo[0] = std::min(lo[0], X.x[i]); hi[0] = std::max(hi[0], X.x[i]);
+        lo[1] = std::min(lo[1], X.y[i]); hi[1] = std::max(hi[1], X.y[i]);
+        if (!planar) {
+            lo[2] = std::min(lo[2], X.z[i]); hi[2] = std::max(hi[2], X.z[i]);
+        }
+    }
+    double half = 0.5 * std::max({ hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2] });
+    // a little slack so bodies on the upper faces still fall inside
+    half = half > 0.0 ? half * 1.0001 : 1.0;
+
+    nodes.clear();
+    nodes.push_back({ 0.5 * (lo[0] + hi[0]), 0.5 * (lo[1] + hi[1]), 0.5 * (lo[2] + hi[2]), half,
+        0.0, 0.0, 0.0, 0.0, -1, -1 });
+    next.assign(N, -1);
+
+    for (int i = 0; i < N; ++i)
+        insert(X, i);
+
+    summarize(X);
+}
+
+int BarnesHutGravity::octant(const Node& n, double px, double py, double pz) const
+{
+    int o = (px >= n.cx ? 1 : 0) | (py >= n.cy ? 2 : 0);
+    if (!planar && pz >= n.cz)
+        o |= 4;
+    return o;
+}
+
+void BarnesHutGravity::split(int node)
+{
+    const int count = planar ? 4 : 8;
+    const int first = nodes.size();
+    // copy, push_back may move the array
+    const Node parent = nodes[node];
+    const double h = parent.half * 0.5;
+
+    for (int o = 0; o < count; ++o) {
+        nodes.push_back({
+            parent.cx + ((o & 1) ? h : -h),
+            parent.cy + ((o & 2) ? h : -h),
+            planar ? parent.cz : parent.cz + ((o & 4) ? h : -h),
+            h, 0.0, 0.0, 0.0, 0.0, -1, -1 });
+    }
+    nodes[node].child = first;
+}
+
+void BarnesHutGravity::insert(const BodyState& X, int b)
+{
+    const double px = X.x[b], py = X.y[b], pz = X.z[b];
+    int node = 0;
+
+    for (int depth = 0;; ++depth)
+    {
+        if (nodes[node].child >= 0) {
+            node = nodes[node].child + octant(nodes[node], px, py, pz);
+            continue;
+        }
+
+        const int resident = nodes[node].body;
+        if (resident < 0 || depth >= MaxDepth) {
+            next[b] = resident;
+            nodes[node].body = b;
+            return;
+        }
+
+        // occupied leaf: push the resident one level down and try again
+        split(node);
+        nodes[node].body = -1;
+        int target = nodes[node].child + octant(nodes[node], X.x[resident], X.y[resident], X.z[resident]);
+        nodes[target].body = resident;
+        next[resident] = -1;
+        --depth;
+    }
+}
+
+void BarnesHutGravity::summarize(const BodyState& X)
+{
+    const int count = planar ? 4 : 8;
+
+    // children always sit behind their parent, so one backwards sweep is bottom-up
+    for (int n = (int)nodes.size() - 1; n >= 0; --n)
+    {
+        Node& node = nodes[n];
+        double m = 0.0, mx = 0.0, my = 0.0, mz = 0.0;
+
+        if (node.child >= 0) {
+            for (int c = node.child; c < node.child + count; ++c) {
+                const Node& ch = nodes[c];
+                m += ch.m;
+                mx += ch.m * ch.mx;
+                my += ch.m * ch.my;
+                mz += ch.m * ch.mz;
+            }
+        }
+        else {
+            for (int b = node.body; b >= 0; b = next[b]) {
+                m += X.mass[b];
+                mx += X.mass[b] * X.x[b];
+                my += X.mass[b] * X.y[b];
+                mz += X.mass[b] * X.z[b];
+            }
+        }
+
+        node.m = m;
+        if (m > 0.0) {
+            node.mx = mx / m;
+            node.my = my / m;
+            node.mz = mz / m;
+        }
+        else {
+            node.mx = node.cx;
+            node.my = node.cy;
+            node.mz = node.cz;
+        }
+    }
+}
+
+void BarnesHutGravity::accelerationRow(const BodyState& X, double G, int i,
+    double& ax, double& ay, double& az, double* pot) const
+{
+    const int count = planar ? 4 : 8;
+    const double xi = X.x[i], yi = X.y[i], zi = X.z[i];
+    const double theta2 = theta * theta;
+    double sx = 0.0, sy = 0.0, sz = 0.0, phi = 0.0;
+
+    // cells are softened like bodies, for the spline that is only ever the
+    // cells closer than its support
+    const bool softened = softening.enabled();
+    auto factor = [&](double r2) {
+        if (softened)
+            return softening.forceFactor(r2);
+        double inv_r = 1.0 / sqrt(r2);
+        return inv_r * inv_r * inv_r;
+    };
+    auto potential = [&](double r2) {
+        return softened ? softening.potentialFactor(r2) : -1.0 / sqrt(r2);
+    };
+
+    int stack[MaxDepth * 8 + 8];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0)
+    {
+        const Node& node = nodes[stack[--top]];
+        if (node.m == 0.0)
+            continue;
+
+        if (node.child < 0) {
+            for (int b = node.body; b >= 0; b = next[b]) {
+                if (b == i)
+                    continue;
+                double dx = X.x[b] - xi, dy = X.y[b] - yi, dz = X.z[b] - zi;
+                double r2 = dx * dx + dy * dy + dz * dz;
+                if (r2 == 0.0)
+                    continue;
+                double s = G * X.mass[b] * factor(r2);
+                sx += s * dx; sy += s * dy; sz += s * dz;
+                if (pot)
+                    phi += G * X.mass[b] * potential(r2);
+            }
+            continue;
+        }
+
+        double dx = node.mx - xi, dy = node.my - yi, dz = node.mz - zi;
+        double r2 = dx * dx + dy * dy + dz * dz;
+        double size = 2.0 * node.half;
+
+        // far enough away: the whole cell acts as one point mass
+        if (size * size < theta2 * r2) {
+            double s = G * node.m * factor(r2);
+            sx += s * dx; sy += s * dy; sz += s * dz;
+            if (pot)
+                phi += G * node.m * potential(r2);
+            continue;
+        }
+
+        for (int c = node.child; c < node.child + count; ++c)
+            stack[top++] = c;
+    }
+
+    ax = sx;
+    ay = sy;
+    az = sz;
+    if (pot)
+        *pot = phi;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+
+#include "force_backend.h"
+
+// Barnes-Hut tree solver, O(N log N) per evaluation.
+// Bodies are sorted into an octree (a quadtree in planar mode) and a cell is
+// replaced by its centre of mass when size / distance < theta. theta = 0
+// degenerates to direct summation, 0.5 is the usual accuracy/speed trade.
+//
+// The node array is rebuilt every evaluation but keeps its capacity, so after
+// the first frames a rebuild does not allocate.
+class BarnesHutGravity : public ForceBackend
+{
+public:
+    explicit BarnesHutGravity(double angle = 0.5, int threads = 1)
+        : theta(angle)
+    {
+        setThreads(threads);
+    }
+
+    const char* name() const override { return planar ? "barnes-hut (quadtree)" : "barnes-hut (octree)"; }
+
+    double openingAngle() const { return theta; }
+    void setOpeningAngle(double t) { theta = t; }
+
+    void accelerations(const BodyState& X, double G, double* ax, double* ay, double* az) override;
+    // cells contribute their monopole potential, with the error of their force
+    void accelerationsWithPotential(const BodyState& X, double G, double* ax, double* ay, double* az,
+        double* pot) override;
+    void accelerationsFor(const BodyState& X, double G, const int* targets, int count,
+        double* ax, double* ay, double* az) override;
+
+    // Size of the last built tree, for stats overlays and benchmarks
+    int nodeCount() const { return (int)nodes.size(); }
+
+    // Deeper cells are not split anymore, coincident bodies share a leaf
+    static constexpr int MaxDepth = 48;
+    static constexpr int RowsPerBlock = 64;
+
+private:
+    struct Node
+    {
+        double cx, cy, cz, half;  // cell centre and half width
+        double m;                 // total mass
+        double mx, my, mz;        // centre of mass
+        int child;                // first of 8 (4 planar) children, -1 for a leaf
+        int body;                 // first body of a leaf, chained through next
+    };
+
+    void build(const BodyState& X);
+    void insert(const BodyState& X, int b);
+    int octant(const Node& n, double px, double py, double pz) const;
+    void split(int node);
+    void summarize(const BodyState& X);
+    void accelerationRow(const BodyState& X, double G, int i, double& ax, double& ay, double& az,
+        double* pot = nullptr) const;
+
+    double theta;
+    std::vector<Node> nodes;
+    std::vector<int> next;
+};
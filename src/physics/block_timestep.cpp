@@ -0,0 +1,205 @@
+#include "block_timestep.h"
+
+#include <algorithm>
+#include <cmath>
+
+void BlockTimestepper::step(BodyState& Xi, double dt, DerivativeRef deriv)
+{
+    auto subset = [&](const BodyState& X, const int* targets, int count, double* ox, double* oy, double* oz) {
+        full.resize(X.size());
+        deriv(X, full);
+        for (int k = 0; k < count; ++k) {
+            ox[k] = full.vx[targets[k]];
+            oy[k] = full.vy[targets[k]];
+            oz[k] = full.vz[targets[k]];
+        }
+    };
+    advance(Xi, dt, deriv, subset);
+}
+
+int BlockTimestepper::chooseLevel(int i, double dt, double jerk) const
+{
+    const double a = std::sqrt(ax[i] * ax[i] + ay[i] * ay[i] + az[i] * az[i]);
+    double want = dt;
+    if (criterion == Criterion::Jerk) {
+        if (jerk > 0.0)
+            want = eta * a / jerk;
+    }
+    else if (a > 0.0) {
+        want = eta * std::sqrt(lengthScale / a);
+    }
+
+    if (!(want < dt))
+        return 0;
+    int k = (int)std::ceil(std::log2(dt / want));
+    return std::clamp(k, 0, maxLevel);
+}
+
+void BlockTimestepper::bodiesChanged(const std::vector<int>& kept)
+{
+    keepBodies(level, kept);
+    valid = false;
+}
+
+void BlockTimestepper::prime(const BodyState& Xi, double dt, SubsetAccelerationRef accel)
+{
+    const int N = Xi.size();
+    // bodies that were stepped before keep their level, see bodiesChanged()
+    const int known = (int)level.size() <= N ? (int)level.size() : 0;
+    ax.resize(N);
+    ay.resize(N);
+    az.resize(N);
+    active.resize(N);
+    for (int i = 0; i < N; ++i)
+        active[i] = i;
+
+    accel(Xi, active.data(), N, ax.data(), ay.data(), az.data());
+    stats.evaluations += N;
+
+    level.resize(N);
+    if (criterion == Criterion::Acceleration) {
+        for (int i = known; i < N; ++i)
+            level[i] = chooseLevel(i, dt, 0.0);
+    }
+    else if (known < N) {
+        // Aarseth's starting step wants the jerk: the new bodies are evaluated
+        // once more after everything drifted for the finest step h
+        const double h = dt / (1LL << maxLevel);
+        drifted = Xi;
+        for (int i = 0; i < N; ++i) {
+            drifted.x[i] += Xi.vx[i] * h;
+            drifted.y[i] += Xi.vy[i] * h;
+            drifted.z[i] += Xi.vz[i] * h;
+        }
+        const int n = N - known;
+        active.resize(n);
+        for (int k = 0; k < n; ++k)
+            active[k] = known + k;
+        nx.resize(N);
+        ny.resize(N);
+        nz.resize(N);
+        accel(drifted, active.data(), n, nx.data(), ny.data(), nz.data());
+        stats.evaluations += n;
+
+        for (int k = 0; k < n; ++k) {
+            const int i = known + k;
+            double jx = nx[k] - ax[i], jy = ny[k] - ay[i], jz = nz[k] - az[i];
+            level[i] = chooseLevel(i, dt, std::sqrt(jx * jx + jy * jy + jz * jz) / h);
+        }
+    }
+    valid = true;
+}
+
+void BlockTimestepper::advance(BodyState& Xi, double dt, DerivativeRef deriv, SubsetAccelerationRef accel)
+{
+    const int N = Xi.size();
+    if (N == 0)
+        return;
+    if (!valid || (int)level.size() != N)
+        prime(Xi, dt, accel);
+
+    const long long ticks = 1LL << maxLevel;
+    const double dtMin = dt / ticks;
+    auto span = [&](int k) { return 1LL << (maxLevel - k); };
+
+    std::vector<int>& count = stats.bodiesPerLevel;
+    count.assign(maxLevel + 1, 0);
+    for (int i = 0; i < N; ++i)
+        ++count[level[i]];
+    auto finest = [&] {
+        int k = maxLevel;
+        while (k > 0 && count[k] == 0)
+            --k;
+        return k;
+    };
+    int stepFinest = finest();
+
+    // opening half kicks, everyone starts a step at tick 0
+    for (int i = 0; i < N; ++i) {
+        double h = 0.5 * span(level[i]) * dtMin;
+        Xi.vx[i] += ax[i] * h;
+        Xi.vy[i] += ay[i] * h;
+        Xi.vz[i] += az[i] * h;
+    }
+
+    long long tick = 0, evaluations = 0;
+    nx.resize(N);
+    ny.resize(N);
+    nz.resize(N);
+
+    while (tick < ticks)
+    {
+        const long long s = span(finest());
+        const long long next = (tick / s + 1) * s;
+
+        const double drift = (next - tick) * dtMin;
+        for (int i = 0; i < N; ++i) {
+            Xi.x[i] += Xi.vx[i] * drift;
+            Xi.y[i] += Xi.vy[i] * drift;
+            Xi.z[i] += Xi.vz[i] * drift;
+        }
+        tick = next;
+
+        active.clear();
+        for (int i = 0; i < N; ++i) {
+            if (tick % span(level[i]) == 0)
+                active.push_back(i);
+        }
+        const int n = active.size();
+        if (tick == ticks) {
+            // every level ends here, active is 0..N-1: one full pass, which
+            // also gives callers the potential of the end state (diagnostics)
+            full.resize(N);
+            deriv(Xi, full);
+            std::copy(full.vx.begin(), full.vx.end(), nx.begin());
+            std::copy(full.vy.begin(), full.vy.end(), ny.begin());
+            std::copy(full.vz.begin(), full.vz.end(), nz.begin());
+        }
+        else {
+            accel(Xi, active.data(), n, nx.data(), ny.data(), nz.data());
+        }
+        evaluations += n;
+
+        for (int k = 0; k < n; ++k)
+        {
+            const int i = active[k];
+            const double dti = span(level[i]) * dtMin;
+
+            double jx = nx[k] - ax[i], jy = ny[k] - ay[i], jz = nz[k] - az[i];
+            double jerk = std::sqrt(jx * jx + jy * jy + jz * jz) / dti;
+
+            // closing half kick of the step that just ended
+            Xi.vx[i] += nx[k] * (dti / 2);
+            Xi.vy[i] += ny[k] * (dti / 2);
+            Xi.vz[i] += nz[k] * (dti / 2);
+            ax[i] = nx[k];
+            ay[i] = ny[k];
+            az[i] = nz[k];
+
+            int want = chooseLevel(i, dt, jerk);
+            int now = level[i];
+            if (want > now)
+                now = want;
+            else if (want < now && tick % span(now - 1) == 0)
+                now = now - 1;
+            --count[level[i]];
+            ++count[now];
+            level[i] = now;
+
+            // opening half kick of the next one, unless dt is done
+            if (tick < ticks) {
+                double h = 0.5 * span(now) * dtMin;
+                Xi.vx[i] += ax[i] * h;
+                Xi.vy[i] += ay[i] * h;
+                Xi.vz[i] += az[i] * h;
+            }
+        }
+        stepFinest = std::max(stepFinest, finest());
+    }
+
+    stats.finestLevel = stepFinest;
+    stats.lastEvaluations = evaluations;
+    stats.lastGlobalEvaluations = (long long)N << stepFinest;
+    stats.evaluations += evaluations;
+    stats.globalEvaluations += stats.lastGlobalEvaluations;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <vector>
+
+#include "integrator.h"
+
+// Counters of the hierarchical block timestepper
+struct BlockStepStats
+{
+    // bodies per level after the last step, level k steps with dt / 2^k
+    std::vector<int> bodiesPerLevel;
+    // finest level used during the last step
+    int finestLevel = 0;
+    // body force evaluations actually done, and what a global step equal to
+    // the finest level used would have needed (N * 2^finest per step)
+    long long evaluations = 0;
+    long long globalEvaluations = 0;
+    long long lastEvaluations = 0;
+    long long lastGlobalEvaluations = 0;
+};
+
+// Kick-drift-kick leapfrog with individual power-of-two timesteps.
+//
+// step(X, dt) advances everything by dt, but each body moves on its own level
+// k with dt_k = dt / 2^k picked from its acceleration and jerk:
+//   dt_i = eta * |a| / |da/dt|        (Jerk, scale free, default)
+//   dt_i = eta * sqrt(length / |a|)   (Acceleration)
+// All bodies drift together, but only the bodies whose own step ends get
+// their forces evaluated and are kicked, so quiet outer bodies cost one force
+// evaluation per dt while a close pair subcycles. A body may go to a finer
+// level at any end of its step, to a coarser one (one level at a time) only
+// where that level's steps line up. At the end of dt every level is active,
+// that evaluation is a full deriv() pass over the state.
+class BlockTimestepper : public Integrator
+{
+public:
+    enum class Criterion { Jerk, Acceleration };
+
+    explicit BlockTimestepper(int finestLevel = 8, double accuracy = 0.25)
+        : maxLevel(finestLevel), eta(accuracy)
+    {
+        stats.bodiesPerLevel.assign(maxLevel + 1, 0);
+    }
+
+    const char* name() const override { return "Block leapfrog"; }
+    int evaluationsPerStep() const override { return 1; }
+
+    // Forces are evaluated again, the levels stay
+    void invalidate() override { valid = false; }
+    void bodiesChanged(const std::vector<int>& kept) override;
+
+    // Without a subset evaluator every partial evaluation computes everything
+    void step(BodyState& Xi, double dt, DerivativeRef deriv) override;
+    void advance(BodyState& Xi, double dt, DerivativeRef deriv, SubsetAccelerationRef accel) override;
+
+    void setCriterion(Criterion c, double length = 1.0)
+    {
+        criterion = c;
+        lengthScale = length;
+    }
+    void setEta(double e) { eta = e; }
+    int levels() const { return maxLevel + 1; }
+
+    const BlockStepStats& statistics() const { return stats; }
+
+private:
+    void prime(const BodyState& Xi, double dt, SubsetAccelerationRef accel);
+    int chooseLevel(int i, double dt, double jerk) const;
+
+    int maxLevel;
+    double eta;
+    Criterion criterion = Criterion::Jerk;
+    double lengthScale = 1.0;
+
+    // per body
+    std::vector<int> level;
+    std::vector<double> ax, ay, az;
+    bool valid = false;
+
+    // scratch
+    std::vector<int> active;
+    std::vector<double> nx, ny, nz;
+    BodyState full, drifted;
+
+    BlockStepStats stats;
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+// Structure-of-arrays state of the whole system.
+// Every component lives in its own contiguous array, so a sweep over one
+// coordinate touches consecutive memory and adding a body is 7 push_backs
+// instead of one heap allocation per body.
+struct BodyState
+{
+    std::vector<double> x, y, z;
+    std::vector<double> vx, vy, vz;
+    std::vector<double> mass;
+
+    BodyState() = default;
+
+    explicit BodyState(size_t n)
+    {
+        resize(n);
+    }
+
+    // Builds the state from the old one-row-per-body layout {x, y, z, vx, vy, vz}
+    BodyState(const std::vector<std::vector<double>>& rows, const std::vector<double>& masses)
+    {
+        assert(rows.size() == masses.size());
+        reserve(rows.size());
+        for (size_t i = 0; i < rows.size(); ++i) {
+            assert(rows[i].size() == 6);
+            push_back(rows[i][0], rows[i][1], rows[i][2], rows[i][3], rows[i][4], rows[i][5], masses[i]);
+        }
+    }
+
+    size_t size() const { return x.size(); }
+    bool empty() const { return x.empty(); }
+
+    void resize(size_t n)
+    {
+        x.resize(n); y.resize(n); z.resize(n);
+        vx.resize(n); vy.resize(n); vz.resize(n);
+        mass.resize(n);
+    }
+
+    void reserve(size_t n)
+    {
+        x.reserve(n); y.reserve(n); z.reserve(n);
+        vx.reserve(n); vy.reserve(n); vz.reserve(n);
+        mass.reserve(n);
+    }
+
+    void push_back(double px, double py, double pz, double pvx, double pvy, double pvz, double m)
+    {
+        x.push_back(px); y.push_back(py); z.push_back(pz);
+        vx.push_back(pvx); vy.push_back(pvy); vz.push_back(pvz);
+        mass.push_back(m);
+    }
+
+    // Moves body kept[k] to slot k and drops the rest, kept has to be ascending
+    void keep(const std::vector<int>& kept)
+    {
+        for (std::vector<double>* c : { &x, &y, &z, &vx, &vy, &vz, &mass }) {
+            for (size_t k = 0; k < kept.size(); ++k)
+                (*c)[k] = (*c)[kept[k]];
+            c->resize(kept.size());
+        }
+    }
+
+    // The six integrated components in the old row order, used by loops that
+    // treat every component the same way (rk4 stage updates)
+    static constexpr int NumComponents = 6;
+
+    std::vector<double>& component(int k)
+    {
+        static constexpr std::vector<double> BodyState::* members[NumComponents] = {
+            &BodyState::x, &BodyState::y, &BodyState::z,
+            &BodyState::vx, &BodyState::vy, &BodyState::vz };
+        return this->*members[k];
+    }
+
+    const std::vector<double>& component(int k) const
+    {
+        return const_cast<BodyState*>(this)->component(k);
+    }
+};
+
+// Applies a BodyState::keep() to an array running parallel to the bodies
+// (radii, colors, ids, ...)
+template <class T>
+void keepBodies(std::vector<T>& v, const std::vector<int>& kept)
+{
+    for (size_t k = 0; k < kept.size(); ++k)
+        v[k] = v[kept[k]];
+    v.resize(kept.size());
+}
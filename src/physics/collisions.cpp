@@ -0,0 +1,150 @@
+#include "collisions.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    uint32_t hashCell(int64_t cx, int64_t cy, int64_t cz)
+    {
+        return (uint32_t)(cx * 73856093) ^ (uint32_t)(cy * 19349663) ^ (uint32_t)(cz * 83492791);
+    }
+}
+
+void CollisionDetector::findContacts(const BodyState& X, const double* radii, bool planar,
+    std::vector<std::pair<int, int>>& out)
+{
+    out.clear();
+    const int N = X.size();
+    if (N < 2)
+        return;
+
+    double cell = 0.0;
+    for (int i = 0; i < N; ++i)
+        cell = std::max(cell, 2.0 * radii[i]);
+    if (cell <= 0.0)
+        return;
+    const double inv = 1.0 / cell;
+
+    uint32_t buckets = 1;
+    while (buckets < 2u * (uint32_t)N)
+        buckets <<= 1;
+    const uint32_t mask = buckets - 1;
+
+    // counting sort of the bodies by bucket
+    bucketOf.resize(N);
+    bucketStart.assign(buckets + 1, 0);
+    for (int i = 0; i < N; ++i) {
+        const int64_t cz = planar ? 0 : (int64_t)std::floor(X.z[i] * inv);
+        bucketOf[i] = hashCell((int64_t)std::floor(X.x[i] * inv), (int64_t)std::floor(X.y[i] * inv), cz) & mask;
+        ++bucketStart[bucketOf[i] + 1];
+    }
+    for (uint32_t b = 0; b < buckets; ++b)
+        bucketStart[b + 1] += bucketStart[b];
+    sorted.resize(N);
+    for (int i = 0; i < N; ++i)
+        sorted[bucketStart[bucketOf[i]]++] = i;
+    // the fill moved every start to the next bucket's start, shift back
+    for (uint32_t b = buckets; b > 0; --b)
+        bucketStart[b] = bucketStart[b - 1];
+    bucketStart[0] = 0;
+
+    const int zRange = planar ? 0 : 1;
+    for (int i = 0; i < N; ++i)
+    {
+        const int64_t cx = (int64_t)std::floor(X.x[i] * inv);
+        const int64_t cy = (int64_t)std::floor(X.y[i] * inv);
+        const int64_t cz = planar ? 0 : (int64_t)std::floor(X.z[i] * inv);
+
+        // distinct neighbour cells may share a bucket, visit every bucket once
+        uint32_t seen[27];
+        int count = 0;
+        for (int dz = -zRange; dz <= zRange; ++dz)
+            for (int dy = -1; dy <= 1; ++dy)
+                for (int dx = -1; dx <= 1; ++dx)
+                {
+                    const uint32_t b = hashCell(cx + dx, cy + dy, cz + dz) & mask;
+                    if (std::find(seen, seen + count, b) != seen + count)
+                        continue;
+                    seen[count++] = b;
+
+                    for (int k = bucketStart[b]; k < bucketStart[b + 1]; ++k)
+                    {
+                        const int j = sorted[k];
+                        if (j <= i)
+                            continue;
+                        const double ex = X.x[j] - X.x[i], ey = X.y[j] - X.y[i];
+                        const double ez = planar ? 0.0 : X.z[j] - X.z[i];
+                        const double reach = radii[i] + radii[j];
+                        if (ex * ex + ey * ey + ez * ez < reach * reach)
+                            out.emplace_back(i, j);
+                    }
+                }
+    }
+}
+
+int CollisionDetector::find(int i)
+{
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+int CollisionDetector::merge(BodyState& X, std::vector<double>& radii, bool planar, std::vector<int>& absorbed)
+{
+    findContacts(X, radii.data(), planar, contacts);
+    if (contacts.empty())
+        return 0;
+
+    const int N = X.size();
+    parent.resize(N);
+    for (int i = 0; i < N; ++i)
+        parent[i] = i;
+    for (const auto& [i, j] : contacts)
+        parent[find(i)] = find(j);
+
+    // survivor of every group: the heaviest member, the lowest index on ties
+    heaviest.assign(N, -1);
+    for (int i = 0; i < N; ++i) {
+        int& h = heaviest[find(i)];
+        if (h < 0 || X.mass[i] > X.mass[h])
+            h = i;
+    }
+
+    // mass weighted sums per group, indexed by the group's root
+    sums.assign(N, Sum());
+    for (int i = 0; i < N; ++i)
+    {
+        Sum& s = sums[find(i)];
+        const double m = X.mass[i];
+        s.m += m;
+        s.x += m * X.x[i]; s.y += m * X.y[i]; s.z += m * X.z[i];
+        s.vx += m * X.vx[i]; s.vy += m * X.vy[i]; s.vz += m * X.vz[i];
+        s.r3 += radii[i] * radii[i] * radii[i];
+        ++s.members;
+    }
+
+    absorbed.clear();
+    for (int i = 0; i < N; ++i)
+    {
+        const int root = find(i);
+        if (heaviest[root] != i) {
+            absorbed.push_back(i);
+            continue;
+        }
+
+        const Sum& s = sums[root];
+        if (s.members == 1)
+            continue;
+        if (s.m > 0.0) {
+            X.x[i] = s.x / s.m; X.y[i] = s.y / s.m; X.z[i] = s.z / s.m;
+            X.vx[i] = s.vx / s.m; X.vy[i] = s.vy / s.m; X.vz[i] = s.vz / s.m;
+        }
+        X.mass[i] = s.m;
+        radii[i] = std::cbrt(s.r3);
+    }
+
+    return absorbed.size();
+}
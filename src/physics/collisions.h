@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "body_state.h"
+
+// Collision detection on a uniform spatial hash grid, O(N) expected.
+//
+// The cell size is the largest diameter, so two touching spheres always sit
+// in the same or in neighbouring cells and each body only tests the 27 cells
+// around it (9 in planar mode). Cells are hashed into a table of at least 2N
+// buckets, filled by a counting sort, so nothing is allocated once the
+// buffers have grown. One body much larger than the rest makes every cell
+// large and the search degrades towards O(N^2) around it.
+class CollisionDetector
+{
+public:
+    // Pairs (i, j), i < j, with |p_i - p_j| < r_i + r_j. Planar mode ignores z.
+    void findContacts(const BodyState& X, const double* radii, bool planar,
+        std::vector<std::pair<int, int>>& contacts);
+
+    // Merges every group of touching bodies into one, perfectly inelastic:
+    // masses add up, position and velocity become the mass weighted means, so
+    // momentum and the centre of mass are conserved, and radii add up by
+    // volume. The heaviest body of a group survives and gets the merged
+    // values, the others are listed in absorbed (ascending) for the caller to
+    // remove, e.g. with Simulation::removeBodies() or BodyState::keep().
+    // Returns how many were absorbed.
+    int merge(BodyState& X, std::vector<double>& radii, bool planar, std::vector<int>& absorbed);
+
+    // Contacts found by the last merge()
+    const std::vector<std::pair<int, int>>& lastContacts() const { return contacts; }
+
+private:
+    struct Sum
+    {
+        double m = 0.0, x = 0.0, y = 0.0, z = 0.0, vx = 0.0, vy = 0.0, vz = 0.0, r3 = 0.0;
+        int members = 0;
+    };
+
+    int find(int i);
+
+    std::vector<uint32_t> bucketOf;
+    std::vector<int> bucketStart;
+    std::vector<int> sorted;
+    std::vector<std::pair<int, int>> contacts;
+    std::vector<int> parent;
+    std::vector<int> heaviest;
+    std::vector<Sum> sums;
+};
+
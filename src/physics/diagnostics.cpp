@@ -0,0 +1,99 @@
+#include "diagnostics.h"
+
+#include <cmath>
+
+DiagnosticsSample Diagnostics::measure(const BodyState& X, long long step, double time)
+{
+    DiagnosticsSample s;
+    s.step = step;
+    s.time = time;
+
+    const int N = X.size();
+    double twiceKinetic = 0.0, mx = 0.0, my = 0.0, mz = 0.0;
+    for (int i = 0; i < N; ++i)
+    {
+        const double m = X.mass[i];
+        const double vx = X.vx[i], vy = X.vy[i], vz = X.vz[i];
+        twiceKinetic += m * (vx * vx + vy * vy + vz * vz);
+
+        const double px = m * vx, py = m * vy, pz = m * vz;
+        s.px += px; s.py += py; s.pz += pz;
+        s.lx += X.y[i] * pz - X.z[i] * py;
+        s.ly += X.z[i] * px - X.x[i] * pz;
+        s.lz += X.x[i] * py - X.y[i] * px;
+
+        s.mass += m;
+        mx += m * X.x[i]; my += m * X.y[i]; mz += m * X.z[i];
+    }
+    s.kinetic = 0.5 * twiceKinetic;
+    if (s.mass > 0.0) {
+        s.cx = mx / s.mass;
+        s.cy = my / s.mass;
+        s.cz = mz / s.mass;
+    }
+    return s;
+}
+
+// every pair is in pot[i] and in pot[j], hence the half
+double Diagnostics::potentialEnergy(const BodyState& X, const double* pot)
+{
+    double sum = 0.0;
+    for (int i = 0; i < (int)X.size(); ++i)
+        sum += X.mass[i] * pot[i];
+    return 0.5 * sum;
+}
+
+void Diagnostics::add(const DiagnosticsSample& s)
+{
+    series.push_back(s);
+    lastStep = s.step;
+    if (file)
+        write(s);
+}
+
+double Diagnostics::energyError() const
+{
+    if (series.size() < 2)
+        return 0.0;
+    const double e0 = series.front().energy();
+    const double de = series.back().energy() - e0;
+    return e0 != 0.0 ? de / std::fabs(e0) : de;
+}
+
+void Diagnostics::clear()
+{
+    series.clear();
+    lastStep = -1;
+}
+
+bool Diagnostics::open(const char* path, std::string& error)
+{
+    close();
+    file = fopen(path, "w");
+    if (!file) {
+        error = std::string("cannot create ") + path;
+        return false;
+    }
+    fprintf(file, "step,time,kinetic,potential,energy,dE/E0,px,py,pz,lx,ly,lz,cx,cy,cz\n");
+    // a file opened mid run starts where the samples are
+    for (const auto& s : series)
+        write(s);
+    return true;
+}
+
+void Diagnostics::close()
+{
+    if (file) {
+        fclose(file);
+        file = nullptr;
+    }
+}
+
+void Diagnostics::write(const DiagnosticsSample& s)
+{
+    const double e0 = series.front().energy();
+    const double error = e0 != 0.0 ? (s.energy() - e0) / std::fabs(e0) : s.energy() - e0;
+    fprintf(file, "%lld,%.17g,%.17g,%.17g,%.17g,%.6e,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g,%.17g\n",
+        s.step, s.time, s.kinetic, s.potential, s.energy(), error,
+        s.px, s.py, s.pz, s.lx, s.ly, s.lz, s.cx, s.cy, s.cz);
+}
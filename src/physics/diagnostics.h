@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "body_state.h"
+
+// Conserved quantities of the state after `step` steps
+struct DiagnosticsSample
+{
+    long long step = 0;
+    double time = 0.0;
+    double kinetic = 0.0;
+    double potential = 0.0;
+    double px = 0.0, py = 0.0, pz = 0.0; // linear momentum
+    double lx = 0.0, ly = 0.0, lz = 0.0; // angular momentum about the origin
+    double cx = 0.0, cy = 0.0, cz = 0.0; // centre of mass
+    double mass = 0.0;
+
+    double energy() const { return kinetic + potential; }
+};
+
+// Time series of energy, momentum, angular momentum and centre of mass,
+// sampled every `interval` steps by Simulation.
+//
+// Everything but the potential energy is one O(N) pass over the state. The
+// potential comes from the force evaluation: the kernels sum pot[i] =
+// sum_j G m_j phi(r_ij) next to the accelerations on the steps that are
+// sampled, so there is no second O(N^2) sweep, see Simulation::step(). With
+// the tree and multipole solvers it carries their approximation error, with
+// the mesh solver it is relative to the mean density.
+//
+// Samples are kept in memory and, when a file is open, appended to it as CSV
+// lines as they are taken.
+class Diagnostics
+{
+public:
+    Diagnostics() = default;
+    ~Diagnostics() { close(); }
+
+    Diagnostics(const Diagnostics&) = delete;
+    Diagnostics& operator=(const Diagnostics&) = delete;
+
+    // 0 is off
+    void setInterval(int steps) { every = steps > 0 ? steps : 0; }
+    int interval() const { return every; }
+    // The state after `step` steps is to be sampled and has not been yet
+    bool due(long long step) const { return every > 0 && step % every == 0 && step != lastStep; }
+
+    // Every quantity but the potential energy, O(N)
+    static DiagnosticsSample measure(const BodyState& X, long long step, double time);
+    // 1/2 sum m_i pot[i], pot as the kernels fill it
+    static double potentialEnergy(const BodyState& X, const double* pot);
+
+    void add(const DiagnosticsSample& s);
+    const std::vector<DiagnosticsSample>& samples() const { return series; }
+    // (E - E0) / |E0| of the last sample against the first, 0 before two samples
+    double energyError() const;
+    // Forgets the samples, e.g. when the scene is replaced
+    void clear();
+
+    // Writes a header line and then every sample as it is added
+    bool open(const char* path, std::string& error);
+    void close();
+    bool isOpen() const { return file != nullptr; }
+
+private:
+    void write(const DiagnosticsSample& s);
+
+    int every = 0;
+    long long lastStep = -1;
+    std::vector<DiagnosticsSample> series;
+    FILE* file = nullptr;
+};
@@ -0,0 +1,382 @@
+#include "ensemble.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "simd_target.h"
+
+namespace
+{
+    constexpr int W = EnsembleLanes;
+
+    // Rows are [component][body][lane], R = N * W doubles per component.
+    // a gets the accelerations, closest the smallest squared separation per lane.
+    void forcesScalar(const double* pos, const double* gm, int N, double* a, double* closest)
+    {
+        const int R = N * W;
+        std::fill(a, a + 3 * R, 0.0);
+        for (int i = 0; i < N; ++i)
+            for (int j = i + 1; j < N; ++j)
+                for (int l = 0; l < W; ++l)
+                {
+                    const int pi = i * W + l, pj = j * W + l;
+                    const double dx = pos[pj] - pos[pi];
+                    const double dy = pos[R + pj] - pos[R + pi];
+                    const double dz = pos[2 * R + pj] - pos[2 * R + pi];
+                    const double r2 = dx * dx + dy * dy + dz * dz;
+                    closest[l] = std::min(closest[l], r2);
+
+                    // coincident bodies contribute nothing, as in the SIMD lanes
+                    const double inv = r2 > 0.0 ? 1.0 / std::sqrt(r2) : 0.0;
+                    const double inv3 = inv * inv * inv;
+                    const double si = gm[pj] * inv3, sj = gm[pi] * inv3;
+                    a[pi] += si * dx; a[R + pi] += si * dy; a[2 * R + pi] += si * dz;
+                    a[pj] -= sj * dx; a[R + pj] -= sj * dy; a[2 * R + pj] -= sj * dz;
+                }
+    }
+
+#if defined(NBODY_X86)
+    TARGET_AVX2
+    void forcesAVX2(const double* pos, const double* gm, int N, double* a, double* closest)
+    {
+        const int R = N * W;
+        const __m256d one = _mm256_set1_pd(1.0);
+        const __m256d zero = _mm256_setzero_pd();
+
+        // two independent halves of the lanes
+        for (int h = 0; h < W; h += 4)
+        {
+            for (int i = 0; i < N; ++i)
+                for (int c = 0; c < 3; ++c)
+                    _mm256_storeu_pd(a + c * R + i * W + h, zero);
+            __m256d minR2 = _mm256_loadu_pd(closest + h);
+
+            for (int i = 0; i < N; ++i)
+            {
+                const int pi = i * W + h;
+                const __m256d xi = _mm256_loadu_pd(pos + pi);
+                const __m256d yi = _mm256_loadu_pd(pos + R + pi);
+                const __m256d zi = _mm256_loadu_pd(pos + 2 * R + pi);
+                const __m256d gmi = _mm256_loadu_pd(gm + pi);
+                __m256d axi = _mm256_loadu_pd(a + pi);
+                __m256d ayi = _mm256_loadu_pd(a + R + pi);
+                __m256d azi = _mm256_loadu_pd(a + 2 * R + pi);
+
+                for (int j = i + 1; j < N; ++j)
+                {
+                    const int pj = j * W + h;
+                    __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(pos + pj), xi);
+                    __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(pos + R + pj), yi);
+                    __m256d dz = _mm256_sub_pd(_mm256_loadu_pd(pos + 2 * R + pj), zi);
+                    __m256d r2 = _mm256_fmadd_pd(dz, dz, _mm256_fmadd_pd(dy, dy, _mm256_mul_pd(dx, dx)));
+                    minR2 = _mm256_min_pd(minR2, r2);
+
+                    // the rsqrt estimate only comes in float, whose range r2 can leave
+                    __m256d inv = _mm256_div_pd(one, _mm256_sqrt_pd(r2));
+                    inv = _mm256_and_pd(inv, _mm256_cmp_pd(r2, zero, _CMP_GT_OQ));
+                    __m256d inv3 = _mm256_mul_pd(inv, _mm256_mul_pd(inv, inv));
+
+                    __m256d si = _mm256_mul_pd(_mm256_loadu_pd(gm + pj), inv3);
+                    axi = _mm256_fmadd_pd(si, dx, axi);
+                    ayi = _mm256_fmadd_pd(si, dy, ayi);
+                    azi = _mm256_fmadd_pd(si, dz, azi);
+
+                    __m256d sj = _mm256_mul_pd(gmi, inv3);
+                    _mm256_storeu_pd(a + pj, _mm256_fnmadd_pd(sj, dx, _mm256_loadu_pd(a + pj)));
+                    _mm256_storeu_pd(a + R + pj, _mm256_fnmadd_pd(sj, dy, _mm256_loadu_pd(a + R + pj)));
+                    _mm256_storeu_pd(a + 2 * R + pj, _mm256_fnmadd_pd(sj, dz, _mm256_loadu_pd(a + 2 * R + pj)));
+                }
+
+                _mm256_storeu_pd(a + pi, axi);
+                _mm256_storeu_pd(a + R + pi, ayi);
+                _mm256_storeu_pd(a + 2 * R + pi, azi);
+            }
+            _mm256_storeu_pd(closest + h, minR2);
+        }
+    }
+
+    TARGET_AVX512
+    void forcesAVX512(const double* pos, const double* gm, int N, double* a, double* closest)
+    {
+        const int R = N * W;
+        const __m512d half = _mm512_set1_pd(0.5);
+        const __m512d threeHalves = _mm512_set1_pd(1.5);
+        const __m512d zero = _mm512_setzero_pd();
+
+        for (int k = 0; k < 3 * R; k += W)
+            _mm512_storeu_pd(a + k, zero);
+        __m512d minR2 = _mm512_loadu_pd(closest);
+
+        for (int i = 0; i < N; ++i)
+        {
+            const int pi = i * W;
+            const __m512d xi = _mm512_loadu_pd(pos + pi);
+            const __m512d yi = _mm512_loadu_pd(pos + R + pi);
+            const __m512d zi = _mm512_loadu_pd(pos + 2 * R + pi);
+            const __m512d gmi = _mm512_loadu_pd(gm + pi);
+            __m512d axi = _mm512_loadu_pd(a + pi);
+            __m512d ayi = _mm512_loadu_pd(a + R + pi);
+            __m512d azi = _mm512_loadu_pd(a + 2 * R + pi);
+
+            for (int j = i + 1; j < N; ++j)
+            {
+                const int pj = j * W;
+                __m512d dx = _mm512_sub_pd(_mm512_loadu_pd(pos + pj), xi);
+                __m512d dy = _mm512_sub_pd(_mm512_loadu_pd(pos + R + pj), yi);
+                __m512d dz = _mm512_sub_pd(_mm512_loadu_pd(pos + 2 * R + pj), zi);
+                __m512d r2 = _mm512_fmadd_pd(dz, dz, _mm512_fmadd_pd(dy, dy, _mm512_mul_pd(dx, dx)));
+                minR2 = _mm512_mask_min_pd(minR2, 0xff, minR2, r2); // the unmasked form trips GCC's -Wmaybe-uninitialized
+
+                __mmask8 valid = _mm512_cmp_pd_mask(r2, zero, _CMP_GT_OQ);
+                __m512d inv = _mm512_maskz_rsqrt14_pd(valid, r2);
+                __m512d hr2 = _mm512_mul_pd(half, r2);
+                inv = _mm512_mul_pd(inv, _mm512_fnmadd_pd(hr2, _mm512_mul_pd(inv, inv), threeHalves));
+                inv = _mm512_mul_pd(inv, _mm512_fnmadd_pd(hr2, _mm512_mul_pd(inv, inv), threeHalves));
+                __m512d inv3 = _mm512_mul_pd(inv, _mm512_mul_pd(inv, inv));
+
+                __m512d si = _mm512_mul_pd(_mm512_loadu_pd(gm + pj), inv3);
+                axi = _mm512_fmadd_pd(si, dx, axi);
+                ayi = _mm512_fmadd_pd(si, dy, ayi);
+                azi = _mm512_fmadd_pd(si, dz, azi);
+
+                __m512d sj = _mm512_mul_pd(gmi, inv3);
+                _mm512_storeu_pd(a + pj, _mm512_fnmadd_pd(sj, dx, _mm512_loadu_pd(a + pj)));
+                _mm512_storeu_pd(a + R + pj, _mm512_fnmadd_pd(sj, dy, _mm512_loadu_pd(a + R + pj)));
+                _mm512_storeu_pd(a + 2 * R + pj, _mm512_fnmadd_pd(sj, dz, _mm512_loadu_pd(a + 2 * R + pj)));
+            }
+
+            _mm512_storeu_pd(a + pi, axi);
+            _mm512_storeu_pd(a + R + pi, ayi);
+            _mm512_storeu_pd(a + 2 * R + pi, azi);
+        }
+        _mm512_storeu_pd(closest, minR2);
+    }
+#endif
+
+    double energyOf(const BodyState& X, double G)
+    {
+        const size_t N = X.size();
+        double kinetic = 0.0, potential = 0.0;
+        for (size_t i = 0; i < N; ++i)
+        {
+            kinetic += 0.5 * X.mass[i] * (X.vx[i] * X.vx[i] + X.vy[i] * X.vy[i] + X.vz[i] * X.vz[i]);
+            for (size_t j = i + 1; j < N; ++j)
+            {
+                const double dx = X.x[j] - X.x[i], dy = X.y[j] - X.y[i], dz = X.z[j] - X.z[i];
+                potential -= G * X.mass[i] * X.mass[j] / std::sqrt(dx * dx + dy * dy + dz * dz);
+            }
+        }
+        return kinetic + potential;
+    }
+
+    double closestSquared(const BodyState& X)
+    {
+        const size_t N = X.size();
+        double best = INFINITY;
+        for (size_t i = 0; i < N; ++i)
+            for (size_t j = i + 1; j < N; ++j)
+            {
+                const double dx = X.x[j] - X.x[i], dy = X.y[j] - X.y[i], dz = X.z[j] - X.z[i];
+                best = std::min(best, dx * dx + dy * dy + dz * dz);
+            }
+        return best;
+    }
+}
+
+Ensemble::Ensemble(double gravitationalConstant, int threads)
+    : G(gravitationalConstant), pool(threads)
+{
+}
+
+int Ensemble::add(const BodyState& X)
+{
+    assert(count == 0 || (int)X.size() == N);
+    N = X.size();
+
+    const int b = count / W, lane = count % W;
+    // a new batch starts as copies of its first system, the unused lanes are
+    // stepped along with the rest and never read back
+    const int lanesEnd = lane == 0 ? W : lane + 1;
+    if (lane == 0) {
+        state.resize(state.size() + 6 * N * W);
+        acc.resize(acc.size() + 3 * N * W);
+        mass.resize(mass.size() + N * W);
+        gm.resize(gm.size() + N * W);
+        closestSq.resize(closestSq.size() + W);
+    }
+
+    const double sq = closestSquared(X);
+    double* s = stateOf(b);
+    for (int l = lane; l < lanesEnd; ++l)
+    {
+        for (int c = 0; c < 6; ++c)
+            for (int i = 0; i < N; ++i)
+                s[(c * N + i) * W + l] = X.component(c)[i];
+        for (int i = 0; i < N; ++i) {
+            mass[(size_t)b * N * W + i * W + l] = X.mass[i];
+            gm[(size_t)b * N * W + i * W + l] = G * X.mass[i];
+        }
+        closestSq[(size_t)b * W + l] = sq;
+    }
+
+    EnsembleStats st;
+    st.energy0 = st.energy = energyOf(X, G);
+    st.closest = std::sqrt(sq);
+    summary.push_back(st);
+    accValid = false;
+    return count++;
+}
+
+BodyState Ensemble::system(int s) const
+{
+    const int b = s / W, l = s % W;
+    const double* S = state.data() + (size_t)b * 6 * N * W;
+    const double* m = massOf(b);
+    BodyState X(N);
+    for (int c = 0; c < 6; ++c)
+        for (int i = 0; i < N; ++i)
+            X.component(c)[i] = S[(c * N + i) * W + l];
+    for (int i = 0; i < N; ++i)
+        X.mass[i] = m[i * W + l];
+    return X;
+}
+
+void Ensemble::setIntegrator(IntegratorKind k)
+{
+    assert(k == IntegratorKind::RK4 || k == IntegratorKind::Leapfrog || k == IntegratorKind::VelocityVerlet);
+    kind = k;
+    accValid = false;
+}
+
+void Ensemble::forces(const double* pos, const double* gmOf, double* a, double* closest) const
+{
+#if defined(NBODY_X86)
+    if (simd == SimdLevel::AVX512) {
+        forcesAVX512(pos, gmOf, N, a, closest);
+        return;
+    }
+    if (simd == SimdLevel::AVX2) {
+        forcesAVX2(pos, gmOf, N, a, closest);
+        return;
+    }
+#endif
+    forcesScalar(pos, gmOf, N, a, closest);
+}
+
+void Ensemble::runBatch(int b, int steps, double dt)
+{
+    const int R = N * W;
+    double* pos = stateOf(b);
+    double* vel = pos + 3 * R;
+    double* a = accOf(b);
+    const double* g = gm.data() + (size_t)b * R;
+    double* closest = closestSq.data() + (size_t)b * W;
+
+    // RK4 stages, kept per thread so a steady-state run does not allocate
+    thread_local std::vector<double> scratch;
+    if (kind == IntegratorKind::RK4)
+        scratch.resize(5 * 6 * R);
+
+    if (kind != IntegratorKind::RK4 && !accValid)
+        forces(pos, g, a, closest);
+
+    for (int k = 0; k < steps; ++k)
+    {
+        if (kind == IntegratorKind::Leapfrog)
+        {
+            const double h = dt / 2;
+            for (int n = 0; n < 3 * R; ++n) {
+                vel[n] += a[n] * h;
+                pos[n] += vel[n] * dt;
+            }
+            forces(pos, g, a, closest);
+            for (int n = 0; n < 3 * R; ++n)
+                vel[n] += a[n] * h;
+        }
+        else if (kind == IntegratorKind::VelocityVerlet)
+        {
+            const double h = dt * dt / 2;
+            for (int n = 0; n < 3 * R; ++n) {
+                pos[n] += vel[n] * dt + a[n] * h;
+                vel[n] += a[n] * (dt / 2);
+            }
+            forces(pos, g, a, closest);
+            for (int n = 0; n < 3 * R; ++n)
+                vel[n] += a[n] * (dt / 2);
+        }
+        else
+        {
+            // k1..k4 and the stage state, each 6 * R: positions' derivative
+            // in the first half, velocities' in the second
+            double* K[4] = { scratch.data(), scratch.data() + 6 * R, scratch.data() + 12 * R, scratch.data() + 18 * R };
+            double* temp = scratch.data() + 24 * R;
+            auto derive = [&](const double* S, double* D) {
+                std::copy(S + 3 * R, S + 6 * R, D);
+                forces(S, g, D + 3 * R, closest);
+            };
+            auto stage = [&](const double* D, double h) {
+                for (int n = 0; n < 6 * R; ++n)
+                    temp[n] = pos[n] + D[n] * h;
+            };
+
+            derive(pos, K[0]);
+            stage(K[0], dt / 2);
+            derive(temp, K[1]);
+            stage(K[1], dt / 2);
+            derive(temp, K[2]);
+            stage(K[2], dt);
+            derive(temp, K[3]);
+            for (int n = 0; n < 6 * R; ++n)
+                pos[n] += (K[0][n] + 2 * K[1][n] + 2 * K[2][n] + K[3][n]) * (dt / 6);
+        }
+
+        if ((stepsDone + k + 1) % sampleEvery == 0 && k + 1 < steps)
+            sample(b);
+    }
+    sample(b);
+}
+
+void Ensemble::sample(int b)
+{
+    const int R = N * W;
+    const double* S = stateOf(b);
+    const double* m = massOf(b);
+    const int lanes = std::min(W, count - b * W);
+    for (int l = 0; l < lanes; ++l)
+    {
+        double kinetic = 0.0, potential = 0.0;
+        for (int i = 0; i < N; ++i)
+        {
+            const int p = i * W + l;
+            const double vx = S[3 * R + p], vy = S[4 * R + p], vz = S[5 * R + p];
+            kinetic += 0.5 * m[p] * (vx * vx + vy * vy + vz * vz);
+            for (int j = i + 1; j < N; ++j)
+            {
+                const int q = j * W + l;
+                const double dx = S[q] - S[p], dy = S[R + q] - S[R + p], dz = S[2 * R + q] - S[2 * R + p];
+                potential -= G * m[p] * m[q] / std::sqrt(dx * dx + dy * dy + dz * dz);
+            }
+        }
+
+        EnsembleStats& st = summary[(size_t)b * W + l];
+        st.energy = kinetic + potential;
+        if (st.energy0 != 0.0)
+            st.maxEnergyError = std::max(st.maxEnergyError, std::fabs((st.energy - st.energy0) / st.energy0));
+        st.closest = std::sqrt(closestSq[(size_t)b * W + l]);
+    }
+}
+
+void Ensemble::run(int steps, double dt)
+{
+    if (count == 0 || steps <= 0)
+        return;
+
+    const int batches = (count + W - 1) / W;
+    auto task = [&](int b) { runBatch(b, steps, dt); };
+    pool.run(batches, task);
+
+    accValid = kind != IntegratorKind::RK4;
+    stepsDone += steps;
+    elapsed += steps * dt;
+}
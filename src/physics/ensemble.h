@@ -0,0 +1,94 @@
+#pragma once
+
+#include <vector>
+
+#include "body_state.h"
+#include "gravity_simd.h"
+#include "integrator.h"
+#include "thread_pool.h"
+
+// Systems per batch, one SIMD lane each: a full AVX-512 register, two AVX2 ones
+constexpr int EnsembleLanes = 8;
+
+// Summary of one system of an Ensemble, updated by run()
+struct EnsembleStats
+{
+    double energy0 = 0.0;        // when it was added
+    double energy = 0.0;         // at the last sample
+    double maxEnergyError = 0.0; // largest |E - E0| / |E0| over the samples
+    double closest = 0.0;        // smallest pair separation any force pass saw
+};
+
+// Many independent systems with the same body count, e.g. perturbed copies of
+// the solar system for a Monte-Carlo sweep, stepped together.
+//
+// The systems are interleaved in batches of EnsembleLanes: within a batch
+// every (component, body) is a row of EnsembleLanes doubles, one per system,
+// so one SIMD instruction advances a pair of bodies in eight systems and a
+// batch of nine bodies (6 KB with its forces) stays in L1 for a whole run().
+// The pair loop uses Newton's third law, every pair is computed once.
+//
+// run() hands the batches out to the thread pool one at a time, so threads
+// that finish early take the remaining ones. The AVX-512 kernel uses the
+// reciprocal square root estimate of gravity_simd.h (same SimdTolerance), the
+// others 1 / sqrt in double.
+class Ensemble
+{
+public:
+    explicit Ensemble(double gravitationalConstant, int threads = 1);
+
+    // Appends a system and returns its index. Every system needs the body
+    // count of the first one.
+    int add(const BodyState& X);
+
+    int size() const { return count; }
+    int bodies() const { return N; }
+
+    // Current state of system s
+    BodyState system(int s) const;
+    const EnsembleStats& stats(int s) const { return summary[s]; }
+
+    // RK4, Leapfrog or VelocityVerlet
+    void setIntegrator(IntegratorKind kind);
+    void setThreads(int n) { pool.setThreads(n); }
+    int threads() const { return pool.threads(); }
+    // Levels above what the CPU supports are clamped to the detected one
+    void setSimdLevel(SimdLevel level) { simd = level < detectSimdLevel() ? level : detectSimdLevel(); }
+    // Steps between two energy samples, every run() also samples at its end
+    void setSampleInterval(int steps) { sampleEvery = steps > 0 ? steps : 1; }
+
+    // Advances every system by steps * dt
+    void run(int steps, double dt);
+
+    long long stepCount() const { return stepsDone; }
+    double time() const { return elapsed; }
+
+private:
+    // Offsets of a batch's rows: [component][body][lane]
+    double* stateOf(int b) { return state.data() + (size_t)b * 6 * N * EnsembleLanes; }
+    double* accOf(int b) { return acc.data() + (size_t)b * 3 * N * EnsembleLanes; }
+    const double* massOf(int b) const { return mass.data() + (size_t)b * N * EnsembleLanes; }
+
+    void runBatch(int b, int steps, double dt);
+    void forces(const double* pos, const double* gm, double* a, double* closest) const;
+    void sample(int b);
+
+    double G;
+    int N = 0;
+    int count = 0;
+    IntegratorKind kind = IntegratorKind::Leapfrog;
+    SimdLevel simd = detectSimdLevel();
+    int sampleEvery = 100;
+    long long stepsDone = 0;
+    double elapsed = 0.0;
+
+    std::vector<double> state; // per batch 6 * N * EnsembleLanes
+    std::vector<double> acc;   // per batch 3 * N * EnsembleLanes, leapfrog forces of the next step
+    std::vector<double> mass;  // per batch N * EnsembleLanes
+    std::vector<double> gm;    // G * mass
+    std::vector<double> closestSq;
+    std::vector<EnsembleStats> summary;
+    bool accValid = false;
+
+    ThreadPool pool;
+};
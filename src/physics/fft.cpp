@@ -0,0 +1,141 @@
+#include "fft.h"
+
+#include <cassert>
+#include <cmath>
+#include <utility>
+
+namespace {
+
+constexpr double Pi = 3.14159265358979323846;
+
+}
+
+void Fft::setSize(int size)
+{
+    assert(size > 0 && (size & (size - 1)) == 0);
+    n = size;
+
+    swaps.clear();
+    int bits = 0;
+    while ((1 << bits) < n)
+        ++bits;
+    for (int i = 0; i < n; ++i) {
+        int r = 0;
+        for (int b = 0; b < bits; ++b)
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        if (i < r)
+            swaps.emplace_back(i, r);
+    }
+
+    cosine.resize(n / 2);
+    sine.resize(n / 2);
+    for (int k = 0; k < n / 2; ++k) {
+        cosine[k] = std::cos(2.0 * Pi * k / n);
+        sine[k] = std::sin(2.0 * Pi * k / n);
+    }
+}
+
+void Fft::transform(double* data, size_t stride, int count, bool inverse) const
+{
+    const size_t row = 2 * stride;
+    const int width = 2 * count;
+
+    for (const auto& s : swaps) {
+        double* a = data + s.first * row;
+        double* b = data + s.second * row;
+        for (int c = 0; c < width; ++c)
+            std::swap(a[c], b[c]);
+    }
+
+    // e^(-2 pi i k / len) forward, e^(+2 pi i k / len) inverse
+    const double sign = inverse ? 1.0 : -1.0;
+    for (int len = 2; len <= n; len <<= 1)
+    {
+        const int half = len / 2, step = n / len;
+        for (int start = 0; start < n; start += len) {
+            for (int k = 0; k < half; ++k) {
+                const double wr = cosine[k * step], wi = sign * sine[k * step];
+                double* a = data + (start + k) * row;
+                double* b = a + half * row;
+                for (int c = 0; c < width; c += 2) {
+                    const double br = b[c] * wr - b[c + 1] * wi;
+                    const double bi = b[c] * wi + b[c + 1] * wr;
+                    b[c] = a[c] - br;
+                    b[c + 1] = a[c + 1] - bi;
+                    a[c] += br;
+                    a[c + 1] += bi;
+                }
+            }
+        }
+    }
+}
+
+void RealFft::setSize(int size)
+{
+    assert(size >= 4 && (size & (size - 1)) == 0);
+    n = size;
+    half.setSize(n / 2);
+    cosine.resize(n / 4 + 1);
+    sine.resize(n / 4 + 1);
+    for (int k = 0; k <= n / 4; ++k) {
+        cosine[k] = std::cos(2.0 * Pi * k / n);
+        sine[k] = std::sin(2.0 * Pi * k / n);
+    }
+}
+
+// The reals as n / 2 complex z_j = x_2j + i x_2j+1 with transform Z. With
+// E = (Z_k + conj Z_m-k) / 2 and O = (Z_k - conj Z_m-k) / 2i, m = n / 2, the
+// spectrum is X_k = E + W^k O and X_m-k = conj(E - W^k O), W = e^(-2 pi i / n).
+void RealFft::forward(double* data) const
+{
+    const int m = n / 2;
+    half.forward(data);
+
+    const double r0 = data[0], i0 = data[1];
+    data[0] = r0 + i0;
+    data[1] = 0.0;
+    data[2 * m] = r0 - i0;
+    data[2 * m + 1] = 0.0;
+
+    for (int k = 1; k <= m / 2; ++k)
+    {
+        double* a = data + 2 * k;
+        double* b = data + 2 * (m - k);
+        const double er = 0.5 * (a[0] + b[0]), ei = 0.5 * (a[1] - b[1]);
+        const double or_ = 0.5 * (a[1] + b[1]), oi = -0.5 * (a[0] - b[0]);
+        const double wr = cosine[k], wi = -sine[k];
+        const double tr = wr * or_ - wi * oi, ti = wr * oi + wi * or_;
+        // b first, at k = m / 2 both are the same bin and a is the right value
+        b[0] = er - tr;
+        b[1] = -(ei - ti);
+        a[0] = er + tr;
+        a[1] = ei + ti;
+    }
+}
+
+// The forward steps undone, times two: Z_k = P + iQ and Z_m-k = conj(P - iQ)
+// with P = X_k + conj X_m-k, Q = (X_k - conj X_m-k) conj W^k
+void RealFft::inverse(double* data) const
+{
+    const int m = n / 2;
+
+    const double x0 = data[0], xm = data[2 * m];
+    data[0] = x0 + xm;
+    data[1] = x0 - xm;
+
+    for (int k = 1; k <= m / 2; ++k)
+    {
+        double* a = data + 2 * k;
+        double* b = data + 2 * (m - k);
+        const double pr = a[0] + b[0], pi = a[1] - b[1];
+        const double dr = a[0] - b[0], di = a[1] + b[1];
+        const double wr = cosine[k], wi = sine[k];
+        const double qr = dr * wr - di * wi, qi = dr * wi + di * wr;
+        b[0] = pr + qi;
+        b[1] = -(pi - qr);
+        a[0] = pr - qi;
+        a[1] = pi + qr;
+    }
+
+    half.inverse(data);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Radix-2 FFT of power of two lengths, self-contained so the mesh solver
+// needs no library.
+//
+// Complex values are (re, im) pairs of doubles. The transforms are
+// unnormalized, inverse(forward(x)) = n x. One call transforms `count`
+// interleaved sequences, element i of sequence c at data[2 * (i * stride + c)]:
+// the butterflies then run over contiguous rows of count values, which is
+// how the mesh transforms whole planes and column blocks without copying
+// them out.
+class Fft
+{
+public:
+    explicit Fft(int size = 1) { setSize(size); }
+
+    void setSize(int size);
+    int size() const { return n; }
+
+    void forward(double* data, size_t stride = 1, int count = 1) const { transform(data, stride, count, false); }
+    void inverse(double* data, size_t stride = 1, int count = 1) const { transform(data, stride, count, true); }
+
+private:
+    void transform(double* data, size_t stride, int count, bool inverse) const;
+
+    int n = 1;
+    std::vector<std::pair<int, int>> swaps; // bit reversal
+    std::vector<double> cosine, sine;       // of 2 pi k / n, k < n / 2
+};
+
+// Transform of n real values (n a power of two, at least 4) through one
+// complex transform of n / 2. In place on n + 2 doubles: the n reals go in,
+// the bins 0..n/2 come out as n / 2 + 1 complex values, and back.
+class RealFft
+{
+public:
+    explicit RealFft(int size = 4) { setSize(size); }
+
+    void setSize(int size);
+    int size() const { return n; }
+
+    void forward(double* data) const;
+    // n times the original values
+    void inverse(double* data) const;
+
+private:
+    int n = 4;
+    Fft half;
+    std::vector<double> cosine, sine; // of 2 pi k / n, k <= n / 4
+};
@@ -0,0 +1,408 @@
+#include "fmm.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+double binomial(int n, int k)
+{
+    double r = 1.0;
+    for (int i = 1; i <= k; ++i)
+        r = r * (n - k + i) / i;
+    return r;
+}
+
+// prod_i binomial(n_i, k_i) for multi-indices
+double binomial3(const std::array<int, 3>& n, const std::array<int, 3>& k)
+{
+    return binomial(n[0], k[0]) * binomial(n[1], k[1]) * binomial(n[2], k[2]);
+}
+
+constexpr int MaxLevels = 6;
+constexpr int BlockCells = 16;
+
+}
+
+void FmmGravity::setOrder(int order)
+{
+    p = std::clamp(order, 1, MaxOrder);
+
+    mi.clear();
+    degree.clear();
+    lookup.assign((p + 1) * (p + 1) * (p + 1), -1);
+    for (int n = 0; n <= p; ++n) {
+        for (int a = n; a >= 0; --a) {
+            for (int b = n - a; b >= 0; --b) {
+                lookup[(a * (p + 1) + b) * (p + 1) + (n - a - b)] = mi.size();
+                mi.push_back({ a, b, n - a - b });
+                degree.push_back(n);
+            }
+        }
+    }
+
+    m2l.clear();
+    m2m.clear();
+    l2l.clear();
+    for (int l = 0; l < terms(); ++l) {
+        for (int k = 0; k < terms(); ++k) {
+            const auto& L = mi[l];
+            const auto& K = mi[k];
+
+            if (degree[l] + degree[k] <= p) {
+                std::array<int, 3> kl = { K[0] + L[0], K[1] + L[1], K[2] + L[2] };
+                double sign = (degree[k] & 1) ? -1.0 : 1.0;
+                m2l.push_back({ l, k, termIndex(kl[0], kl[1], kl[2]), sign * binomial3(kl, K) });
+            }
+
+            // k <= l componentwise: M2M moves moments k into l, L2L moves locals l into k
+            if (K[0] <= L[0] && K[1] <= L[1] && K[2] <= L[2]) {
+                int power = termIndex(L[0] - K[0], L[1] - K[1], L[2] - K[2]);
+                double c = binomial3(L, K);
+                m2m.push_back({ l, k, power, c });
+                l2l.push_back({ k, l, power, c });
+            }
+        }
+    }
+}
+
+void FmmGravity::monomials(double x, double y, double z, double* out) const
+{
+    double px[MaxOrder + 1], py[MaxOrder + 1], pz[MaxOrder + 1];
+    px[0] = py[0] = pz[0] = 1.0;
+    for (int i = 1; i <= p; ++i) {
+        px[i] = px[i - 1] * x;
+        py[i] = py[i - 1] * y;
+        pz[i] = pz[i - 1] * z;
+    }
+    for (int t = 0; t < terms(); ++t)
+        out[t] = px[mi[t][0]] * py[mi[t][1]] * pz[mi[t][2]];
+}
+
+// Taylor coefficients T_k = (1 / k!) d^k (1 / r) of the kernel at (x, y, z), from
+//   n r^2 T_k + (2n - 1) sum_i x_i T_{k - e_i} + (n - 1) sum_i T_{k - 2 e_i} = 0
+void FmmGravity::derivatives(double x, double y, double z, double* T) const
+{
+    const double r2 = x * x + y * y + z * z;
+    T[0] = 1.0 / sqrt(r2);
+
+    for (int t = 1; t < terms(); ++t)
+    {
+        const int a = mi[t][0], b = mi[t][1], c = mi[t][2];
+        const int n = degree[t];
+
+        double first = 0.0, second = 0.0;
+        if (a > 0) first += x * T[termIndex(a - 1, b, c)];
+        if (b > 0) first += y * T[termIndex(a, b - 1, c)];
+        if (c > 0) first += z * T[termIndex(a, b, c - 1)];
+        if (a > 1) second += T[termIndex(a - 2, b, c)];
+        if (b > 1) second += T[termIndex(a, b - 2, c)];
+        if (c > 1) second += T[termIndex(a, b, c - 2)];
+
+        T[t] = -((2 * n - 1) * first + (n - 1) * second) / (n * r2);
+    }
+}
+
+void FmmGravity::cellCenter(int level, int ix, int iy, int iz, double& cx, double& cy, double& cz) const
+{
+    const double width = 2.0 * rootHalf / (1 << level);
+    cx = rootX - rootHalf + (ix + 0.5) * width;
+    cy = rootY - rootHalf + (iy + 0.5) * width;
+    cz = rootZ - rootHalf + (iz + 0.5) * width;
+}
+
+void FmmGravity::bin(const BodyState& X)
+{
+    const int N = X.size();
+
+    double lo[3] = { X.x[0], X.y[0], X.z[0] };
+    double hi[3] = { lo[0], lo[1], lo[2] };
+    for (int i = 1; i < N; ++i) {
+        lo[0] = std::min(lo[0], X.x[i]); hi[0] = std::max(hi[0], X.x[i]);
+        lo[1] = std::min(lo[1], X.y[i]); hi[1] = std::max(hi[1], X.y[i]);
+        lo[2] = std::min(lo[2], X.z[i]); hi[2] = std::max(hi[2], X.z[i]);
+    }
+    rootX = 0.5 * (lo[0] + hi[0]);
+    rootY = 0.5 * (lo[1] + hi[1]);
+    rootZ = 0.5 * (lo[2] + hi[2]);
+    rootHalf = 0.5 * std::max({ hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2] });
+    rootHalf = rootHalf > 0.0 ? rootHalf * 1.0001 : 1.0;
+
+    // interaction lists only exist from level 2 on
+    const double branching = planar ? 4.0 : 8.0;
+    levels = 2;
+    while (levels < MaxLevels && N / pow(branching, levels) > leafSize)
+        ++levels;
+
+    levelStart.assign(levels + 2, 0);
+    for (int l = 0; l <= levels; ++l)
+        levelStart[l + 1] = levelStart[l] + (1 << (3 * l));
+    const int cells = levelStart[levels + 1];
+
+    multipole.assign((size_t)cells * terms(), 0.0);
+    local.assign((size_t)cells * terms(), 0.0);
+    cellCount.assign(cells, 0);
+
+    // counting sort of the bodies by leaf
+    const int side = 1 << levels;
+    const int leaves = side * side * side;
+    const double scale = side / (2.0 * rootHalf);
+    auto coord = [&](double v, double origin) {
+        return std::clamp((int)((v - origin) * scale), 0, side - 1);
+    };
+
+    sorted.resize(N);
+    leafStart.assign(leaves + 1, 0);
+    for (int i = 0; i < N; ++i) {
+        int leaf = (coord(X.z[i], rootZ - rootHalf) * side + coord(X.y[i], rootY - rootHalf)) * side
+            + coord(X.x[i], rootX - rootHalf);
+        sorted[i] = leaf;
+        ++leafStart[leaf + 1];
+    }
+    for (int c = 0; c < leaves; ++c)
+        leafStart[c + 1] += leafStart[c];
+
+    // sorted[] holds the leaf of each body so far, slots[] becomes the sorted body list
+    sx.resize(N); sy.resize(N); sz.resize(N); sm.resize(N);
+    slots.resize(N);
+    int* leafCount = &cellCount[levelStart[levels]];
+    for (int i = 0; i < N; ++i) {
+        int leaf = sorted[i];
+        int slot = leafStart[leaf] + leafCount[leaf]++;
+        sx[slot] = X.x[i]; sy[slot] = X.y[i]; sz[slot] = X.z[i]; sm[slot] = X.mass[i];
+        slots[slot] = i;
+    }
+    sorted.swap(slots);
+
+    // body counts of the coarser levels, empty cells get skipped later
+    for (int l = levels - 1; l >= 0; --l) {
+        const int s2 = 1 << l;
+        for (int iz = 0; iz < s2; ++iz)
+            for (int iy = 0; iy < s2; ++iy)
+                for (int ix = 0; ix < s2; ++ix) {
+                    int sum = 0;
+                    for (int o = 0; o < 8; ++o)
+                        sum += cellCount[cellIndex(l + 1, 2 * ix + (o & 1), 2 * iy + ((o >> 1) & 1), 2 * iz + (o >> 2))];
+                    cellCount[cellIndex(l, ix, iy, iz)] = sum;
+                }
+    }
+}
+
+void FmmGravity::upwardPass()
+{
+    const int T = terms();
+    const int side = 1 << levels;
+    const int leaves = side * side * side;
+
+    // P2M
+    auto p2m = [&](int block) {
+        double mono[MaxTerms];
+        const int end = std::min((block + 1) * BlockCells, leaves);
+        for (int leaf = block * BlockCells; leaf < end; ++leaf) {
+            if (leafStart[leaf] == leafStart[leaf + 1])
+                continue;
+            double cx, cy, cz;
+            cellCenter(levels, leaf % side, (leaf / side) % side, leaf / (side * side), cx, cy, cz);
+            double* M = &multipole[(size_t)(levelStart[levels] + leaf) * T];
+            for (int s = leafStart[leaf]; s < leafStart[leaf + 1]; ++s) {
+                monomials(sx[s] - cx, sy[s] - cy, sz[s] - cz, mono);
+                for (int t = 0; t < T; ++t)
+                    M[t] += sm[s] * mono[t];
+            }
+        }
+    };
+    pool.run((leaves + BlockCells - 1) / BlockCells, p2m);
+
+    // M2M, children to parents
+    for (int l = levels - 1; l >= 2; --l)
+    {
+        const int s2 = 1 << l;
+        const int cells = s2 * s2 * s2;
+        auto m2mTask = [&](int block) {
+            double mono[MaxTerms];
+            const int end = std::min((block + 1) * BlockCells, cells);
+            for (int c = block * BlockCells; c < end; ++c) {
+                const int ix = c % s2, iy = (c / s2) % s2, iz = c / (s2 * s2);
+                const int parent = cellIndex(l, ix, iy, iz);
+                if (cellCount[parent] == 0)
+                    continue;
+                double px, py, pz;
+                cellCenter(l, ix, iy, iz, px, py, pz);
+                double* M = &multipole[(size_t)parent * T];
+
+                for (int o = 0; o < 8; ++o) {
+                    int cx = 2 * ix + (o & 1), cy = 2 * iy + ((o >> 1) & 1), cz = 2 * iz + (o >> 2);
+                    int child = cellIndex(l + 1, cx, cy, cz);
+                    if (cellCount[child] == 0)
+                        continue;
+                    double ccx, ccy, ccz;
+                    cellCenter(l + 1, cx, cy, cz, ccx, ccy, ccz);
+                    monomials(ccx - px, ccy - py, ccz - pz, mono);
+                    const double* Mc = &multipole[(size_t)child * T];
+                    for (const auto& e : m2m)
+                        M[e.to] += e.coeff * Mc[e.from] * mono[e.power];
+                }
+            }
+        };
+        pool.run((cells + BlockCells - 1) / BlockCells, m2mTask);
+    }
+}
+
+void FmmGravity::downwardPass()
+{
+    const int T = terms();
+
+    for (int l = 2; l <= levels; ++l)
+    {
+        const int s2 = 1 << l;
+        const int cells = s2 * s2 * s2;
+
+        // on a uniform grid a source sits at most 3 cells away, so the kernel
+        // derivatives are shared by every cell of the level
+        const double width = 2.0 * rootHalf / s2;
+        kernelTable.resize((size_t)343 * T);
+        for (int dz = -3; dz <= 3; ++dz)
+            for (int dy = -3; dy <= 3; ++dy)
+                for (int dx = -3; dx <= 3; ++dx) {
+                    if (abs(dx) <= 1 && abs(dy) <= 1 && abs(dz) <= 1)
+                        continue;
+                    derivatives(dx * width, dy * width, dz * width,
+                        &kernelTable[(size_t)(((dz + 3) * 7 + dy + 3) * 7 + dx + 3) * T]);
+                }
+
+        auto task = [&](int block) {
+            double buf[MaxTerms];
+            const int end = std::min((block + 1) * BlockCells, cells);
+            for (int c = block * BlockCells; c < end; ++c) {
+                const int ix = c % s2, iy = (c / s2) % s2, iz = c / (s2 * s2);
+                const int target = cellIndex(l, ix, iy, iz);
+                if (cellCount[target] == 0)
+                    continue;
+                double tx, ty, tz;
+                cellCenter(l, ix, iy, iz, tx, ty, tz);
+                double* L = &local[(size_t)target * T];
+
+                // L2L from the parent
+                if (l > 2) {
+                    double px, py, pz;
+                    cellCenter(l - 1, ix / 2, iy / 2, iz / 2, px, py, pz);
+                    monomials(tx - px, ty - py, tz - pz, buf);
+                    const double* Lp = &local[(size_t)cellIndex(l - 1, ix / 2, iy / 2, iz / 2) * T];
+                    for (const auto& e : l2l)
+                        L[e.to] += e.coeff * Lp[e.from] * buf[e.power];
+                }
+
+                // M2L from children of the parent's neighbours that are not our neighbours
+                const int side = s2 / 2;
+                for (int nz = std::max(iz / 2 - 1, 0); nz <= std::min(iz / 2 + 1, side - 1); ++nz)
+                for (int ny = std::max(iy / 2 - 1, 0); ny <= std::min(iy / 2 + 1, side - 1); ++ny)
+                for (int nx = std::max(ix / 2 - 1, 0); nx <= std::min(ix / 2 + 1, side - 1); ++nx)
+                for (int o = 0; o < 8; ++o) {
+                    int sxi = 2 * nx + (o & 1), syi = 2 * ny + ((o >> 1) & 1), szi = 2 * nz + (o >> 2);
+                    if (abs(sxi - ix) <= 1 && abs(syi - iy) <= 1 && abs(szi - iz) <= 1)
+                        continue;
+                    int source = cellIndex(l, sxi, syi, szi);
+                    if (cellCount[source] == 0)
+                        continue;
+
+                    const double* D = &kernelTable[(size_t)(((iz - szi + 3) * 7 + iy - syi + 3) * 7 + ix - sxi + 3) * T];
+                    const double* M = &multipole[(size_t)source * T];
+                    for (const auto& e : m2l)
+                        L[e.l] += e.coeff * M[e.k] * D[e.kl];
+                }
+            }
+        };
+        pool.run((cells + BlockCells - 1) / BlockCells, task);
+    }
+}
+
+void FmmGravity::evaluate(double G, double* ax, double* ay, double* az, double* pot)
+{
+    const int T = terms();
+    const int side = 1 << levels;
+    const int leaves = side * side * side;
+    // only the P2P part is softened, the leaves are rarely smaller than eps
+    const bool softened = softening.enabled();
+
+    auto task = [&](int block) {
+        double mono[MaxTerms];
+        const int end = std::min((block + 1) * BlockCells, leaves);
+        for (int leaf = block * BlockCells; leaf < end; ++leaf)
+        {
+            if (leafStart[leaf] == leafStart[leaf + 1])
+                continue;
+            const int ix = leaf % side, iy = (leaf / side) % side, iz = leaf / (side * side);
+            double cx, cy, cz;
+            cellCenter(levels, ix, iy, iz, cx, cy, cz);
+            const double* L = &local[(size_t)(levelStart[levels] + leaf) * T];
+
+            for (int s = leafStart[leaf]; s < leafStart[leaf + 1]; ++s)
+            {
+                // L2P: gradient of the local expansion, psi = sum m / r is the expansion itself
+                double gx = 0.0, gy = 0.0, gz = 0.0, psi = 0.0;
+                monomials(sx[s] - cx, sy[s] - cy, sz[s] - cz, mono);
+                if (pot) {
+                    for (int t = 0; t < T; ++t)
+                        psi += L[t] * mono[t];
+                }
+                for (int t = 1; t < T; ++t) {
+                    const int a = mi[t][0], b = mi[t][1], c = mi[t][2];
+                    if (a > 0) gx += L[t] * a * mono[termIndex(a - 1, b, c)];
+                    if (b > 0) gy += L[t] * b * mono[termIndex(a, b - 1, c)];
+                    if (c > 0) gz += L[t] * c * mono[termIndex(a, b, c - 1)];
+                }
+
+                // P2P with the 27 neighbouring leaves
+                for (int nz = std::max(iz - 1, 0); nz <= std::min(iz + 1, side - 1); ++nz)
+                for (int ny = std::max(iy - 1, 0); ny <= std::min(iy + 1, side - 1); ++ny)
+                for (int nx = std::max(ix - 1, 0); nx <= std::min(ix + 1, side - 1); ++nx) {
+                    const int nb = (nz * side + ny) * side + nx;
+                    for (int j = leafStart[nb]; j < leafStart[nb + 1]; ++j) {
+                        double dx = sx[j] - sx[s], dy = sy[j] - sy[s], dz = sz[j] - sz[s];
+                        double r2 = dx * dx + dy * dy + dz * dz;
+                        if (r2 == 0.0)
+                            continue;
+                        double w;
+                        if (softened) {
+                            w = sm[j] * softening.forceFactor(r2);
+                            if (pot)
+                                psi -= sm[j] * softening.potentialFactor(r2);
+                        }
+                        else {
+                            double inv_r = 1.0 / sqrt(r2);
+                            w = sm[j] * inv_r * inv_r * inv_r;
+                            if (pot)
+                                psi += sm[j] * inv_r;
+                        }
+                        gx += w * dx; gy += w * dy; gz += w * dz;
+                    }
+                }
+
+                const int i = sorted[s];
+                ax[i] = G * gx;
+                ay[i] = G * gy;
+                az[i] = G * gz;
+                if (pot)
+                    pot[i] = -G * psi;
+            }
+        }
+    };
+    pool.run((leaves + BlockCells - 1) / BlockCells, task);
+}
+
+void FmmGravity::accelerations(const BodyState& X, double G, double* ax, double* ay, double* az)
+{
+    accelerationsWithPotential(X, G, ax, ay, az, nullptr);
+}
+
+void FmmGravity::accelerationsWithPotential(const BodyState& X, double G, double* ax, double* ay, double* az,
+    double* pot)
+{
+    if (X.empty())
+        return;
+
+    bin(X);
+    upwardPass();
+    downwardPass();
+    evaluate(G, ax, ay, az, pot);
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include "force_backend.h"
+
+// Fast multipole method on a uniform octree, O(N) per evaluation.
+//
+// Cells carry Cartesian multipole moments M_k = sum m d^k and local (Taylor)
+// expansions up to total order p, k being a multi-index (a, b, c). Cells that
+// are not adjacent but whose parents are exchange far field through M2L, the
+// 27 neighbouring leaves interact directly.
+//
+// One cell of separation keeps the near field small but converges slowly.
+// On a uniform cloud (`bench fmm_accuracy`, N = 3000 and 30000) the rms
+// relative force error is about 7e-2, 2e-2, 5e-3, 2e-3 for p = 1..4 and
+// then only halves per order, 2e-4 at p = 8. The worst body is up to 40
+// times the rms and at low p not even monotonic (0.26 at p = 2 against 0.24
+// at p = 1 for N = 3000). Below about 10^4 bodies the SIMD direct sum is
+// faster at every order.
+//
+// The tree depth follows from N and the target leaf size. The tree is uniform,
+// so strongly clustered scenes are better served by BarnesHutGravity. In
+// planar mode the cube just gets flat, the expansions stay 3D.
+class FmmGravity : public ForceBackend
+{
+public:
+    explicit FmmGravity(int order = 4, int bodiesPerLeaf = 64, int threads = 1)
+    {
+        setOrder(order);
+        setLeafSize(bodiesPerLeaf);
+        setThreads(threads);
+    }
+
+    const char* name() const override { return "fmm"; }
+
+    static constexpr int MaxOrder = 12;
+    static constexpr int MaxTerms = (MaxOrder + 1) * (MaxOrder + 2) * (MaxOrder + 3) / 6;
+
+    int order() const { return p; }
+    void setOrder(int order);
+
+    int targetLeafSize() const { return leafSize; }
+    void setLeafSize(int n) { leafSize = n > 1 ? n : 1; }
+
+    // Depth of the last evaluation, leaves sit on this level
+    int depth() const { return levels; }
+
+    void accelerations(const BodyState& X, double G, double* ax, double* ay, double* az) override;
+    // the potential is the local expansion itself plus the P2P terms
+    void accelerationsWithPotential(const BodyState& X, double G, double* ax, double* ay, double* az,
+        double* pot) override;
+
+private:
+    int terms() const { return (int)mi.size(); }
+    int termIndex(int a, int b, int c) const { return lookup[(a * (p + 1) + b) * (p + 1) + c]; }
+
+    void bin(const BodyState& X);
+    void upwardPass();
+    void downwardPass();
+    void evaluate(double G, double* ax, double* ay, double* az, double* pot);
+
+    void derivatives(double x, double y, double z, double* T) const;
+    void monomials(double x, double y, double z, double* out) const;
+
+    // Cells of level l are numbered (iz * side + iy) * side + ix behind levelStart[l]
+    int cellIndex(int level, int ix, int iy, int iz) const
+    {
+        const int side = 1 << level;
+        return levelStart[level] + (iz * side + iy) * side + ix;
+    }
+    void cellCenter(int level, int ix, int iy, int iz, double& cx, double& cy, double& cz) const;
+
+    int p = 4;
+    int leafSize = 64;
+    int levels = 2;
+
+    // expansion terms, ordered by total degree
+    std::vector<std::array<int, 3>> mi;
+    std::vector<int> lookup;
+    std::vector<int> degree;
+
+    // flattened M2L and shift tables
+    struct M2LTerm { int l, k, kl; double coeff; };
+    std::vector<M2LTerm> m2l;
+    struct ShiftTerm { int to, from, power; double coeff; };
+    std::vector<ShiftTerm> m2m, l2l;
+
+    // tree
+    double rootX = 0.0, rootY = 0.0, rootZ = 0.0, rootHalf = 1.0;
+    std::vector<int> levelStart;
+    std::vector<double> multipole, local;
+    std::vector<int> cellCount;
+    std::vector<double> kernelTable;
+
+    // bodies sorted by leaf
+    std::vector<int> sorted, slots;
+    std::vector<int> leafStart;
+    std::vector<double> sx, sy, sz, sm;
+};
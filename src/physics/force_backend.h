@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vector>
+
+#include "body_state.h"
+#include "softening.h"
+#include "thread_pool.h"
+
+// Common interface of the acceleration solvers.
+// A backend fills ax/ay/az[0..N) for the bodies in X. The direct summation
+// is one of them, approximate solvers (trees, multipoles, meshes) plug in the
+// same way and are picked when the NbodySimulation is constructed.
+class ForceBackend
+{
+public:
+    virtual ~ForceBackend() = default;
+
+    virtual const char* name() const = 0;
+
+    virtual void accelerations(const BodyState& X, double G, double* ax, double* ay, double* az) = 0;
+
+    // The same accelerations plus pot[i] = sum_j G m_j phi(|x_j - x_i|), phi
+    // = -1 / r softened like the forces, for energy diagnostics. The solvers
+    // sum it in their force pass, the default here adds a direct O(N^2) sum.
+    virtual void accelerationsWithPotential(const BodyState& X, double G, double* ax, double* ay, double* az,
+        double* pot)
+    {
+        accelerations(X, G, ax, ay, az);
+        directPotential(X, G, softening, pot);
+    }
+
+    // pot[0..N) by direct summation
+    static void directPotential(const BodyState& X, double G, const Softening& soft, double* pot)
+    {
+        const int N = X.size();
+        for (int i = 0; i < N; ++i)
+            pot[i] = 0.0;
+        for (int i = 0; i < N; ++i) {
+            for (int j = i + 1; j < N; ++j) {
+                double dx = X.x[j] - X.x[i], dy = X.y[j] - X.y[i], dz = X.z[j] - X.z[i];
+                double r2 = dx * dx + dy * dy + dz * dz;
+                if (r2 == 0.0 && !soft.enabled())
+                    continue;
+                double phi = G * soft.potentialFactor(r2);
+                pot[i] += phi * X.mass[j];
+                pot[j] += phi * X.mass[i];
+            }
+        }
+    }
+
+    // Accelerations of the bodies targets[0..count) only, every body still acts
+    // as a source. ax[k] belongs to targets[k]. Used by block timestepping, the
+    // default evaluates everything and picks the targets out.
+    virtual void accelerationsFor(const BodyState& X, double G, const int* targets, int count,
+        double* ax, double* ay, double* az)
+    {
+        const size_t N = X.size();
+        scratchX.resize(N);
+        scratchY.resize(N);
+        scratchZ.resize(N);
+        accelerations(X, G, scratchX.data(), scratchY.data(), scratchZ.data());
+        for (int k = 0; k < count; ++k) {
+            ax[k] = scratchX[targets[k]];
+            ay[k] = scratchY[targets[k]];
+            az[k] = scratchZ[targets[k]];
+        }
+    }
+
+    // 2D mode: every z is zero, solvers may drop the third dimension
+    virtual void setPlanar(bool on) { planar = on; }
+    bool isPlanar() const { return planar; }
+
+    // Softening of the pair interactions. Approximate solvers soften what
+    // they sum pair by pair, their far field stays Newtonian.
+    void setSoftening(const Softening& s) { softening = s; }
+    const Softening& softeningOf() const { return softening; }
+
+    int threads() const { return pool.threads(); }
+    void setThreads(int n) { pool.setThreads(n); }
+
+protected:
+    ThreadPool pool;
+    bool planar = false;
+    Softening softening;
+
+private:
+    std::vector<double> scratchX, scratchY, scratchZ;
+};
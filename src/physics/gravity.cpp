@@ -0,0 +1,127 @@
+#include "gravity.h"
+
+#include <cmath>
+
+void DirectGravity::accelerationOf(const BodyState& X, double G, int i, double& ax, double& ay, double& az,
+    const Softening& soft, double* pot)
+{
+    const bool softened = soft.enabled();
+    const int N = X.size();
+    const double* x = X.x.data();
+    const double* y = X.y.data();
+    const double* z = X.z.data();
+    const double* m = X.mass.data();
+
+    double axi = 0.0, ayi = 0.0, azi = 0.0, phi = 0.0;
+    const double xi = x[i], yi = y[i], zi = z[i];
+
+    for (int j = 0; j < N; ++j)
+    {
+        if (j == i)
+            continue;
+        double dx = x[j] - xi;
+        double dy = y[j] - yi;
+        double dz = z[j] - zi;
+        double r_squared = dx * dx + dy * dy + dz * dz;
+        double s;
+        if (softened) {
+            s = G * m[j] * soft.forceFactor(r_squared);
+            if (pot)
+                phi += G * m[j] * soft.potentialFactor(r_squared);
+        }
+        else {
+            double inv_r = 1.0 / sqrt(r_squared);
+            s = G * m[j] * inv_r * inv_r * inv_r;
+            if (pot)
+                phi -= G * m[j] * inv_r;
+        }
+
+        axi += s * dx;
+        ayi += s * dy;
+        azi += s * dz;
+    }
+
+    ax = axi;
+    ay = ayi;
+    az = azi;
+    if (pot)
+        *pot = phi;
+}
+
+void DirectGravity::accelerationRows(const BodyState& X, double G, int begin, int end,
+    double* ax, double* ay, double* az, const Softening& soft, double* pot)
+{
+    for (int i = begin; i < end; ++i)
+        accelerationOf(X, G, i, ax[i], ay[i], az[i], soft, pot ? pot + i : nullptr);
+}
+
+void DirectGravity::accelerations(const BodyState& X, double G, double* ax, double* ay, double* az)
+{
+    evaluate(X, G, ax, ay, az, nullptr);
+}
+
+void DirectGravity::accelerationsWithPotential(const BodyState& X, double G, double* ax, double* ay, double* az,
+    double* pot)
+{
+    evaluate(X, G, ax, ay, az, pot);
+}
+
+void DirectGravity::evaluate(const BodyState& X, double G, double* ax, double* ay, double* az, double* pot)
+{
+    const int N = X.size();
+    const int blocks = (N + RowsPerBlock - 1) / RowsPerBlock;
+
+    if (mode == ForcePrecision::Mixed && softening.kind != SofteningKind::Spline) {
+        sources.load(X, G);
+        sources.eps2 = softening.enabled() ? (float)(softening.eps * softening.eps) : 0.0f;
+        auto task = [&](int b) {
+            int begin = b * RowsPerBlock;
+            int end = begin + RowsPerBlock < N ? begin + RowsPerBlock : N;
+            simdAccelerationRowsMixed(simd, sources, begin, end, ax, ay, az, pot);
+        };
+        pool.run(blocks, task);
+        return;
+    }
+
+    auto task = [&](int b) {
+        int begin = b * RowsPerBlock;
+        int end = begin + RowsPerBlock < N ? begin + RowsPerBlock : N;
+        simdAccelerationRows(simd, X, G, begin, end, ax, ay, az, softening, pot);
+    };
+    pool.run(blocks, task);
+}
+
+void DirectGravity::accelerationsFor(const BodyState& X, double G, const int* targets, int count,
+    double* ax, double* ay, double* az)
+{
+    const int blocks = (count + RowsPerBlock - 1) / RowsPerBlock;
+
+    // the targets are gathered into rows of their own, then go through the same kernels as a full pass
+    if (mode == ForcePrecision::Mixed && softening.kind != SofteningKind::Spline) {
+        sources.load(X, G);
+        sources.eps2 = softening.enabled() ? (float)(softening.eps * softening.eps) : 0.0f;
+        gathered.loadTargets(X, G, sources, targets, count);
+        auto task = [&](int b) {
+            int begin = b * RowsPerBlock;
+            int end = begin + RowsPerBlock < count ? begin + RowsPerBlock : count;
+            simdAccelerationTargetsMixed(simd, sources, gathered, targets, begin, end, ax, ay, az);
+        };
+        pool.run(blocks, task);
+        return;
+    }
+
+    rows.resize(count);
+    for (int k = 0; k < count; ++k) {
+        const int i = targets[k];
+        rows.x[k] = X.x[i];
+        rows.y[k] = X.y[i];
+        rows.z[k] = X.z[i];
+        rows.mass[k] = X.mass[i];
+    }
+    auto task = [&](int b) {
+        int begin = b * RowsPerBlock;
+        int end = begin + RowsPerBlock < count ? begin + RowsPerBlock : count;
+        simdAccelerationTargets(simd, X, rows, targets, G, begin, end, ax, ay, az, softening);
+    };
+    pool.run(blocks, task);
+}
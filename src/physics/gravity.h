@@ -0,0 +1,65 @@
+#pragma once
+
+#include "body_state.h"
+#include "force_backend.h"
+#include "gravity_simd.h"
+
+// Double: every pair term in double. Mixed: pair terms in float, sums in
+// double (simdAccelerationRowsMixed), about twice the throughput for ~1e-7
+// relative force error.
+enum class ForcePrecision { Double, Mixed };
+
+// Direct O(N^2) summation of gravitational accelerations
+//   a_i = sum_{j != i} G m_j (x_j - x_i) / |x_j - x_i|^3
+//
+// Work is split into contiguous row blocks of i. Every thread only writes the
+// accelerations of its own rows and every row sums j in the same order, so the
+// result is bit-identical for any thread count.
+// Rows go through the vectorized kernel of the best SIMD level found at
+// startup, SimdLevel::Scalar selects the plain reference loop. The targets of
+// accelerationsFor() are gathered into rows of their own and go through the
+// same kernels and precision. With spline softening Mixed falls back to Double.
+class DirectGravity : public ForceBackend
+{
+public:
+    explicit DirectGravity(int threads = 1) { setThreads(threads); }
+
+    const char* name() const override { return "direct"; }
+
+    SimdLevel simdLevel() const { return simd; }
+    // Levels above what the CPU supports are clamped to the detected one
+    void setSimdLevel(SimdLevel level) { simd = level < detectSimdLevel() ? level : detectSimdLevel(); }
+
+    ForcePrecision precision() const { return mode; }
+    void setPrecision(ForcePrecision p) { mode = p; }
+
+    // Rows handed to one task, small systems stay on the calling thread
+    static constexpr int RowsPerBlock = 64;
+
+    // Fills ax/ay/az[0..N) for the bodies in X
+    void accelerations(const BodyState& X, double G, double* ax, double* ay, double* az) override;
+    void accelerationsWithPotential(const BodyState& X, double G, double* ax, double* ay, double* az,
+        double* pot) override;
+
+    // Gathers the targets, then row blocks like accelerations()
+    void accelerationsFor(const BodyState& X, double G, const int* targets, int count,
+        double* ax, double* ay, double* az) override;
+
+    // Acceleration of body i on the calling thread, and its potential into *pot if given
+    static void accelerationOf(const BodyState& X, double G, int i, double& ax, double& ay, double& az,
+        const Softening& soft = Softening(), double* pot = nullptr);
+
+    // Rows [begin, end) on the calling thread, also the scalar reference for other kernels
+    static void accelerationRows(const BodyState& X, double G, int begin, int end,
+        double* ax, double* ay, double* az, const Softening& soft = Softening(), double* pot = nullptr);
+
+private:
+    void evaluate(const BodyState& X, double G, double* ax, double* ay, double* az, double* pot);
+
+    SimdLevel simd = detectSimdLevel();
+    ForcePrecision mode = ForcePrecision::Double;
+    FloatSources sources;
+    // gathered targets of accelerationsFor(), kept so a warm step does not allocate
+    BodyState rows;
+    FloatSources gathered;
+};
@@ -0,0 +1,749 @@
+#include "gravity_simd.h"
+#include "gravity.h"
+
+#include <cmath>
+
+#include "simd_target.h"
+
+namespace {
+
+// Reference of the mixed kernels and their tail rows. The body itself is
+// skipped by index, a distinct body at the same place still counts when
+// softened, as in the SIMD lanes, which mask out r2 = 0 only.
+template <bool Potential>
+void mixedScalar(const FloatSources& S, const FloatSources& T, const int* index, int begin, int end,
+    double* ax, double* ay, double* az, double* pot)
+{
+    const int N = S.x.size();
+    for (int i = begin; i < end; ++i)
+    {
+        const float xi = T.x[i], yi = T.y[i], zi = T.z[i];
+        const int self = index ? index[i] : i;
+        double axi = 0.0, ayi = 0.0, azi = 0.0, phi = 0.0;
+        for (int t = 0; t < N; t += MixedTile)
+        {
+            const int tileEnd = t + MixedTile < N ? t + MixedTile : N;
+            float fx = 0.0f, fy = 0.0f, fz = 0.0f, fp = 0.0f;
+            for (int j = t; j < tileEnd; ++j)
+            {
+                if (j == self)
+                    continue;
+                float dx = S.x[j] - xi, dy = S.y[j] - yi, dz = S.z[j] - zi;
+                float r2 = dx * dx + dy * dy + dz * dz + S.eps2;
+                if (r2 == 0.0f)
+                    continue;
+                float inv = 1.0f / sqrtf(r2);
+                float s = S.gm[j] * inv * inv * inv;
+                fx += s * dx; fy += s * dy; fz += s * dz;
+                if constexpr (Potential)
+                    fp -= S.gm[j] * inv;
+            }
+            axi += fx; ayi += fy; azi += fz; phi += fp;
+        }
+        ax[i] = axi;
+        ay[i] = ayi;
+        az[i] = azi;
+        if constexpr (Potential)
+            pot[i] = phi;
+    }
+}
+
+#if defined(NBODY_X86)
+
+// Plummer softening is r^2 + eps^2 in every kernel, 0 adds nothing
+double plummerEps2(const Softening& soft)
+{
+    return soft.enabled() && soft.kind == SofteningKind::Plummer ? soft.eps * soft.eps : 0.0;
+}
+
+// Scalar target rows [begin, end), the tails of the double kernels: rows of X,
+// or with an index the bodies index[k] of X the targets were gathered from
+void tailRows(const BodyState& X, const int* index, double G, const Softening& soft,
+    int begin, int end, double* ax, double* ay, double* az, double* pot)
+{
+    if (!index) {
+        DirectGravity::accelerationRows(X, G, begin, end, ax, ay, az, soft, pot);
+        return;
+    }
+    for (int k = begin; k < end; ++k)
+        DirectGravity::accelerationOf(X, G, index[k], ax[k], ay[k], az[k], soft, pot ? pot + k : nullptr);
+}
+
+// Softening::forceFactor() of the cubic spline from r^2, 1 / r and 1 / r^3,
+// lanes at or beyond the support keep 1 / r^3
+TARGET_SSE2
+inline __m128d splineSSE2(__m128d r2, __m128d inv, __m128d inv3, __m128d invH, __m128d invH3)
+{
+    const __m128d u = _mm_mul_pd(_mm_mul_pd(r2, inv), invH);
+    const __m128d inner = _mm_mul_pd(invH3, _mm_add_pd(_mm_set1_pd(10.666666666667),
+        _mm_mul_pd(_mm_mul_pd(u, u), _mm_sub_pd(_mm_mul_pd(_mm_set1_pd(32.0), u), _mm_set1_pd(38.4)))));
+    const __m128d outer = _mm_sub_pd(_mm_mul_pd(invH3, _mm_add_pd(_mm_set1_pd(21.333333333333),
+        _mm_mul_pd(u, _mm_add_pd(_mm_set1_pd(-48.0), _mm_mul_pd(u, _mm_sub_pd(_mm_set1_pd(38.4), _mm_mul_pd(_mm_set1_pd(10.666666666667), u))))))),
+        _mm_mul_pd(_mm_set1_pd(0.066666666667), inv3));
+    const __m128d isOuter = _mm_cmplt_pd(u, _mm_set1_pd(1.0));
+    const __m128d isInner = _mm_cmplt_pd(u, _mm_set1_pd(0.5));
+    __m128d f = _mm_or_pd(_mm_and_pd(isOuter, outer), _mm_andnot_pd(isOuter, inv3));
+    return _mm_or_pd(_mm_and_pd(isInner, inner), _mm_andnot_pd(isInner, f));
+}
+
+// -Softening::potentialFactor() of the cubic spline, 1 / r beyond the support
+TARGET_SSE2
+inline __m128d splinePotentialSSE2(__m128d r2, __m128d inv, __m128d invH)
+{
+    const __m128d u = _mm_mul_pd(_mm_mul_pd(r2, inv), invH);
+    const __m128d u2 = _mm_mul_pd(u, u);
+    const __m128d inner = _mm_mul_pd(invH, _mm_sub_pd(_mm_set1_pd(2.8), _mm_mul_pd(u2, _mm_add_pd(_mm_set1_pd(5.333333333333),
+        _mm_mul_pd(u2, _mm_sub_pd(_mm_mul_pd(_mm_set1_pd(6.4), u), _mm_set1_pd(9.6)))))));
+    const __m128d outer = _mm_sub_pd(_mm_mul_pd(invH, _mm_sub_pd(_mm_set1_pd(3.2), _mm_mul_pd(u2, _mm_add_pd(_mm_set1_pd(10.666666666667),
+        _mm_mul_pd(u, _mm_add_pd(_mm_set1_pd(-16.0), _mm_mul_pd(u, _mm_sub_pd(_mm_set1_pd(9.6), _mm_mul_pd(_mm_set1_pd(2.133333333333), u))))))))),
+        _mm_mul_pd(_mm_set1_pd(0.066666666667), inv));
+    const __m128d isOuter = _mm_cmplt_pd(u, _mm_set1_pd(1.0));
+    const __m128d isInner = _mm_cmplt_pd(u, _mm_set1_pd(0.5));
+    __m128d psi = _mm_or_pd(_mm_and_pd(isOuter, outer), _mm_andnot_pd(isOuter, inv));
+    return _mm_or_pd(_mm_and_pd(isInner, inner), _mm_andnot_pd(isInner, psi));
+}
+
+template <bool Spline, bool Potential>
+TARGET_SSE2
+void rowsSSE2(const BodyState& X, const BodyState& T, const int* index, double G, const Softening& soft,
+    int begin, int end,
+    double* ax, double* ay, double* az, double* pot)
+{
+    const int N = X.size();
+    const double* x = X.x.data();
+    const double* y = X.y.data();
+    const double* z = X.z.data();
+    const double* m = X.mass.data();
+    const double* tx = T.x.data();
+    const double* ty = T.y.data();
+    const double* tz = T.z.data();
+    const double* tm = T.mass.data();
+    const __m128d one = _mm_set1_pd(1.0);
+    const __m128d zero = _mm_setzero_pd();
+    const __m128d eps2 = _mm_set1_pd(plummerEps2(soft));
+    const __m128d invH = _mm_set1_pd(Spline ? 1.0 / soft.support() : 0.0);
+    const __m128d invH3 = _mm_mul_pd(invH, _mm_mul_pd(invH, invH));
+    const __m128d selfPhi = _mm_set1_pd(soft.enabled() ? soft.potentialFactor(0.0) : 0.0);
+
+    int i = begin;
+    for (; i + 2 <= end; i += 2)
+    {
+        __m128d xi = _mm_loadu_pd(tx + i), yi = _mm_loadu_pd(ty + i), zi = _mm_loadu_pd(tz + i);
+        __m128d axi = zero, ayi = zero, azi = zero, phi = zero;
+
+        for (int j = 0; j < N; ++j)
+        {
+            __m128d dx = _mm_sub_pd(_mm_set1_pd(x[j]), xi);
+            __m128d dy = _mm_sub_pd(_mm_set1_pd(y[j]), yi);
+            __m128d dz = _mm_sub_pd(_mm_set1_pd(z[j]), zi);
+            __m128d r2 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)), _mm_mul_pd(dz, dz));
+            r2 = _mm_add_pd(r2, eps2);
+
+            // no rsqrt estimate: it only comes in float, whose range r2 can leave
+            __m128d inv = _mm_div_pd(one, _mm_sqrt_pd(r2));
+            inv = _mm_and_pd(inv, _mm_cmpgt_pd(r2, zero));
+
+            __m128d f = _mm_mul_pd(inv, _mm_mul_pd(inv, inv));
+            if constexpr (Spline)
+                f = splineSSE2(r2, inv, f, invH, invH3);
+            __m128d s = _mm_mul_pd(_mm_set1_pd(G * m[j]), f);
+            axi = _mm_add_pd(axi, _mm_mul_pd(s, dx));
+            ayi = _mm_add_pd(ayi, _mm_mul_pd(s, dy));
+            azi = _mm_add_pd(azi, _mm_mul_pd(s, dz));
+            if constexpr (Potential) {
+                __m128d psi = inv;
+                if constexpr (Spline)
+                    psi = splinePotentialSSE2(r2, inv, invH);
+                phi = _mm_sub_pd(phi, _mm_mul_pd(_mm_set1_pd(G * m[j]), psi));
+            }
+        }
+
+        _mm_storeu_pd(ax + i, axi);
+        _mm_storeu_pd(ay + i, ayi);
+        _mm_storeu_pd(az + i, azi);
+        if constexpr (Potential) {
+            // softened, the body itself was one of the sources
+            phi = _mm_sub_pd(phi, _mm_mul_pd(_mm_mul_pd(_mm_set1_pd(G), _mm_loadu_pd(tm + i)), selfPhi));
+            _mm_storeu_pd(pot + i, phi);
+        }
+    }
+
+    tailRows(X, index, G, soft, i, end, ax, ay, az, pot);
+}
+
+TARGET_AVX2
+inline __m256d splineAVX2(__m256d r2, __m256d inv, __m256d inv3, __m256d invH, __m256d invH3)
+{
+    const __m256d u = _mm256_mul_pd(_mm256_mul_pd(r2, inv), invH);
+    const __m256d inner = _mm256_mul_pd(invH3, _mm256_fmadd_pd(_mm256_mul_pd(u, u),
+        _mm256_fmsub_pd(_mm256_set1_pd(32.0), u, _mm256_set1_pd(38.4)), _mm256_set1_pd(10.666666666667)));
+    const __m256d outer = _mm256_fnmadd_pd(_mm256_set1_pd(0.066666666667), inv3, _mm256_mul_pd(invH3,
+        _mm256_fmadd_pd(u, _mm256_fmadd_pd(u, _mm256_fnmadd_pd(_mm256_set1_pd(10.666666666667), u, _mm256_set1_pd(38.4)), _mm256_set1_pd(-48.0)),
+            _mm256_set1_pd(21.333333333333))));
+    __m256d f = _mm256_blendv_pd(inv3, outer, _mm256_cmp_pd(u, _mm256_set1_pd(1.0), _CMP_LT_OQ));
+    return _mm256_blendv_pd(f, inner, _mm256_cmp_pd(u, _mm256_set1_pd(0.5), _CMP_LT_OQ));
+}
+
+TARGET_AVX2
+inline __m256d splinePotentialAVX2(__m256d r2, __m256d inv, __m256d invH)
+{
+    const __m256d u = _mm256_mul_pd(_mm256_mul_pd(r2, inv), invH);
+    const __m256d u2 = _mm256_mul_pd(u, u);
+    const __m256d inner = _mm256_mul_pd(invH, _mm256_fnmadd_pd(u2, _mm256_fmadd_pd(u2,
+        _mm256_fmsub_pd(_mm256_set1_pd(6.4), u, _mm256_set1_pd(9.6)), _mm256_set1_pd(5.333333333333)), _mm256_set1_pd(2.8)));
+    const __m256d outer = _mm256_fnmadd_pd(_mm256_set1_pd(0.066666666667), inv, _mm256_mul_pd(invH, _mm256_fnmadd_pd(u2,
+        _mm256_fmadd_pd(u, _mm256_fmadd_pd(u, _mm256_fnmadd_pd(_mm256_set1_pd(2.133333333333), u, _mm256_set1_pd(9.6)), _mm256_set1_pd(-16.0)),
+            _mm256_set1_pd(10.666666666667)), _mm256_set1_pd(3.2))));
+    __m256d psi = _mm256_blendv_pd(inv, outer, _mm256_cmp_pd(u, _mm256_set1_pd(1.0), _CMP_LT_OQ));
+    return _mm256_blendv_pd(psi, inner, _mm256_cmp_pd(u, _mm256_set1_pd(0.5), _CMP_LT_OQ));
+}
+
+template <bool Spline, bool Potential>
+TARGET_AVX2
+void rowsAVX2(const BodyState& X, const BodyState& T, const int* index, double G, const Softening& soft,
+    int begin, int end,
+    double* ax, double* ay, double* az, double* pot)
+{
+    const int N = X.size();
+    const double* x = X.x.data();
+    const double* y = X.y.data();
+    const double* z = X.z.data();
+    const double* m = X.mass.data();
+    const double* tx = T.x.data();
+    const double* ty = T.y.data();
+    const double* tz = T.z.data();
+    const double* tm = T.mass.data();
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d eps2 = _mm256_set1_pd(plummerEps2(soft));
+    const __m256d invH = _mm256_set1_pd(Spline ? 1.0 / soft.support() : 0.0);
+    const __m256d invH3 = _mm256_mul_pd(invH, _mm256_mul_pd(invH, invH));
+    const __m256d selfPhi = _mm256_set1_pd(soft.enabled() ? soft.potentialFactor(0.0) : 0.0);
+
+    int i = begin;
+    for (; i + 4 <= end; i += 4)
+    {
+        __m256d xi = _mm256_loadu_pd(tx + i), yi = _mm256_loadu_pd(ty + i), zi = _mm256_loadu_pd(tz + i);
+        __m256d axi = zero, ayi = zero, azi = zero, phi = zero;
+
+        for (int j = 0; j < N; ++j)
+        {
+            __m256d dx = _mm256_sub_pd(_mm256_set1_pd(x[j]), xi);
+            __m256d dy = _mm256_sub_pd(_mm256_set1_pd(y[j]), yi);
+            __m256d dz = _mm256_sub_pd(_mm256_set1_pd(z[j]), zi);
+            __m256d r2 = _mm256_fmadd_pd(dx, dx, _mm256_fmadd_pd(dy, dy, _mm256_mul_pd(dz, dz)));
+            r2 = _mm256_add_pd(r2, eps2);
+
+            // no rsqrt estimate: it only comes in float, whose range r2 can leave
+            __m256d inv = _mm256_div_pd(one, _mm256_sqrt_pd(r2));
+            inv = _mm256_and_pd(inv, _mm256_cmp_pd(r2, zero, _CMP_GT_OQ));
+
+            __m256d f = _mm256_mul_pd(inv, _mm256_mul_pd(inv, inv));
+            if constexpr (Spline)
+                f = splineAVX2(r2, inv, f, invH, invH3);
+            __m256d s = _mm256_mul_pd(_mm256_set1_pd(G * m[j]), f);
+            axi = _mm256_fmadd_pd(s, dx, axi);
+            ayi = _mm256_fmadd_pd(s, dy, ayi);
+            azi = _mm256_fmadd_pd(s, dz, azi);
+            if constexpr (Potential) {
+                __m256d psi = inv;
+                if constexpr (Spline)
+                    psi = splinePotentialAVX2(r2, inv, invH);
+                phi = _mm256_sub_pd(phi, _mm256_mul_pd(_mm256_set1_pd(G * m[j]), psi));
+            }
+        }
+
+        _mm256_storeu_pd(ax + i, axi);
+        _mm256_storeu_pd(ay + i, ayi);
+        _mm256_storeu_pd(az + i, azi);
+        if constexpr (Potential) {
+            // softened, the body itself was one of the sources
+            phi = _mm256_sub_pd(phi, _mm256_mul_pd(_mm256_mul_pd(_mm256_set1_pd(G), _mm256_loadu_pd(tm + i)), selfPhi));
+            _mm256_storeu_pd(pot + i, phi);
+        }
+    }
+
+    rowsSSE2<Spline, Potential>(X, T, index, G, soft, i, end, ax, ay, az, pot);
+}
+
+TARGET_AVX512
+inline __m512d splineAVX512(__m512d r2, __m512d inv, __m512d inv3, __m512d invH, __m512d invH3)
+{
+    const __m512d u = _mm512_mul_pd(_mm512_mul_pd(r2, inv), invH);
+    const __m512d inner = _mm512_mul_pd(invH3, _mm512_fmadd_pd(_mm512_mul_pd(u, u),
+        _mm512_fmsub_pd(_mm512_set1_pd(32.0), u, _mm512_set1_pd(38.4)), _mm512_set1_pd(10.666666666667)));
+    const __m512d outer = _mm512_fnmadd_pd(_mm512_set1_pd(0.066666666667), inv3, _mm512_mul_pd(invH3,
+        _mm512_fmadd_pd(u, _mm512_fmadd_pd(u, _mm512_fnmadd_pd(_mm512_set1_pd(10.666666666667), u, _mm512_set1_pd(38.4)), _mm512_set1_pd(-48.0)),
+            _mm512_set1_pd(21.333333333333))));
+    __m512d f = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(u, _mm512_set1_pd(1.0), _CMP_LT_OQ), inv3, outer);
+    return _mm512_mask_blend_pd(_mm512_cmp_pd_mask(u, _mm512_set1_pd(0.5), _CMP_LT_OQ), f, inner);
+}
+
+TARGET_AVX512
+inline __m512d splinePotentialAVX512(__m512d r2, __m512d inv, __m512d invH)
+{
+    const __m512d u = _mm512_mul_pd(_mm512_mul_pd(r2, inv), invH);
+    const __m512d u2 = _mm512_mul_pd(u, u);
+    const __m512d inner = _mm512_mul_pd(invH, _mm512_fnmadd_pd(u2, _mm512_fmadd_pd(u2,
+        _mm512_fmsub_pd(_mm512_set1_pd(6.4), u, _mm512_set1_pd(9.6)), _mm512_set1_pd(5.333333333333)), _mm512_set1_pd(2.8)));
+    const __m512d outer = _mm512_fnmadd_pd(_mm512_set1_pd(0.066666666667), inv, _mm512_mul_pd(invH, _mm512_fnmadd_pd(u2,
+        _mm512_fmadd_pd(u, _mm512_fmadd_pd(u, _mm512_fnmadd_pd(_mm512_set1_pd(2.133333333333), u, _mm512_set1_pd(9.6)), _mm512_set1_pd(-16.0)),
+            _mm512_set1_pd(10.666666666667)), _mm512_set1_pd(3.2))));
+    __m512d psi = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(u, _mm512_set1_pd(1.0), _CMP_LT_OQ), inv, outer);
+    return _mm512_mask_blend_pd(_mm512_cmp_pd_mask(u, _mm512_set1_pd(0.5), _CMP_LT_OQ), psi, inner);
+}
+
+template <bool Spline, bool Potential>
+TARGET_AVX512
+void rowsAVX512(const BodyState& X, const BodyState& T, const int* index, double G, const Softening& soft,
+    int begin, int end,
+    double* ax, double* ay, double* az, double* pot)
+{
+    const int N = X.size();
+    const double* x = X.x.data();
+    const double* y = X.y.data();
+    const double* z = X.z.data();
+    const double* m = X.mass.data();
+    const double* tx = T.x.data();
+    const double* ty = T.y.data();
+    const double* tz = T.z.data();
+    const double* tm = T.mass.data();
+    const __m512d half = _mm512_set1_pd(0.5);
+    const __m512d threeHalves = _mm512_set1_pd(1.5);
+    const __m512d zero = _mm512_setzero_pd();
+    const __m512d eps2 = _mm512_set1_pd(plummerEps2(soft));
+    const __m512d invH = _mm512_set1_pd(Spline ? 1.0 / soft.support() : 0.0);
+    const __m512d invH3 = _mm512_mul_pd(invH, _mm512_mul_pd(invH, invH));
+    const __m512d selfPhi = _mm512_set1_pd(soft.enabled() ? soft.potentialFactor(0.0) : 0.0);
+
+    int i = begin;
+    for (; i + 8 <= end; i += 8)
+    {
+        __m512d xi = _mm512_loadu_pd(tx + i), yi = _mm512_loadu_pd(ty + i), zi = _mm512_loadu_pd(tz + i);
+        __m512d axi = zero, ayi = zero, azi = zero, phi = zero;
+
+        for (int j = 0; j < N; ++j)
+        {
+            __m512d dx = _mm512_sub_pd(_mm512_set1_pd(x[j]), xi);
+            __m512d dy = _mm512_sub_pd(_mm512_set1_pd(y[j]), yi);
+            __m512d dz = _mm512_sub_pd(_mm512_set1_pd(z[j]), zi);
+            __m512d r2 = _mm512_fmadd_pd(dx, dx, _mm512_fmadd_pd(dy, dy, _mm512_mul_pd(dz, dz)));
+            r2 = _mm512_add_pd(r2, eps2);
+
+            __mmask8 valid = _mm512_cmp_pd_mask(r2, zero, _CMP_GT_OQ);
+            __m512d inv = _mm512_maskz_rsqrt14_pd(valid, r2);
+            __m512d hr2 = _mm512_mul_pd(half, r2);
+            inv = _mm512_mul_pd(inv, _mm512_fnmadd_pd(hr2, _mm512_mul_pd(inv, inv), threeHalves));
+            inv = _mm512_mul_pd(inv, _mm512_fnmadd_pd(hr2, _mm512_mul_pd(inv, inv), threeHalves));
+
+            __m512d f = _mm512_mul_pd(inv, _mm512_mul_pd(inv, inv));
+            if constexpr (Spline)
+                f = splineAVX512(r2, inv, f, invH, invH3);
+            __m512d s = _mm512_mul_pd(_mm512_set1_pd(G * m[j]), f);
+            axi = _mm512_fmadd_pd(s, dx, axi);
+            ayi = _mm512_fmadd_pd(s, dy, ayi);
+            azi = _mm512_fmadd_pd(s, dz, azi);
+            if constexpr (Potential) {
+                __m512d psi = inv;
+                if constexpr (Spline)
+                    psi = splinePotentialAVX512(r2, inv, invH);
+                phi = _mm512_sub_pd(phi, _mm512_mul_pd(_mm512_set1_pd(G * m[j]), psi));
+            }
+        }
+
+        _mm512_storeu_pd(ax + i, axi);
+        _mm512_storeu_pd(ay + i, ayi);
+        _mm512_storeu_pd(az + i, azi);
+        if constexpr (Potential) {
+            // softened, the body itself was one of the sources
+            phi = _mm512_sub_pd(phi, _mm512_mul_pd(_mm512_mul_pd(_mm512_set1_pd(G), _mm512_loadu_pd(tm + i)), selfPhi));
+            _mm512_storeu_pd(pot + i, phi);
+        }
+    }
+
+    rowsAVX2<Spline, Potential>(X, T, index, G, soft, i, end, ax, ay, az, pot);
+}
+
+// The double rows of one level, false for Scalar
+template <bool Spline, bool Potential>
+bool rowsAt(SimdLevel level, const BodyState& X, const BodyState& T, const int* index, double G, const Softening& soft,
+    int begin, int end,
+    double* ax, double* ay, double* az, double* pot)
+{
+    switch (level) {
+    case SimdLevel::AVX512: rowsAVX512<Spline, Potential>(X, T, index, G, soft, begin, end, ax, ay, az, pot); return true;
+    case SimdLevel::AVX2: rowsAVX2<Spline, Potential>(X, T, index, G, soft, begin, end, ax, ay, az, pot); return true;
+    case SimdLevel::SSE2: rowsSSE2<Spline, Potential>(X, T, index, G, soft, begin, end, ax, ay, az, pot); return true;
+    default: return false;
+    }
+}
+
+template <bool Potential>
+TARGET_SSE2
+void mixedSSE2(const FloatSources& S, const FloatSources& T, const int* index, int begin, int end,
+    double* ax, double* ay, double* az, double* pot)
+{
+    const int N = S.x.size();
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 threeHalves = _mm_set1_ps(1.5f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 eps2 = _mm_set1_ps(S.eps2);
+    // softened, a body is one of its own sources at distance eps
+    const __m128d selfInv = _mm_set1_pd(S.eps2 > 0.0f ? 1.0 / std::sqrt((double)S.eps2) : 0.0);
+
+    int i = begin;
+    for (; i + 4 <= end; i += 4)
+    {
+        __m128 xi = _mm_loadu_ps(T.x.data() + i), yi = _mm_loadu_ps(T.y.data() + i), zi = _mm_loadu_ps(T.z.data() + i);
+        // lanes 0-1 and 2-3 of the float sums
+        __m128d axLo = _mm_setzero_pd(), ayLo = axLo, azLo = axLo, axHi = axLo, ayHi = axLo, azHi = axLo;
+        __m128d phLo = axLo, phHi = axLo;
+
+        for (int t = 0; t < N; t += MixedTile)
+        {
+            const int tileEnd = t + MixedTile < N ? t + MixedTile : N;
+            __m128 fx = zero, fy = zero, fz = zero, fp = zero;
+            for (int j = t; j < tileEnd; ++j)
+            {
+                __m128 dx = _mm_sub_ps(_mm_set1_ps(S.x[j]), xi);
+                __m128 dy = _mm_sub_ps(_mm_set1_ps(S.y[j]), yi);
+                __m128 dz = _mm_sub_ps(_mm_set1_ps(S.z[j]), zi);
+                __m128 r2 = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)), eps2);
+
+                __m128 inv = _mm_rsqrt_ps(r2);
+                inv = _mm_mul_ps(inv, _mm_sub_ps(threeHalves, _mm_mul_ps(_mm_mul_ps(half, r2), _mm_mul_ps(inv, inv))));
+                inv = _mm_and_ps(inv, _mm_cmpgt_ps(r2, zero));
+
+                __m128 s = _mm_mul_ps(_mm_set1_ps(S.gm[j]), _mm_mul_ps(inv, _mm_mul_ps(inv, inv)));
+                fx = _mm_add_ps(fx, _mm_mul_ps(s, dx));
+                fy = _mm_add_ps(fy, _mm_mul_ps(s, dy));
+                fz = _mm_add_ps(fz, _mm_mul_ps(s, dz));
+                if constexpr (Potential)
+                    fp = _mm_sub_ps(fp, _mm_mul_ps(_mm_set1_ps(S.gm[j]), inv));
+            }
+            axLo = _mm_add_pd(axLo, _mm_cvtps_pd(fx)); axHi = _mm_add_pd(axHi, _mm_cvtps_pd(_mm_movehl_ps(fx, fx)));
+            ayLo = _mm_add_pd(ayLo, _mm_cvtps_pd(fy)); ayHi = _mm_add_pd(ayHi, _mm_cvtps_pd(_mm_movehl_ps(fy, fy)));
+            azLo = _mm_add_pd(azLo, _mm_cvtps_pd(fz)); azHi = _mm_add_pd(azHi, _mm_cvtps_pd(_mm_movehl_ps(fz, fz)));
+            if constexpr (Potential) {
+                phLo = _mm_add_pd(phLo, _mm_cvtps_pd(fp)); phHi = _mm_add_pd(phHi, _mm_cvtps_pd(_mm_movehl_ps(fp, fp)));
+            }
+        }
+
+        _mm_storeu_pd(ax + i, axLo); _mm_storeu_pd(ax + i + 2, axHi);
+        _mm_storeu_pd(ay + i, ayLo); _mm_storeu_pd(ay + i + 2, ayHi);
+        _mm_storeu_pd(az + i, azLo); _mm_storeu_pd(az + i + 2, azHi);
+        if constexpr (Potential) {
+            const __m128 gm = _mm_loadu_ps(T.gm.data() + i);
+            phLo = _mm_add_pd(phLo, _mm_mul_pd(_mm_cvtps_pd(gm), selfInv));
+            phHi = _mm_add_pd(phHi, _mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(gm, gm)), selfInv));
+            _mm_storeu_pd(pot + i, phLo); _mm_storeu_pd(pot + i + 2, phHi);
+        }
+    }
+
+    mixedScalar<Potential>(S, T, index, i, end, ax, ay, az, pot);
+}
+
+template <bool Potential>
+TARGET_AVX2
+void mixedAVX2(const FloatSources& S, const FloatSources& T, const int* index, int begin, int end,
+    double* ax, double* ay, double* az, double* pot)
+{
+    const int N = S.x.size();
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 threeHalves = _mm256_set1_ps(1.5f);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 eps2 = _mm256_set1_ps(S.eps2);
+    const __m256d selfInv = _mm256_set1_pd(S.eps2 > 0.0f ? 1.0 / std::sqrt((double)S.eps2) : 0.0);
+
+    int i = begin;
+    for (; i + 8 <= end; i += 8)
+    {
+        __m256 xi = _mm256_loadu_ps(T.x.data() + i), yi = _mm256_loadu_ps(T.y.data() + i), zi = _mm256_loadu_ps(T.z.data() + i);
+        __m256d axLo = _mm256_setzero_pd(), ayLo = axLo, azLo = axLo, axHi = axLo, ayHi = axLo, azHi = axLo;
+        __m256d phLo = axLo, phHi = axLo;
+
+        for (int t = 0; t < N; t += MixedTile)
+        {
+            const int tileEnd = t + MixedTile < N ? t + MixedTile : N;
+            __m256 fx = zero, fy = zero, fz = zero, fp = zero;
+            for (int j = t; j < tileEnd; ++j)
+            {
+                __m256 dx = _mm256_sub_ps(_mm256_set1_ps(S.x[j]), xi);
+                __m256 dy = _mm256_sub_ps(_mm256_set1_ps(S.y[j]), yi);
+                __m256 dz = _mm256_sub_ps(_mm256_set1_ps(S.z[j]), zi);
+                __m256 r2 = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, _mm256_fmadd_ps(dz, dz, eps2)));
+
+                __m256 inv = _mm256_rsqrt_ps(r2);
+                inv = _mm256_mul_ps(inv, _mm256_fnmadd_ps(_mm256_mul_ps(half, r2), _mm256_mul_ps(inv, inv), threeHalves));
+                inv = _mm256_and_ps(inv, _mm256_cmp_ps(r2, zero, _CMP_GT_OQ));
+
+                __m256 s = _mm256_mul_ps(_mm256_set1_ps(S.gm[j]), _mm256_mul_ps(inv, _mm256_mul_ps(inv, inv)));
+                fx = _mm256_fmadd_ps(s, dx, fx);
+                fy = _mm256_fmadd_ps(s, dy, fy);
+                fz = _mm256_fmadd_ps(s, dz, fz);
+                if constexpr (Potential)
+                    fp = _mm256_fnmadd_ps(_mm256_set1_ps(S.gm[j]), inv, fp);
+            }
+            axLo = _mm256_add_pd(axLo, _mm256_cvtps_pd(_mm256_castps256_ps128(fx)));
+            axHi = _mm256_add_pd(axHi, _mm256_cvtps_pd(_mm256_extractf128_ps(fx, 1)));
+            ayLo = _mm256_add_pd(ayLo, _mm256_cvtps_pd(_mm256_castps256_ps128(fy)));
+            ayHi = _mm256_add_pd(ayHi, _mm256_cvtps_pd(_mm256_extractf128_ps(fy, 1)));
+            azLo = _mm256_add_pd(azLo, _mm256_cvtps_pd(_mm256_castps256_ps128(fz)));
+            azHi = _mm256_add_pd(azHi, _mm256_cvtps_pd(_mm256_extractf128_ps(fz, 1)));
+            if constexpr (Potential) {
+                phLo = _mm256_add_pd(phLo, _mm256_cvtps_pd(_mm256_castps256_ps128(fp)));
+                phHi = _mm256_add_pd(phHi, _mm256_cvtps_pd(_mm256_extractf128_ps(fp, 1)));
+            }
+        }
+
+        _mm256_storeu_pd(ax + i, axLo); _mm256_storeu_pd(ax + i + 4, axHi);
+        _mm256_storeu_pd(ay + i, ayLo); _mm256_storeu_pd(ay + i + 4, ayHi);
+        _mm256_storeu_pd(az + i, azLo); _mm256_storeu_pd(az + i + 4, azHi);
+        if constexpr (Potential) {
+            phLo = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm_loadu_ps(T.gm.data() + i)), selfInv, phLo);
+            phHi = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm_loadu_ps(T.gm.data() + i + 4)), selfInv, phHi);
+            _mm256_storeu_pd(pot + i, phLo); _mm256_storeu_pd(pot + i + 4, phHi);
+        }
+    }
+
+    mixedSSE2<Potential>(S, T, index, i, end, ax, ay, az, pot);
+}
+
+template <bool Potential>
+TARGET_AVX512
+void mixedAVX512(const FloatSources& S, const FloatSources& T, const int* index, int begin, int end,
+    double* ax, double* ay, double* az, double* pot)
+{
+    const int N = S.x.size();
+    const __m512 half = _mm512_set1_ps(0.5f);
+    const __m512 threeHalves = _mm512_set1_ps(1.5f);
+    const __m512 zero = _mm512_setzero_ps();
+    const __m512 eps2 = _mm512_set1_ps(S.eps2);
+    const __m512d selfInv = _mm512_set1_pd(S.eps2 > 0.0f ? 1.0 / std::sqrt((double)S.eps2) : 0.0);
+
+    int i = begin;
+    for (; i + 16 <= end; i += 16)
+    {
+        __m512 xi = _mm512_loadu_ps(T.x.data() + i), yi = _mm512_loadu_ps(T.y.data() + i), zi = _mm512_loadu_ps(T.z.data() + i);
+        __m512d axLo = _mm512_setzero_pd(), ayLo = axLo, azLo = axLo, axHi = axLo, ayHi = axLo, azHi = axLo;
+        __m512d phLo = axLo, phHi = axLo;
+
+        for (int t = 0; t < N; t += MixedTile)
+        {
+            const int tileEnd = t + MixedTile < N ? t + MixedTile : N;
+            __m512 fx = zero, fy = zero, fz = zero, fp = zero;
+            for (int j = t; j < tileEnd; ++j)
+            {
+                __m512 dx = _mm512_sub_ps(_mm512_set1_ps(S.x[j]), xi);
+                __m512 dy = _mm512_sub_ps(_mm512_set1_ps(S.y[j]), yi);
+                __m512 dz = _mm512_sub_ps(_mm512_set1_ps(S.z[j]), zi);
+                __m512 r2 = _mm512_fmadd_ps(dx, dx, _mm512_fmadd_ps(dy, dy, _mm512_fmadd_ps(dz, dz, eps2)));
+
+                __mmask16 valid = _mm512_cmp_ps_mask(r2, zero, _CMP_GT_OQ);
+                __m512 inv = _mm512_maskz_rsqrt14_ps(valid, r2);
+                inv = _mm512_mul_ps(inv, _mm512_fnmadd_ps(_mm512_mul_ps(half, r2), _mm512_mul_ps(inv, inv), threeHalves));
+
+                __m512 s = _mm512_mul_ps(_mm512_set1_ps(S.gm[j]), _mm512_mul_ps(inv, _mm512_mul_ps(inv, inv)));
+                fx = _mm512_fmadd_ps(s, dx, fx);
+                fy = _mm512_fmadd_ps(s, dy, fy);
+                fz = _mm512_fmadd_ps(s, dz, fz);
+                if constexpr (Potential)
+                    fp = _mm512_fnmadd_ps(_mm512_set1_ps(S.gm[j]), inv, fp);
+            }
+            // through memory, once per tile: the 256 bit half extracts trip
+            // GCC's -Wmaybe-uninitialized inside its own headers
+            alignas(64) float tile[4][16];
+            _mm512_store_ps(tile[0], fx); _mm512_store_ps(tile[1], fy); _mm512_store_ps(tile[2], fz);
+            axLo = _mm512_add_pd(axLo, _mm512_maskz_cvtps_pd(0xff, _mm256_load_ps(tile[0])));
+            axHi = _mm512_add_pd(axHi, _mm512_maskz_cvtps_pd(0xff, _mm256_load_ps(tile[0] + 8)));
+            ayLo = _mm512_add_pd(ayLo, _mm512_maskz_cvtps_pd(0xff, _mm256_load_ps(tile[1])));
+            ayHi = _mm512_add_pd(ayHi, _mm512_maskz_cvtps_pd(0xff, _mm256_load_ps(tile[1] + 8)));
+            azLo = _mm512_add_pd(azLo, _mm512_maskz_cvtps_pd(0xff, _mm256_load_ps(tile[2])));
+            azHi = _mm512_add_pd(azHi, _mm512_maskz_cvtps_pd(0xff, _mm256_load_ps(tile[2] + 8)));
+            if constexpr (Potential) {
+                _mm512_store_ps(tile[3], fp);
+                phLo = _mm512_add_pd(phLo, _mm512_maskz_cvtps_pd(0xff, _mm256_load_ps(tile[3])));
+                phHi = _mm512_add_pd(phHi, _mm512_maskz_cvtps_pd(0xff, _mm256_load_ps(tile[3] + 8)));
+            }
+        }
+
+        _mm512_storeu_pd(ax + i, axLo); _mm512_storeu_pd(ax + i + 8, axHi);
+        _mm512_storeu_pd(ay + i, ayLo); _mm512_storeu_pd(ay + i + 8, ayHi);
+        _mm512_storeu_pd(az + i, azLo); _mm512_storeu_pd(az + i + 8, azHi);
+        if constexpr (Potential) {
+            phLo = _mm512_fmadd_pd(_mm512_maskz_cvtps_pd(0xff, _mm256_loadu_ps(T.gm.data() + i)), selfInv, phLo);
+            phHi = _mm512_fmadd_pd(_mm512_maskz_cvtps_pd(0xff, _mm256_loadu_ps(T.gm.data() + i + 8)), selfInv, phHi);
+            _mm512_storeu_pd(pot + i, phLo); _mm512_storeu_pd(pot + i + 8, phHi);
+        }
+    }
+
+    mixedAVX2<Potential>(S, T, index, i, end, ax, ay, az, pot);
+}
+
+SimdLevel queryCpu()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+    __cpuid(info, 1);
+    const bool sse2 = (info[3] >> 26) & 1;
+    const bool fma = (info[2] >> 12) & 1;
+    const bool osxsave = (info[2] >> 27) & 1;
+    const bool avx = (info[2] >> 28) & 1;
+    bool avx2 = false, avx512 = false;
+    if (osxsave && avx && maxLeaf >= 7) {
+        // the OS has to save the wider registers on context switches
+        unsigned long long xcr0 = _xgetbv(0);
+        __cpuidex(info, 7, 0);
+        avx2 = ((xcr0 & 0x6) == 0x6) && fma && ((info[1] >> 5) & 1);
+        avx512 = ((xcr0 & 0xe6) == 0xe6) && ((info[1] >> 16) & 1);
+    }
+#else
+    __builtin_cpu_init();
+    const bool sse2 = __builtin_cpu_supports("sse2");
+    const bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    const bool avx512 = __builtin_cpu_supports("avx512f");
+#endif
+    if (avx512)
+        return SimdLevel::AVX512;
+    if (avx2)
+        return SimdLevel::AVX2;
+    if (sse2)
+        return SimdLevel::SSE2;
+    return SimdLevel::Scalar;
+}
+
+#else
+
+SimdLevel queryCpu()
+{
+    return SimdLevel::Scalar;
+}
+
+#endif
+
+}
+
+SimdLevel detectSimdLevel()
+{
+    static const SimdLevel level = queryCpu();
+    return level;
+}
+
+const char* simdLevelName(SimdLevel level)
+{
+    switch (level) {
+    case SimdLevel::SSE2: return "SSE2";
+    case SimdLevel::AVX2: return "AVX2";
+    case SimdLevel::AVX512: return "AVX-512";
+    default: return "scalar";
+    }
+}
+
+namespace {
+
+void dispatchRows(SimdLevel level, const BodyState& X, const BodyState& T, const int* index, double G,
+    int begin, int end, double* ax, double* ay, double* az, const Softening& soft, double* pot)
+{
+#if defined(NBODY_X86)
+    const bool spline = soft.enabled() && soft.kind == SofteningKind::Spline;
+    const bool done = spline
+        ? (pot ? rowsAt<true, true>(level, X, T, index, G, soft, begin, end, ax, ay, az, pot)
+               : rowsAt<true, false>(level, X, T, index, G, soft, begin, end, ax, ay, az, pot))
+        : (pot ? rowsAt<false, true>(level, X, T, index, G, soft, begin, end, ax, ay, az, pot)
+               : rowsAt<false, false>(level, X, T, index, G, soft, begin, end, ax, ay, az, pot));
+    if (done)
+        return;
+#endif
+    tailRows(X, index, G, soft, begin, end, ax, ay, az, pot);
+}
+
+void dispatchMixed(SimdLevel level, const FloatSources& S, const FloatSources& T, const int* index,
+    int begin, int end, double* ax, double* ay, double* az, double* pot)
+{
+#if defined(NBODY_X86)
+    switch (level) {
+    case SimdLevel::AVX512:
+        pot ? mixedAVX512<true>(S, T, index, begin, end, ax, ay, az, pot)
+            : mixedAVX512<false>(S, T, index, begin, end, ax, ay, az, pot);
+        return;
+    case SimdLevel::AVX2:
+        pot ? mixedAVX2<true>(S, T, index, begin, end, ax, ay, az, pot)
+            : mixedAVX2<false>(S, T, index, begin, end, ax, ay, az, pot);
+        return;
+    case SimdLevel::SSE2:
+        pot ? mixedSSE2<true>(S, T, index, begin, end, ax, ay, az, pot)
+            : mixedSSE2<false>(S, T, index, begin, end, ax, ay, az, pot);
+        return;
+    default: break;
+    }
+#endif
+    pot ? mixedScalar<true>(S, T, index, begin, end, ax, ay, az, pot)
+        : mixedScalar<false>(S, T, index, begin, end, ax, ay, az, pot);
+}
+
+}
+
+void simdAccelerationRows(SimdLevel level, const BodyState& X, double G, int begin, int end,
+    double* ax, double* ay, double* az, const Softening& soft, double* pot)
+{
+    dispatchRows(level, X, X, nullptr, G, begin, end, ax, ay, az, soft, pot);
+}
+
+void simdAccelerationTargets(SimdLevel level, const BodyState& X, const BodyState& T, const int* index, double G,
+    int begin, int end, double* ax, double* ay, double* az, const Softening& soft)
+{
+    dispatchRows(level, X, T, index, G, begin, end, ax, ay, az, soft, nullptr);
+}
+
+void FloatSources::load(const BodyState& X, double G)
+{
+    const size_t N = X.size();
+    double m = 0.0;
+    cx = cy = cz = 0.0;
+    for (size_t i = 0; i < N; ++i) {
+        m += X.mass[i];
+        cx += X.mass[i] * X.x[i];
+        cy += X.mass[i] * X.y[i];
+        cz += X.mass[i] * X.z[i];
+    }
+    if (m != 0.0) {
+        cx /= m; cy /= m; cz /= m;
+    }
+
+    x.resize(N); y.resize(N); z.resize(N); gm.resize(N);
+    for (size_t i = 0; i < N; ++i) {
+        x[i] = (float)(X.x[i] - cx);
+        y[i] = (float)(X.y[i] - cy);
+        z[i] = (float)(X.z[i] - cz);
+        gm[i] = (float)(G * X.mass[i]);
+    }
+}
+
+void FloatSources::loadTargets(const BodyState& X, double G, const FloatSources& frame, const int* targets,
+    int count)
+{
+    cx = frame.cx; cy = frame.cy; cz = frame.cz;
+    eps2 = frame.eps2;
+    x.resize(count); y.resize(count); z.resize(count); gm.resize(count);
+    for (int k = 0; k < count; ++k) {
+        const int i = targets[k];
+        x[k] = (float)(X.x[i] - cx);
+        y[k] = (float)(X.y[i] - cy);
+        z[k] = (float)(X.z[i] - cz);
+        gm[k] = (float)(G * X.mass[i]);
+    }
+}
+
+void simdAccelerationRowsMixed(SimdLevel level, const FloatSources& S, int begin, int end,
+    double* ax, double* ay, double* az, double* pot)
+{
+    dispatchMixed(level, S, S, nullptr, begin, end, ax, ay, az, pot);
+}
+
+void simdAccelerationTargetsMixed(SimdLevel level, const FloatSources& S, const FloatSources& T, const int* index,
+    int begin, int end, double* ax, double* ay, double* az)
+{
+    dispatchMixed(level, S, T, index, begin, end, ax, ay, az, nullptr);
+}
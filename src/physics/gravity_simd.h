@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+
+#include "body_state.h"
+#include "softening.h"
+
+// Vectorized direct-summation kernels.
+// Each instruction handles several target bodies i at once (2 with SSE2,
+// 4 with AVX2, 8 with AVX-512) against one broadcast source body j. With
+// AVX-512 the inverse distance comes from the hardware reciprocal square root
+// estimate refined by two Newton-Raphson steps, no sqrt and no divide in the
+// inner loop. SSE2 and AVX2 only have the estimate in float, whose range a
+// squared distance can leave, so they take sqrt and divide in double.
+//
+// Accuracy: per body |a_simd - a_scalar| / |a_scalar| <= SimdTolerance
+// against DirectGravity::accelerationRows, for any separation a double holds.
+// Coincident bodies contribute nothing instead of NaN.
+// Plummer softening adds eps^2 to every r^2, the spline blends its polynomial
+// in where u = r / h < 1, a few more instructions per pair.
+enum class SimdLevel { Scalar, SSE2, AVX2, AVX512 };
+
+constexpr double SimdTolerance = 1e-10;
+
+// Best level supported by this CPU and OS, checked once via CPUID
+SimdLevel detectSimdLevel();
+
+const char* simdLevelName(SimdLevel level);
+
+// Rows [begin, end) of the accelerations, like DirectGravity::accelerationRows.
+// Levels the CPU does not support must not be requested. With pot the same
+// pass fills pot[begin, end) with the potential too, a kernel of its own, so
+// the accelerations keep their bits.
+void simdAccelerationRows(SimdLevel level, const BodyState& X, double G, int begin, int end,
+    double* ax, double* ay, double* az, const Softening& soft = Softening(), double* pot = nullptr);
+
+// Rows [begin, end) of T, bodies gathered from X: row k is body index[k] of X
+// and sums every body of X but itself, within SimdTolerance of the scalar
+// loop like the rows above. ax/ay/az are indexed by row.
+void simdAccelerationTargets(SimdLevel level, const BodyState& X, const BodyState& T, const int* index, double G,
+    int begin, int end, double* ax, double* ay, double* az, const Softening& soft = Softening());
+
+// Sources of the mixed precision kernels in float: positions relative to a
+// reference point (the centre of mass), and G * m
+struct FloatSources
+{
+    std::vector<float> x, y, z, gm;
+    float eps2 = 0.0f; // Plummer softening, the mixed kernels have no spline
+    double cx = 0.0, cy = 0.0, cz = 0.0; // reference point
+
+    void load(const BodyState& X, double G);
+    // Bodies targets[0..count) of X as target rows, in the frame of the sources
+    void loadTargets(const BodyState& X, double G, const FloatSources& frame, const int* targets, int count);
+};
+
+// Mixed precision: every pair term is computed in float, twice as many lanes
+// per instruction as the double kernels (4 SSE2, 8 AVX2, 16 AVX-512), with a
+// single Newton step on the reciprocal square root. Terms are summed in float
+// over tiles of MixedTile sources and every tile is added to double
+// accumulators, so the rounding of the sum does not grow with N.
+//
+// Positions only keep float precision relative to the reference point, so the
+// error of a pair is about 6e-8 * (distance from the centre of mass) /
+// (separation): fine for the solar system (see bench mixed_precision), poor
+// for a tight binary far from the centre. The state and the integrators stay
+// in double.
+constexpr int MixedTile = 256;
+
+// Rows [begin, end) of the accelerations of the bodies in S, and of the
+// potential with pot, summed like the accelerations
+void simdAccelerationRowsMixed(SimdLevel level, const FloatSources& S, int begin, int end,
+    double* ax, double* ay, double* az, double* pot = nullptr);
+
+// Rows [begin, end) of T as targets of every source in S, T loaded by
+// loadTargets() with the index it was gathered by
+void simdAccelerationTargetsMixed(SimdLevel level, const FloatSources& S, const FloatSources& T, const int* index,
+    int begin, int end, double* ax, double* ay, double* az);
@@ -0,0 +1,12 @@
+#include "integrator.h"
+#include "block_timestep.h"
+
+std::unique_ptr<Integrator> makeIntegrator(IntegratorKind kind)
+{
+    switch (kind) {
+    case IntegratorKind::Leapfrog: return std::make_unique<LeapfrogStepper>();
+    case IntegratorKind::VelocityVerlet: return std::make_unique<VelocityVerletStepper>();
+    case IntegratorKind::BlockLeapfrog: return std::make_unique<BlockTimestepper>();
+    default: return std::make_unique<Rk4Stepper>();
+    }
+}
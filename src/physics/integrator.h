@@ -0,0 +1,248 @@
+#pragma once
+
+#include <memory>
+#include <type_traits>
+
+#include "body_state.h"
+
+// Non-owning handle to the state derivative function, cheap to pass around
+// and never allocates. The callable must outlive the call it is passed to.
+// deriv(X, Xdot) fills Xdot in place: Xdot.x/y/z = velocities,
+// Xdot.vx/vy/vz = accelerations.
+class DerivativeRef
+{
+public:
+    template <class F, class = std::enable_if_t<!std::is_same_v<std::decay_t<F>, DerivativeRef>>>
+    DerivativeRef(F& f)
+        : ctx(&f), fn([](void* c, const BodyState& X, BodyState& Xdot) { (*static_cast<F*>(c))(X, Xdot); })
+    {
+    }
+
+    void operator()(const BodyState& X, BodyState& Xdot) const { fn(ctx, X, Xdot); }
+
+private:
+    void* ctx;
+    void (*fn)(void*, const BodyState&, BodyState&);
+};
+
+// Accelerations of a subset of the bodies, all bodies acting as sources:
+// accel(X, targets, count, ax, ay, az) fills ax[k] for body targets[k].
+class SubsetAccelerationRef
+{
+public:
+    template <class F, class = std::enable_if_t<!std::is_same_v<std::decay_t<F>, SubsetAccelerationRef>>>
+    SubsetAccelerationRef(F& f)
+        : ctx(&f), fn([](void* c, const BodyState& X, const int* t, int n, double* ax, double* ay, double* az) {
+            (*static_cast<F*>(c))(X, t, n, ax, ay, az);
+        })
+    {
+    }
+
+    void operator()(const BodyState& X, const int* targets, int count, double* ax, double* ay, double* az) const
+    {
+        fn(ctx, X, targets, count, ax, ay, az);
+    }
+
+private:
+    void* ctx;
+    void (*fn)(void*, const BodyState&, const int*, int, double*, double*, double*);
+};
+
+// Advances the whole state by one step of dt.
+// Steppers own their scratch buffers and keep them between calls, they are
+// only resized when the body count changes, so a steady-state step does no
+// heap allocation.
+class Integrator
+{
+public:
+    virtual ~Integrator() = default;
+
+    virtual const char* name() const = 0;
+
+    // Force evaluations per step, for cost comparisons
+    virtual int evaluationsPerStep() const = 0;
+
+    virtual void step(BodyState& Xi, double dt, DerivativeRef deriv) = 0;
+
+    // Same as step(), for callers that can also evaluate part of the bodies.
+    // Steppers that only need some forces (block timesteps) override this.
+    virtual void advance(BodyState& Xi, double dt, DerivativeRef deriv, SubsetAccelerationRef)
+    {
+        step(Xi, dt, deriv);
+    }
+
+    // Has to be called when the state was changed outside of step()
+    // (coordinates edited), steppers may cache forces
+    virtual void invalidate() {}
+
+    // Bodies were added or removed: body k < kept.size() was body kept[k]
+    // before, the ones after are new. Steppers with per-body state keep it
+    // for the survivors, the rest only drop their cache.
+    virtual void bodiesChanged(const std::vector<int>& kept)
+    {
+        (void)kept;
+        invalidate();
+    }
+};
+
+// Classic 4th order Runge-Kutta, 4 force evaluations per step.
+// Not symplectic: the energy error of a bound orbit grows steadily.
+class Rk4Stepper : public Integrator
+{
+public:
+    const char* name() const override { return "RK4"; }
+    int evaluationsPerStep() const override { return 4; }
+
+    void step(BodyState& Xi, double dt, DerivativeRef deriv) override
+    {
+        const size_t N = Xi.size();
+        resize(N);
+        temp.mass = Xi.mass;
+
+        deriv(Xi, k1);
+        stage(Xi, k1, dt / 2);
+        deriv(temp, k2);
+        stage(Xi, k2, dt / 2);
+        deriv(temp, k3);
+        stage(Xi, k3, dt);
+        deriv(temp, k4);
+
+        for (int c = 0; c < BodyState::NumComponents; ++c) {
+            double* xi = Xi.component(c).data();
+            const double* a = k1.component(c).data();
+            const double* b = k2.component(c).data();
+            const double* d = k3.component(c).data();
+            const double* e = k4.component(c).data();
+            for (size_t i = 0; i < N; ++i) {
+                xi[i] += (a[i] + 2 * b[i] + 2 * d[i] + e[i]) * (dt / 6);
+            }
+        }
+    }
+
+    // Grows (or shrinks) the scratch buffers, called automatically by step()
+    void resize(size_t n)
+    {
+        if (k1.size() == n)
+            return;
+        k1.resize(n);
+        k2.resize(n);
+        k3.resize(n);
+        k4.resize(n);
+        temp.resize(n);
+    }
+
+private:
+    // temp = Xi + k * h
+    void stage(const BodyState& Xi, const BodyState& k, double h)
+    {
+        const size_t N = Xi.size();
+        for (int c = 0; c < BodyState::NumComponents; ++c) {
+            const double* xi = Xi.component(c).data();
+            const double* kc = k.component(c).data();
+            double* t = temp.component(c).data();
+            for (size_t i = 0; i < N; ++i) {
+                t[i] = xi[i] + kc[i] * h;
+            }
+        }
+    }
+
+    BodyState k1, k2, k3, k4;
+    BodyState temp;
+};
+
+// Base of the symplectic second order schemes.
+// They need the acceleration at the start of the step, which is the one at
+// the end of the previous step, so it is cached and a step costs one force
+// evaluation. The cache is dropped by invalidate() or a body count change.
+class CachedForceStepper : public Integrator
+{
+public:
+    int evaluationsPerStep() const override { return 1; }
+    void invalidate() override { valid = false; }
+
+protected:
+    // Makes sure acc holds the accelerations of Xi
+    void prime(const BodyState& Xi, DerivativeRef deriv)
+    {
+        if (acc.size() != Xi.size()) {
+            acc.resize(Xi.size());
+            valid = false;
+        }
+        if (!valid) {
+            deriv(Xi, acc);
+            valid = true;
+        }
+    }
+
+    BodyState acc;
+    bool valid = false;
+};
+
+// Kick-drift-kick leapfrog:
+//   v += a dt/2,  x += v dt,  a = a(x),  v += a dt/2
+class LeapfrogStepper : public CachedForceStepper
+{
+public:
+    const char* name() const override { return "Leapfrog (KDK)"; }
+
+    void step(BodyState& Xi, double dt, DerivativeRef deriv) override
+    {
+        prime(Xi, deriv);
+        const size_t N = Xi.size();
+        const double h = dt / 2;
+
+        for (size_t i = 0; i < N; ++i) {
+            Xi.vx[i] += acc.vx[i] * h;
+            Xi.vy[i] += acc.vy[i] * h;
+            Xi.vz[i] += acc.vz[i] * h;
+            Xi.x[i] += Xi.vx[i] * dt;
+            Xi.y[i] += Xi.vy[i] * dt;
+            Xi.z[i] += Xi.vz[i] * dt;
+        }
+
+        deriv(Xi, acc);
+
+        for (size_t i = 0; i < N; ++i) {
+            Xi.vx[i] += acc.vx[i] * h;
+            Xi.vy[i] += acc.vy[i] * h;
+            Xi.vz[i] += acc.vz[i] * h;
+        }
+    }
+};
+
+// Velocity Verlet:
+//   x += v dt + a dt^2/2,  a' = a(x),  v += (a + a') dt/2
+// Same trajectory as KDK leapfrog in exact arithmetic, rounds differently.
+class VelocityVerletStepper : public CachedForceStepper
+{
+public:
+    const char* name() const override { return "Velocity Verlet"; }
+
+    void step(BodyState& Xi, double dt, DerivativeRef deriv) override
+    {
+        prime(Xi, deriv);
+        const size_t N = Xi.size();
+        const double h = dt * dt / 2;
+
+        for (size_t i = 0; i < N; ++i) {
+            Xi.x[i] += Xi.vx[i] * dt + acc.vx[i] * h;
+            Xi.y[i] += Xi.vy[i] * dt + acc.vy[i] * h;
+            Xi.z[i] += Xi.vz[i] * dt + acc.vz[i] * h;
+            Xi.vx[i] += acc.vx[i] * (dt / 2);
+            Xi.vy[i] += acc.vy[i] * (dt / 2);
+            Xi.vz[i] += acc.vz[i] * (dt / 2);
+        }
+
+        deriv(Xi, acc);
+
+        for (size_t i = 0; i < N; ++i) {
+            Xi.vx[i] += acc.vx[i] * (dt / 2);
+            Xi.vy[i] += acc.vy[i] * (dt / 2);
+            Xi.vz[i] += acc.vz[i] * (dt / 2);
+        }
+    }
+};
+
+enum class IntegratorKind { RK4, Leapfrog, VelocityVerlet, BlockLeapfrog };
+
+std::unique_ptr<Integrator> makeIntegrator(IntegratorKind kind);
@@ -0,0 +1,73 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool MappedFile::open(const char* path, std::string& error)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE f = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (f == INVALID_HANDLE_VALUE) {
+        error = std::string("cannot open ") + path;
+        return false;
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(f, &size);
+    HANDLE m = size.QuadPart > 0 ? CreateFileMappingA(f, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+    const void* view = m ? MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!view) {
+        if (m)
+            CloseHandle(m);
+        CloseHandle(f);
+        error = std::string("cannot map ") + path;
+        return false;
+    }
+    file = f;
+    mapping = m;
+    length = (size_t)size.QuadPart;
+#else
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        error = std::string("cannot open ") + path;
+        return false;
+    }
+    struct stat st;
+    void* view = fstat(fd, &st) == 0 && st.st_size > 0
+        ? mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    // the mapping keeps the file alive
+    ::close(fd);
+    if (view == MAP_FAILED) {
+        error = std::string("cannot map ") + path;
+        return false;
+    }
+    length = (size_t)st.st_size;
+#endif
+    bytes = static_cast<const unsigned char*>(view);
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (!bytes)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(bytes);
+    CloseHandle(mapping);
+    CloseHandle(file);
+    mapping = file = nullptr;
+#else
+    munmap(const_cast<unsigned char*>(bytes), length);
+#endif
+    bytes = nullptr;
+    length = 0;
+}
@@ -0,0 +1,35 @@
+#include "neighbor_list.h"
+
+void NeighborList::setRange(double cutoff, double skin)
+{
+    rc = cutoff;
+    rs = skin > 0.0 ? skin : 0.0;
+    built = false;
+}
+
+bool NeighborList::update(const BodyState& X, bool planar)
+{
+    const size_t N = X.size();
+    if (built && refX.size() == N)
+    {
+        const double limit2 = 0.25 * rs * rs;
+        bool moved = false;
+        for (size_t i = 0; i < N && !moved; ++i) {
+            const double dx = X.x[i] - refX[i], dy = X.y[i] - refY[i];
+            const double dz = planar ? 0.0 : X.z[i] - refZ[i];
+            moved = dx * dx + dy * dy + dz * dz > limit2;
+        }
+        if (!moved)
+            return false;
+    }
+
+    // touching spheres of diameter cutoff + skin are exactly the pairs in range
+    radii.assign(N, 0.5 * (rc + rs));
+    grid.findContacts(X, radii.data(), planar, list);
+    refX = X.x;
+    refY = X.y;
+    refZ = X.z;
+    built = true;
+    ++rebuildCount;
+    return true;
+}
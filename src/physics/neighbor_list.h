@@ -0,0 +1,41 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include "body_state.h"
+#include "collisions.h"
+
+// Pairs closer than a cutoff, found on CollisionDetector's spatial hash grid.
+//
+// A build lists every pair within cutoff + skin. The list is only rebuilt
+// once some body has moved more than skin / 2 since, until then it still
+// holds every pair within cutoff: two bodies closing in on each other have
+// covered less than skin together. A rebuild is O(N) expected, the updates in
+// between only compare positions.
+class NeighborList
+{
+public:
+    void setRange(double cutoff, double skin);
+    double cutoff() const { return rc; }
+    double skin() const { return rs; }
+
+    // Rebuilds when a body moved too far or the body count changed, returns
+    // whether it did. Planar mode ignores z.
+    bool update(const BodyState& X, bool planar);
+    void invalidate() { built = false; }
+
+    // (i, j), i < j, within cutoff + skin at the last build
+    const std::vector<std::pair<int, int>>& pairs() const { return list; }
+    long long rebuilds() const { return rebuildCount; }
+
+private:
+    double rc = 0.0, rs = 0.0;
+    bool built = false;
+    long long rebuildCount = 0;
+
+    CollisionDetector grid;
+    std::vector<double> radii;
+    std::vector<std::pair<int, int>> list;
+    std::vector<double> refX, refY, refZ; // positions at the last build
+};
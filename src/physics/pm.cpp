@@ -0,0 +1,262 @@
+#include "pm.h"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+
+namespace {
+
+constexpr double Pi = 3.14159265358979323846;
+
+// complex columns per task of the z transform, 512 bytes of every plane
+constexpr int ColumnBlock = 32;
+
+double elapsedMs(std::chrono::steady_clock::time_point& since)
+{
+    const auto now = std::chrono::steady_clock::now();
+    const double ms = std::chrono::duration<double, std::milli>(now - since).count();
+    since = now;
+    return ms;
+}
+
+}
+
+void PmGravity::setGrid(int cells)
+{
+    assert(cells >= 8 && (cells & (cells - 1)) == 0);
+    n = cells;
+    rows.setSize(n);
+    columns.setSize(n);
+    sin2.resize(n);
+    for (int k = 0; k < n; ++k) {
+        const double s = std::sin(Pi * k / n);
+        sin2[k] = s * s;
+    }
+    mesh.clear();
+    mesh.shrink_to_fit();
+}
+
+void PmGravity::setBox(double x0, double y0, double z0, double size)
+{
+    originX = x0;
+    originY = y0;
+    originZ = z0;
+    side = size;
+}
+
+void PmGravity::fitBox(const BodyState& X)
+{
+    double lo[3] = { X.x[0], X.y[0], X.z[0] };
+    double hi[3] = { lo[0], lo[1], lo[2] };
+    for (int i = 1; i < (int)X.size(); ++i) {
+        lo[0] = std::min(lo[0], X.x[i]); hi[0] = std::max(hi[0], X.x[i]);
+        lo[1] = std::min(lo[1], X.y[i]); hi[1] = std::max(hi[1], X.y[i]);
+        lo[2] = std::min(lo[2], X.z[i]); hi[2] = std::max(hi[2], X.z[i]);
+    }
+    const double extent = std::max({ hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2] });
+    // a cell of margin on each side
+    const double size = extent > 0.0 ? extent * n / (n - 2) : 1.0;
+    setBox(0.5 * (lo[0] + hi[0] - size), 0.5 * (lo[1] + hi[1] - size), 0.5 * (lo[2] + hi[2] - size), size);
+}
+
+void PmGravity::accelerations(const BodyState& X, double G, double* ax, double* ay, double* az)
+{
+    accelerationsWithPotential(X, G, ax, ay, az, nullptr);
+}
+
+void PmGravity::accelerationsWithPotential(const BodyState& X, double G, double* ax, double* ay, double* az,
+    double* pot)
+{
+    if (X.size() == 0)
+        return;
+    if (!hasBox())
+        fitBox(X);
+
+    auto start = std::chrono::steady_clock::now();
+    sortBodies(X);
+    deposit();
+    times.deposit = elapsedMs(start);
+    solve(G);
+    times.solve = elapsedMs(start);
+    interpolate(ax, ay, az, pot);
+    times.interpolate = elapsedMs(start);
+}
+
+// counting sort by mesh row, positions wrapped into the box and in cells
+void PmGravity::sortBodies(const BodyState& X)
+{
+    const int N = X.size();
+    const double inv = n / side;
+    auto wrap = [&](double v, double origin) {
+        double u = (v - origin) * inv;
+        u -= n * std::floor(u / n);
+        return u < n ? u : 0.0;
+    };
+
+    ux.resize(N); uy.resize(N); uz.resize(N); um.resize(N);
+    rowOf.resize(N);
+    order.resize(N);
+    rowStart.assign((size_t)n * n + 1, 0);
+    for (int i = 0; i < N; ++i) {
+        const int row = (int)wrap(X.z[i], originZ) * n + (int)wrap(X.y[i], originY);
+        rowOf[i] = row;
+        ++rowStart[row + 1];
+    }
+    for (int r = 0; r < n * n; ++r)
+        rowStart[r + 1] += rowStart[r];
+
+    // rowStart[r] is moved along while filling and put back after
+    for (int i = 0; i < N; ++i) {
+        const int slot = rowStart[rowOf[i]]++;
+        ux[slot] = wrap(X.x[i], originX);
+        uy[slot] = wrap(X.y[i], originY);
+        uz[slot] = wrap(X.z[i], originZ);
+        um[slot] = X.mass[i];
+        order[slot] = i;
+    }
+    for (int r = n * n; r > 0; --r)
+        rowStart[r] = rowStart[r - 1];
+    rowStart[0] = 0;
+}
+
+void PmGravity::deposit()
+{
+    const int mask = n - 1;
+    mesh.resize((size_t)n * n * (n + 2));
+
+    auto clear = [&](int z) {
+        std::fill(mesh.begin() + cell(0, 0, z), mesh.begin() + cell(0, 0, z + 1), 0.0);
+    };
+    pool.run(n, clear);
+
+    // slab z writes the planes z and z + 1, so the even slabs go first and the odd ones after
+    int parity = 0;
+    auto slab = [&](int task) {
+        const int z = 2 * task + parity, z1 = (z + 1) & mask;
+        for (int b = rowStart[z * n]; b < rowStart[(z + 1) * n]; ++b) {
+            const int ix = (int)ux[b], iy = (int)uy[b];
+            const double fx = ux[b] - ix, fy = uy[b] - iy, fz = uz[b] - z;
+            const int x1 = (ix + 1) & mask, y1 = (iy + 1) & mask;
+
+            const double m0 = um[b] * (1.0 - fz), m1 = um[b] * fz;
+            const double w00 = (1.0 - fx) * (1.0 - fy), w10 = fx * (1.0 - fy);
+            const double w01 = (1.0 - fx) * fy, w11 = fx * fy;
+            mesh[cell(ix, iy, z)] += m0 * w00;
+            mesh[cell(x1, iy, z)] += m0 * w10;
+            mesh[cell(ix, y1, z)] += m0 * w01;
+            mesh[cell(x1, y1, z)] += m0 * w11;
+            mesh[cell(ix, iy, z1)] += m1 * w00;
+            mesh[cell(x1, iy, z1)] += m1 * w10;
+            mesh[cell(ix, y1, z1)] += m1 * w01;
+            mesh[cell(x1, y1, z1)] += m1 * w11;
+        }
+    };
+    pool.run(n / 2, slab);
+    parity = 1;
+    pool.run(n / 2, slab);
+}
+
+// With the cell masses M and the 7-point Laplacian, the potential of mode k is
+//   phi_k = -pi G M_k / (h sum_i sin^2(pi k_i / n))
+void PmGravity::solve(double G)
+{
+    const int h = n / 2 + 1;               // complex values per row
+    const size_t plane = (size_t)n * h;    // complex values per z plane
+    double* data = mesh.data();
+
+    auto xyForward = [&](int z) {
+        for (int y = 0; y < n; ++y)
+            rows.forward(&mesh[cell(0, y, z)]);
+        columns.forward(&mesh[cell(0, 0, z)], h, h);
+    };
+    auto xyInverse = [&](int z) {
+        columns.inverse(&mesh[cell(0, 0, z)], h, h);
+        for (int y = 0; y < n; ++y)
+            rows.inverse(&mesh[cell(0, y, z)]);
+    };
+    const int blocks = (int)((plane + ColumnBlock - 1) / ColumnBlock);
+    auto zForward = [&](int block) {
+        const size_t c = (size_t)block * ColumnBlock;
+        columns.forward(data + 2 * c, plane, (int)std::min<size_t>(ColumnBlock, plane - c));
+    };
+    auto zInverse = [&](int block) {
+        const size_t c = (size_t)block * ColumnBlock;
+        columns.inverse(data + 2 * c, plane, (int)std::min<size_t>(ColumnBlock, plane - c));
+    };
+
+    // the 1 / n^3 of the inverse transform goes in here too
+    const double scale = -Pi * G / (cellSize() * n * (double)n * n);
+    auto green = [&](int kz) {
+        for (int ky = 0; ky < n; ++ky) {
+            double* row = data + 2 * (kz * plane + (size_t)ky * h);
+            for (int kx = 0; kx < h; ++kx) {
+                const double s = sin2[kx] + sin2[ky] + sin2[kz];
+                const double f = s > 0.0 ? scale / s : 0.0;
+                row[2 * kx] *= f;
+                row[2 * kx + 1] *= f;
+            }
+        }
+    };
+
+    pool.run(n, xyForward);
+    pool.run(blocks, zForward);
+    pool.run(n, green);
+    pool.run(blocks, zInverse);
+    pool.run(n, xyInverse);
+}
+
+void PmGravity::interpolate(double* ax, double* ay, double* az, double* pot)
+{
+    const int mask = n - 1;
+    const double d = 1.0 / (12.0 * cellSize());
+    const double* phi = mesh.data();
+
+    // -grad phi at a node, 4-point differences: (8 (f1 - f-1) - (f2 - f-2)) / 12 h
+    auto field = [&](int x, int y, int z, double w, double& gx, double& gy, double& gz) {
+        const size_t c = cell(x, y, z);
+        auto diff = [&](size_t p1, size_t m1, size_t p2, size_t m2) {
+            return 8.0 * (phi[p1] - phi[m1]) - (phi[p2] - phi[m2]);
+        };
+        gx -= w * diff(c - x + ((x + 1) & mask), c - x + ((x - 1) & mask),
+            c - x + ((x + 2) & mask), c - x + ((x - 2) & mask));
+        gy -= w * diff(cell(x, (y + 1) & mask, z), cell(x, (y - 1) & mask, z),
+            cell(x, (y + 2) & mask, z), cell(x, (y - 2) & mask, z));
+        gz -= w * diff(cell(x, y, (z + 1) & mask), cell(x, y, (z - 1) & mask),
+            cell(x, y, (z + 2) & mask), cell(x, y, (z - 2) & mask));
+    };
+
+    auto slab = [&](int z) {
+        const int z1 = (z + 1) & mask;
+        for (int b = rowStart[z * n]; b < rowStart[(z + 1) * n]; ++b) {
+            const int ix = (int)ux[b], iy = (int)uy[b];
+            const double fx = ux[b] - ix, fy = uy[b] - iy, fz = uz[b] - z;
+            const int x1 = (ix + 1) & mask, y1 = (iy + 1) & mask;
+
+            const double w00 = (1.0 - fx) * (1.0 - fy), w10 = fx * (1.0 - fy);
+            const double w01 = (1.0 - fx) * fy, w11 = fx * fy;
+            double gx = 0.0, gy = 0.0, gz = 0.0;
+            field(ix, iy, z, w00 * (1.0 - fz), gx, gy, gz);
+            field(x1, iy, z, w10 * (1.0 - fz), gx, gy, gz);
+            field(ix, y1, z, w01 * (1.0 - fz), gx, gy, gz);
+            field(x1, y1, z, w11 * (1.0 - fz), gx, gy, gz);
+            field(ix, iy, z1, w00 * fz, gx, gy, gz);
+            field(x1, iy, z1, w10 * fz, gx, gy, gz);
+            field(ix, y1, z1, w01 * fz, gx, gy, gz);
+            field(x1, y1, z1, w11 * fz, gx, gy, gz);
+
+            const int i = order[b];
+            ax[i] = gx * d;
+            ay[i] = gy * d;
+            az[i] = gz * d;
+            if (pot) {
+                auto layer = [&](int zl) {
+                    return w00 * phi[cell(ix, iy, zl)] + w10 * phi[cell(x1, iy, zl)]
+                        + w01 * phi[cell(ix, y1, zl)] + w11 * phi[cell(x1, y1, zl)];
+                };
+                pot[i] = (1.0 - fz) * layer(z) + fz * layer(z1);
+            }
+        }
+    };
+    pool.run(n, slab);
+}
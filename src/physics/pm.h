@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vector>
+
+#include "fft.h"
+#include "force_backend.h"
+
+// Wall time of the stages of the last PM evaluation, in ms
+struct PmTimings
+{
+    double deposit = 0.0;     // sorting by mesh row and the CIC deposit
+    double solve = 0.0;       // forward FFT, Green's function, inverse FFT
+    double interpolate = 0.0; // differences of the potential back to the bodies
+};
+
+// Particle-mesh solver for dense, roughly uniform scenes, O(N + M log M) per
+// evaluation on a mesh of M = n^3 cells.
+//
+// Masses are deposited onto a periodic mesh with cloud-in-cell weights, the
+// potential comes from an FFT Poisson solve with the Green's function of the
+// 7-point Laplacian, and the accelerations (4-point differences of the
+// potential) go back to the bodies with the same weights, so a body feels no
+// force from itself and momentum is conserved. The k = 0 mode is dropped,
+// i.e. the mean density does not pull, as in cosmological boxes.
+//
+// The box is periodic, bodies outside it act and feel forces through their
+// images. Unless setBox() was called the first evaluation fits it around the
+// bodies with a cell of margin and keeps it. Forces are Newtonian from a few
+// cells on and soft below, the mesh replaces softeningOf(). Planar scenes are
+// one layer of the 3D mesh.
+//
+// The transforms use the radix-2 FFT of fft.h, so n is a power of two. Every
+// stage runs over slabs of the mesh on the thread pool: deposit and
+// interpolation per z slab (bodies are sorted by mesh row, even and odd slabs
+// go in two rounds since a slab deposits into the next plane too), the x and
+// y transforms per z plane and the z transform per block of columns.
+class PmGravity : public ForceBackend
+{
+public:
+    explicit PmGravity(int grid = 64, int threads = 1)
+    {
+        setGrid(grid);
+        setThreads(threads);
+    }
+
+    const char* name() const override { return "particle-mesh"; }
+
+    int grid() const { return n; }
+    void setGrid(int cells);
+
+    // Periodic box, lower corner and side
+    void setBox(double x0, double y0, double z0, double size);
+    bool hasBox() const { return side > 0.0; }
+    double boxSize() const { return side; }
+    double cellSize() const { return side / n; }
+
+    void accelerations(const BodyState& X, double G, double* ax, double* ay, double* az) override;
+    // the mesh potential at every body, by the same weights: relative to the
+    // mean density, and with the body's own cloud in it, so only its changes
+    // over a run mean much
+    void accelerationsWithPotential(const BodyState& X, double G, double* ax, double* ay, double* az,
+        double* pot) override;
+
+    const PmTimings& timings() const { return times; }
+
+private:
+    void fitBox(const BodyState& X);
+    void sortBodies(const BodyState& X);
+    void deposit();
+    void solve(double G);
+    void interpolate(double* ax, double* ay, double* az, double* pot);
+
+    // real cell (x, y, z), the rows are padded to n + 2 for the in-place real transform
+    size_t cell(int x, int y, int z) const { return ((size_t)z * n + y) * (n + 2) + x; }
+
+    int n = 64;
+    double originX = 0.0, originY = 0.0, originZ = 0.0, side = 0.0;
+
+    Fft columns;
+    RealFft rows;
+    std::vector<double> mesh;           // masses, then spectrum, then potential
+    std::vector<double> sin2;           // sin^2(pi k / n) of the Green's function
+
+    // bodies sorted by mesh row z * n + y, positions in cells
+    std::vector<int> rowStart, rowOf, order;
+    std::vector<double> ux, uy, uz, um;
+
+    PmTimings times;
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cmath>
+#include <random>
+
+#include "body_state.h"
+
+// Initial conditions shared by the benchmarks and tools that run without the
+// window. G is the one the interactive scene in main() uses.
+constexpr double PresetG = 0.1;
+
+// Sun to Neptune, same numbers as the default scene in main()
+inline BodyState solarSystem()
+{
+    return BodyState(
+        {
+            { 0, 0, 0, 0, 0, 0 },             // Sun
+            { 31.95, 0, 0, 0, 95.8, 0 },      // Mercury
+            { 54.1, 0, 0, 0, 70, 0 },         // Venus
+            { 74.3, 0, 0, 0, 59.6, 0 },       // Earth
+            { 113.95, 0, 0, 0, 48.2, 0 },     // Mars
+            { 389.25, 0, 0, 0, 26.2, 0 },     // Jupiter
+            { 716.5, 0, 0, 0, 19.4, 0 },      // Saturn
+            { 1436, 0, 0, 0, 13.6, 0 },       // Uranus
+            { 2247.5, 0, 0, 0, 10.8, 0 }      // Neptune
+        },
+        { 1989000, 0.330, 4.87, 5.97, 0.642, 1900, 568, 86.8, 102 });
+}
+
+// Plummer sphere in virial equilibrium (Aarseth, Henon & Wielen 1974),
+// total mass M, scale radius a, equal mass bodies
+inline BodyState plummerSphere(int n, unsigned seed, double G = PresetG, double M = 1e5, double a = 500.0)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    const double pi = 3.14159265358979323846;
+
+    auto direction = [&](double r, double& x, double& y, double& z) {
+        double c = 2.0 * u(rng) - 1.0;
+        double s = std::sqrt(1.0 - c * c);
+        double phi = 2.0 * pi * u(rng);
+        x = r * s * std::cos(phi);
+        y = r * s * std::sin(phi);
+        z = r * c;
+    };
+
+    BodyState X;
+    X.reserve(n);
+    for (int i = 0; i < n; ++i)
+    {
+        // radius from the inverted cumulative mass, cut at 0.999 M
+        double m = 0.999 * u(rng);
+        double r = a / std::sqrt(std::pow(m, -2.0 / 3.0) - 1.0);
+
+        // speed by rejection sampling of q^2 (1 - q^2)^3.5, q = v / v_escape
+        double q, g;
+        do {
+            q = u(rng);
+            g = 0.1 * u(rng);
+        } while (g > q * q * std::pow(1.0 - q * q, 3.5));
+        double vesc = std::sqrt(2.0 * G * M) * std::pow(r * r + a * a, -0.25);
+
+        double x, y, z, vx, vy, vz;
+        direction(r, x, y, z);
+        direction(q * vesc, vx, vy, vz);
+        X.push_back(x, y, z, vx, vy, vz, M / n);
+    }
+    return X;
+}
+
+// The solar system padded to n bodies with an asteroid belt: light bodies on
+// circular orbits around the Sun between Mars and Jupiter, random phase and a
+// small inclination. n <= 9 gives the first n bodies of solarSystem().
+inline BodyState solarSystemWithBelt(int n, unsigned seed, double G = PresetG)
+{
+    BodyState X = solarSystem();
+    if (n <= (int)X.size()) {
+        X.resize(n);
+        return X;
+    }
+
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> radius(150.0, 350.0);
+    std::uniform_real_distribution<double> phase(0.0, 2.0 * 3.14159265358979323846);
+    std::uniform_real_distribution<double> tilt(-0.05, 0.05);
+    const double sun = X.mass[0];
+
+    X.reserve(n);
+    while ((int)X.size() < n)
+    {
+        double r = radius(rng), p = phase(rng), i = tilt(rng);
+        double v = std::sqrt(G * sun / r);
+        X.push_back(r * std::cos(p), r * std::sin(p) * std::cos(i), r * std::sin(p) * std::sin(i),
+            -v * std::sin(p), v * std::cos(p) * std::cos(i), v * std::cos(p) * std::sin(i), 1e-3);
+    }
+    return X;
+}
+
+// Equal mass bodies at rest, uniformly random in the cube [0, size)^3, the
+// cold start of a cosmological box. Meant for PmGravity with setBox(0, 0, 0, size).
+inline BodyState uniformBox(int n, unsigned seed, double size = 2000.0, double M = 1e5)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> pos(0.0, size);
+    BodyState X;
+    X.reserve(n);
+    for (int i = 0; i < n; ++i) {
+        const double x = pos(rng), y = pos(rng), z = pos(rng);
+        X.push_back(x, y, z, 0.0, 0.0, 0.0, M / n);
+    }
+    return X;
+}
@@ -0,0 +1,164 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+namespace
+{
+    const char* const StageNames[(int)ProfileStage::Count] = {
+        "force", "integrate", "trail update", "trail draw", "body draw", "input"
+    };
+
+    int64_t clockNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    std::atomic<int> nextThread{ 0 };
+
+    uint8_t threadId()
+    {
+        thread_local const uint8_t id = (uint8_t)nextThread.fetch_add(1, std::memory_order_relaxed);
+        return id;
+    }
+}
+
+const char* profileStageName(ProfileStage stage)
+{
+    return stage < ProfileStage::Count ? StageNames[(int)stage] : "?";
+}
+
+Profiler& Profiler::instance()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+Profiler::Profiler()
+    : epoch(clockNs()), ring(new Slot[RingSize])
+{
+    for (int i = 0; i < RingSize; ++i)
+        ring[i].seq.store(i, std::memory_order_relaxed);
+    history.assign((size_t)HistoryFrames * (int)ProfileStage::Count, 0.0f);
+    trace.reserve(TraceEvents);
+}
+
+int64_t Profiler::now() const
+{
+    return clockNs() - epoch;
+}
+
+void Profiler::record(ProfileStage stage, int64_t begin, int64_t end)
+{
+    uint64_t pos = head.load(std::memory_order_relaxed);
+    Slot* slot;
+    for (;;)
+    {
+        slot = &ring[pos & (RingSize - 1)];
+        const int64_t diff = (int64_t)(slot->seq.load(std::memory_order_acquire) - pos);
+        if (diff == 0) {
+            if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0) {
+            // full, the reader is more than a ring behind
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        else {
+            pos = head.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->event = { begin, end, stage, threadId() };
+    slot->seq.store(pos + 1, std::memory_order_release);
+}
+
+void Profiler::endFrame()
+{
+    for (;;)
+    {
+        Slot& slot = ring[tail & (RingSize - 1)];
+        if (slot.seq.load(std::memory_order_acquire) != tail + 1)
+            break;
+        const ProfileEvent e = slot.event;
+        slot.seq.store(tail + RingSize, std::memory_order_release);
+        ++tail;
+
+        current[(int)e.stage] += (e.end - e.begin) * 1e-6;
+        if (trace.size() < (size_t)TraceEvents)
+            trace.push_back(e);
+        else
+            trace[traceNext] = e;
+        traceNext = (traceNext + 1) % TraceEvents;
+    }
+
+    float* row = &history[(size_t)(frames % HistoryFrames) * (int)ProfileStage::Count];
+    for (int s = 0; s < (int)ProfileStage::Count; ++s) {
+        row[s] = (float)current[s];
+        current[s] = 0.0;
+    }
+    ++frames;
+}
+
+double Profiler::percentile(ProfileStage stage, double p) const
+{
+    const int n = historyFrames();
+    if (n == 0)
+        return 0.0;
+    sorted.resize(n);
+    for (int f = 0; f < n; ++f)
+        sorted[f] = history[(size_t)f * (int)ProfileStage::Count + (int)stage];
+    const int k = std::clamp((int)(p * (n - 1) + 0.5), 0, n - 1);
+    std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+    return sorted[k];
+}
+
+double Profiler::lastFrame(ProfileStage stage) const
+{
+    if (frames == 0)
+        return 0.0;
+    return history[(size_t)((frames - 1) % HistoryFrames) * (int)ProfileStage::Count + (int)stage];
+}
+
+void Profiler::histogram(ProfileStage stage, double maxMs, int* bins, int count) const
+{
+    std::fill(bins, bins + count, 0);
+    const int n = historyFrames();
+    for (int f = 0; f < n; ++f)
+    {
+        const double ms = history[(size_t)f * (int)ProfileStage::Count + (int)stage];
+        const int b = maxMs > 0.0 ? (int)(ms / maxMs * count) : 0;
+        ++bins[std::min(b, count - 1)];
+    }
+}
+
+bool Profiler::exportChromeTrace(const char* path, std::string& error) const
+{
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        error = std::string("cannot write ") + path;
+        return false;
+    }
+
+    // complete ("X") events in microseconds, oldest first
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    const size_t n = trace.size();
+    const size_t first = n < (size_t)TraceEvents ? 0 : traceNext;
+    for (size_t k = 0; k < n; ++k)
+    {
+        const ProfileEvent& e = trace[(first + k) % n];
+        fprintf(file, "{\"name\":\"%s\",\"cat\":\"nbody\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f},\n",
+            profileStageName(e.stage), e.thread, e.begin * 1e-3, (e.end - e.begin) * 1e-3);
+    }
+    // metadata entry last, so no event needs to know whether it ends the list
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"nbody\"}}\n]}\n");
+
+    const bool ok = fflush(file) == 0 && !ferror(file);
+    fclose(file);
+    if (!ok)
+        error = std::string("write failed: ") + path;
+    return ok;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Stages the frame profiler knows about. Integrate covers a whole physics
+// step, so it includes the force evaluations done inside it.
+enum class ProfileStage : uint8_t { Force, Integrate, TrailUpdate, TrailDraw, BodyDraw, Input, Count };
+
+const char* profileStageName(ProfileStage stage);
+
+struct ProfileEvent
+{
+    int64_t begin, end;  // ns since the profiler was created
+    ProfileStage stage;
+    uint8_t thread;      // small per thread id, in order of the first event
+};
+
+// Frame profiler behind PROFILE_SCOPE.
+//
+// Markers on any thread push events into a fixed size lock-free ring, a full
+// ring drops the event and counts it. Once per frame the render thread calls
+// endFrame(), which drains the ring, sums every stage into one sample of the
+// frame history (p50/p99 come from there) and keeps the raw events for a
+// Chrome trace export (chrome://tracing, ui.perfetto.dev).
+//
+// Markers only exist when NBODY_PROFILE is defined, otherwise PROFILE_SCOPE
+// expands to nothing and no profiler code runs at all. Compiled in but
+// disabled, a marker is one relaxed atomic load.
+class Profiler
+{
+public:
+    static constexpr int RingSize = 1 << 14;
+    static constexpr int HistoryFrames = 240;
+    static constexpr int TraceEvents = 1 << 16;
+
+    static Profiler& instance();
+
+    // Monotonic ns since the profiler was created
+    int64_t now() const;
+
+    bool enabled() const { return on.load(std::memory_order_relaxed); }
+    void setEnabled(bool enable) { on.store(enable, std::memory_order_relaxed); }
+
+    // Any thread, never blocks or allocates
+    void record(ProfileStage stage, int64_t begin, int64_t end);
+
+    // Everything below is for one thread only, the one drawing the overlay
+
+    void endFrame();
+
+    // Milliseconds per frame spent in a stage, over the history, p in [0, 1]
+    double percentile(ProfileStage stage, double p) const;
+    double lastFrame(ProfileStage stage) const;
+    // Frames of the history per bin of maxMs / count, the last bin also takes everything above
+    void histogram(ProfileStage stage, double maxMs, int* bins, int count) const;
+    int historyFrames() const { return frames < HistoryFrames ? (int)frames : HistoryFrames; }
+    long long droppedEvents() const { return dropped.load(std::memory_order_relaxed); }
+
+    // Writes the kept events (the newest TraceEvents) in Chrome's trace event format
+    bool exportChromeTrace(const char* path, std::string& error) const;
+
+private:
+    Profiler();
+
+    struct Slot
+    {
+        std::atomic<uint64_t> seq;
+        ProfileEvent event;
+    };
+
+    std::atomic<bool> on{ false };
+    std::atomic<long long> dropped{ 0 };
+    int64_t epoch;
+
+    // bounded queue, slot seq == position means free, position + 1 means filled
+    std::unique_ptr<Slot[]> ring;
+    std::atomic<uint64_t> head{ 0 };
+    uint64_t tail = 0;
+
+    // frame history, ms per stage
+    std::vector<float> history;
+    long long frames = 0;
+    double current[(int)ProfileStage::Count] = {};
+    mutable std::vector<float> sorted;
+
+    // trace events, a ring of the newest ones
+    std::vector<ProfileEvent> trace;
+    size_t traceNext = 0;
+};
+
+// Records the time between its construction and destruction
+class ProfileScope
+{
+public:
+    explicit ProfileScope(ProfileStage timed)
+        : stage(timed), begin(Profiler::instance().enabled() ? Profiler::instance().now() : -1)
+    {
+    }
+    ~ProfileScope()
+    {
+        if (begin >= 0)
+            Profiler::instance().record(stage, begin, Profiler::instance().now());
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    ProfileStage stage;
+    int64_t begin;
+};
+
+#ifdef NBODY_PROFILE
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(stage) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(ProfileStage::stage)
+#else
+#define PROFILE_SCOPE(stage) ((void)0)
+#endif
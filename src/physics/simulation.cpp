@@ -0,0 +1,479 @@
+#include "simulation.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "profiler.h"
+
+Simulation::Simulation(const BodyState& bodies, double gravitationalConstant,
+    std::unique_ptr<ForceBackend> backend)
+    : X(bodies), G(gravitationalConstant), solver(std::move(backend))
+{
+    assignIds(0);
+}
+
+std::vector<std::pair<int, int>> Simulation::combinations(int N)
+{
+    std::vector<std::pair<int, int>> pairs;
+    for (int i = 0; i < N; ++i) {
+        for (int j = i + 1; j < N; ++j) {
+            pairs.emplace_back(i, j);
+        }
+    }
+    return pairs;
+}
+
+void Simulation::setForceThreads(int n)
+{
+    direct.setThreads(n);
+    if (solver)
+        solver->setThreads(n);
+}
+
+void Simulation::setIntegrator(IntegratorKind k)
+{
+    kind = k;
+    integrator = makeIntegrator(kind);
+    small.invalidate();
+}
+
+void Simulation::setSoftening(const Softening& s)
+{
+    soft = s;
+    direct.setSoftening(s);
+    if (solver)
+        solver->setSoftening(s);
+    invalidate();
+}
+
+void Simulation::setSubcycling(const Subcycling& s)
+{
+    sub = s;
+    neighbors.setRange(s.cutoff, s.skin);
+    invalidate();
+}
+
+bool Simulation::usesSubcycling() const
+{
+    return kind == IntegratorKind::Leapfrog && sub.substeps > 1 && sub.cutoff > 0.0;
+}
+
+bool Simulation::usesFixedKernels() const
+{
+    if (!fixedKernels || solver || direct.precision() != ForcePrecision::Double || soft.enabled()
+        || kind == IntegratorKind::BlockLeapfrog || !SmallSystemStepper::supports(X.size()))
+        return false;
+    // a 3D leapfrog step is one force pass, where the generic AVX2 / AVX-512
+    // rows already run as fast, copying in and out would only add to it
+    return kind == IntegratorKind::RK4 || planar || direct.simdLevel() < SimdLevel::AVX2;
+}
+
+void Simulation::step(double dt)
+{
+    PROFILE_SCOPE(Integrate);
+
+    // cached forces only go stale when there was something to flatten
+    if (planar) {
+        auto nonzero = [](double v) { return v != 0.0; };
+        if (std::any_of(X.z.begin(), X.z.end(), nonzero) || std::any_of(X.vz.begin(), X.vz.end(), nonzero)) {
+            std::fill(X.z.begin(), X.z.end(), 0.0);
+            std::fill(X.vz.begin(), X.vz.end(), 0.0);
+            invalidate();
+        }
+    }
+
+    // the paths cache forces separately, the others' caches are old
+    const StepPath path = usesSubcycling() ? StepPath::Subcycled
+        : usesFixedKernels() ? StepPath::Fixed : StepPath::Generic;
+    if (path != lastPath) {
+        invalidate();
+        lastPath = path;
+    }
+
+    // the potential of X comes out of a force pass over X: RK4 makes one at
+    // the start of a step (k1), the leapfrogs, subcycling and block steps at
+    // the end, where every level is active (an empty block step has none)
+    const bool passAtStart = kind == IntegratorKind::RK4;
+    const bool passAtEnd = kind == IntegratorKind::Leapfrog || kind == IntegratorKind::VelocityVerlet
+        || (kind == IntegratorKind::BlockLeapfrog && X.size() > 0);
+    DiagnosticsSample startSample;
+    const bool sampleStart = diag.due(stepCount) && passAtStart;
+    if (sampleStart)
+        startSample = Diagnostics::measure(X, stepCount, elapsed);
+    else if (diag.due(stepCount))
+        sampleNow();
+    const bool sampleEnd = diag.due(stepCount + 1) && passAtEnd;
+    wantPotential = sampleStart || sampleEnd;
+    havePotential = false;
+
+    if (path == StepPath::Fixed) {
+        double* pot = nullptr;
+        if (wantPotential) {
+            potential.resize(X.size());
+            pot = potential.data();
+            havePotential = true;
+        }
+        small.step(X, G, dt, kind, planar, pot);
+    }
+    else if (path == StepPath::Subcycled) {
+        stepSubcycled(dt);
+    }
+    else {
+        auto deriv = [&](const BodyState& S, BodyState& Sdot) {
+            derivative(S, Sdot);
+        };
+        auto subset = [&](const BodyState& S, const int* targets, int count, double* ax, double* ay, double* az) {
+            accelerationsFor(S, targets, count, ax, ay, az);
+        };
+        integrator->advance(X, dt, deriv, subset);
+    }
+    wantPotential = false;
+
+    ++stepCount;
+    elapsed += dt;
+
+    if (sampleStart || sampleEnd) {
+        assert(havePotential);
+        DiagnosticsSample s = sampleStart ? startSample : Diagnostics::measure(X, stepCount, elapsed);
+        s.potential = Diagnostics::potentialEnergy(X, potential.data());
+        diag.add(s);
+    }
+    else if (diag.due(stepCount) && !passAtStart) {
+        sampleNow();
+    }
+}
+
+void Simulation::finishDiagnostics()
+{
+    if (diag.due(stepCount))
+        sampleNow();
+}
+
+void Simulation::sampleNow()
+{
+    sampleDot.resize(X.size());
+    wantPotential = true;
+    derivative(X, sampleDot);
+    wantPotential = false;
+
+    DiagnosticsSample s = Diagnostics::measure(X, stepCount, elapsed);
+    s.potential = Diagnostics::potentialEnergy(X, potential.data());
+    diag.add(s);
+}
+
+void Simulation::reset(const BodyState& state, double gravity, double time, long long steps)
+{
+    for (int id : bodyIds)
+        slotOfId[id] = -1;
+    bodyIds.clear();
+
+    X = state;
+    G = gravity;
+    elapsed = time;
+    stepCount = steps;
+    diag.clear();
+    assignIds(0);
+    unchanged.clear();
+    bodiesChanged(unchanged);
+}
+
+void Simulation::assignIds(size_t from)
+{
+    for (size_t i = from; i < X.size(); ++i) {
+        bodyIds.push_back(slotOfId.size());
+        slotOfId.push_back(i);
+    }
+}
+
+void Simulation::addBodies(const BodyState& bodies)
+{
+    const size_t from = X.size();
+    X.reserve(from + bodies.size());
+    for (size_t i = 0; i < bodies.size(); ++i)
+        X.push_back(bodies.x[i], bodies.y[i], bodies.z[i], bodies.vx[i], bodies.vy[i], bodies.vz[i], bodies.mass[i]);
+    assignIds(from);
+    unchanged.resize(from);
+    for (size_t i = 0; i < from; ++i)
+        unchanged[i] = i;
+    bodiesChanged(unchanged);
+}
+
+void Simulation::addBody(double px, double py, double pz, double pvx, double pvy, double pvz, double m)
+{
+    X.push_back(px, py, pz, pvx, pvy, pvz, m);
+    assignIds(X.size() - 1);
+    unchanged.resize(X.size() - 1);
+    for (size_t i = 0; i + 1 < X.size(); ++i)
+        unchanged[i] = i;
+    bodiesChanged(unchanged);
+}
+
+void Simulation::removeBodies(const std::vector<int>& ids, std::vector<int>& kept)
+{
+    const int N = X.size();
+    dropping.assign(N, 0);
+    for (int id : ids) {
+        const int i = indexOf(id);
+        if (i >= 0)
+            dropping[i] = 1;
+    }
+
+    kept.clear();
+    for (int i = 0; i < N; ++i) {
+        if (dropping[i])
+            slotOfId[bodyIds[i]] = -1;
+        else
+            kept.push_back(i);
+    }
+    if ((int)kept.size() == N)
+        return;
+
+    X.keep(kept);
+    keepBodies(bodyIds, kept);
+    for (int k = 0; k < (int)kept.size(); ++k)
+        slotOfId[bodyIds[k]] = k;
+    bodiesChanged(kept);
+}
+
+void Simulation::invalidate()
+{
+    integrator->invalidate();
+    small.invalidate();
+    splitValid = false;
+}
+
+void Simulation::bodiesChanged(const std::vector<int>& kept)
+{
+    integrator->bodiesChanged(kept);
+    small.invalidate();
+    splitValid = false;
+}
+
+void Simulation::stepSubcycled(double dt)
+{
+    const size_t N = X.size();
+    if (farAcc.size() != N) {
+        farAcc.resize(N);
+        closeAcc.resize(N);
+        splitValid = false;
+    }
+    // farAcc = every force - the close part, both of the current state
+    auto split = [&]() {
+        derivative(X, farAcc);
+        for (size_t i = 0; i < N; ++i) {
+            farAcc.vx[i] -= closeAcc.vx[i];
+            farAcc.vy[i] -= closeAcc.vy[i];
+            farAcc.vz[i] -= closeAcc.vz[i];
+        }
+    };
+    auto kick = [&](const BodyState& A, double h) {
+        for (size_t i = 0; i < N; ++i) {
+            X.vx[i] += A.vx[i] * h;
+            X.vy[i] += A.vy[i] * h;
+            X.vz[i] += A.vz[i] * h;
+        }
+    };
+
+    if (!splitValid) {
+        closeAccelerations(X, closeAcc);
+        split();
+        splitValid = true;
+    }
+
+    kick(farAcc, dt / 2);
+    const double h = dt / sub.substeps;
+    for (int k = 0; k < sub.substeps; ++k)
+    {
+        kick(closeAcc, h / 2);
+        for (size_t i = 0; i < N; ++i) {
+            X.x[i] += X.vx[i] * h;
+            X.y[i] += X.vy[i] * h;
+            X.z[i] += X.vz[i] * h;
+        }
+        closeAccelerations(X, closeAcc);
+        kick(closeAcc, h / 2);
+    }
+    split();
+    kick(farAcc, dt / 2);
+}
+
+// K(r) = 1 up to cutoff / 2, then 1 - x^3 (10 - 15 x + 6 x^2) down to 0 at
+// the cutoff, x going 0 to 1 in between: twice continuously differentiable,
+// so the split does not add energy error of its own
+void Simulation::closeAccelerations(const BodyState& S, BodyState& Acc)
+{
+    PROFILE_SCOPE(Force);
+
+    const size_t N = S.size();
+    std::fill(Acc.vx.begin(), Acc.vx.end(), 0.0);
+    std::fill(Acc.vy.begin(), Acc.vy.end(), 0.0);
+    std::fill(Acc.vz.begin(), Acc.vz.end(), 0.0);
+    if (N < 2)
+        return;
+
+    neighbors.update(S, planar);
+    const double outer = sub.cutoff, inner = 0.5 * sub.cutoff;
+    for (const auto& [i, j] : neighbors.pairs())
+    {
+        const double dx = S.x[j] - S.x[i], dy = S.y[j] - S.y[i], dz = S.z[j] - S.z[i];
+        const double r2 = dx * dx + dy * dy + dz * dz;
+        if (r2 >= outer * outer || (r2 == 0.0 && !soft.enabled()))
+            continue;
+
+        double K = 1.0;
+        const double r = std::sqrt(r2);
+        if (r > inner) {
+            const double x = (r - inner) / (outer - inner);
+            K = 1.0 - x * x * x * (10.0 + x * (-15.0 + 6.0 * x));
+        }
+        const double s = G * K * soft.forceFactor(r2);
+        Acc.vx[i] += s * S.mass[j] * dx; Acc.vy[i] += s * S.mass[j] * dy; Acc.vz[i] += s * S.mass[j] * dz;
+        Acc.vx[j] -= s * S.mass[i] * dx; Acc.vy[j] -= s * S.mass[i] * dy; Acc.vz[j] -= s * S.mass[i] * dz;
+    }
+}
+
+void Simulation::accelerationsFor(const BodyState& S, const int* targets, int count,
+    double* ax, double* ay, double* az)
+{
+    PROFILE_SCOPE(Force);
+
+    if (solver) {
+        solver->setPlanar(planar);
+        solver->accelerationsFor(S, G, targets, count, ax, ay, az);
+    }
+    else {
+        direct.accelerationsFor(S, G, targets, count, ax, ay, az);
+    }
+}
+
+void Simulation::derivative(const BodyState& S, BodyState& Sdot)
+{
+    PROFILE_SCOPE(Force);
+
+    // the diagnostics want the potential of X, passes over stages are left alone
+    double* pot = nullptr;
+    if (wantPotential && &S == &X) {
+        potential.resize(S.size());
+        pot = potential.data();
+        havePotential = true;
+    }
+
+    if (solver) {
+        Sdot.x = S.vx;
+        Sdot.y = S.vy;
+        Sdot.z = S.vz;
+        solver->setPlanar(planar);
+        if (pot)
+            solver->accelerationsWithPotential(S, G, Sdot.vx.data(), Sdot.vy.data(), Sdot.vz.data(), pot);
+        else
+            solver->accelerations(S, G, Sdot.vx.data(), Sdot.vy.data(), Sdot.vz.data());
+        return;
+    }
+
+    if (direct.threads() > 1 || direct.simdLevel() != SimdLevel::Scalar || direct.precision() != ForcePrecision::Double) {
+        Sdot.x = S.vx;
+        Sdot.y = S.vy;
+        Sdot.z = S.vz;
+        if (pot)
+            direct.accelerationsWithPotential(S, G, Sdot.vx.data(), Sdot.vy.data(), Sdot.vz.data(), pot);
+        else
+            direct.accelerations(S, G, Sdot.vx.data(), Sdot.vy.data(), Sdot.vz.data());
+        return;
+    }
+
+    if (planar) {
+        if (pot)
+            pairLoop<2, true>(S, Sdot, pot);
+        else
+            pairLoop<2, false>(S, Sdot, nullptr);
+    }
+    else {
+        if (pot)
+            pairLoop<3, true>(S, Sdot, pot);
+        else
+            pairLoop<3, false>(S, Sdot, nullptr);
+    }
+}
+
+// The original pair loop, every pair once, Newton's third law for the partner.
+// The pairs are visited as combinations() lists them, without storing the
+// N^2 / 2 list, so adding or removing bodies costs nothing here. In 2D the z
+// terms are left out, they are all zero, so the result is the same. With
+// Potential the pair's potential goes to both ends as well, the forces keep
+// their bits.
+template <int Dim, bool Potential>
+void Simulation::pairLoop(const BodyState& S, BodyState& Sdot, double* pot) const
+{
+    const int N = S.size();
+    const double* x = S.x.data();
+    const double* y = S.y.data();
+    const double* z = S.z.data();
+    const double* m = S.mass.data();
+    double* ax = Sdot.vx.data();
+    double* ay = Sdot.vy.data();
+    double* az = Sdot.vz.data();
+
+    for (int i = 0; i < N; ++i) {
+        Sdot.x[i] = S.vx[i];
+        Sdot.y[i] = S.vy[i];
+        Sdot.z[i] = S.vz[i];
+        ax[i] = ay[i] = az[i] = 0.0;
+        if constexpr (Potential)
+            pot[i] = 0.0;
+    }
+
+    // softened pairs take the factor form, the original bits stay unsoftened
+    const bool softened = soft.enabled();
+    for (int i = 0; i < N; ++i)
+    {
+        for (int j = i + 1; j < N; ++j)
+        {
+            double dx = x[j] - x[i];
+            double dy = y[j] - y[i];
+            double r_squared = dx * dx + dy * dy;
+            double dz = 0.0;
+            if constexpr (Dim == 3) {
+                dz = z[j] - z[i];
+                r_squared += dz * dz;
+            }
+            if (softened) {
+                const double s = G * soft.forceFactor(r_squared);
+                ax[i] += s * m[j] * dx; ay[i] += s * m[j] * dy;
+                ax[j] -= s * m[i] * dx; ay[j] -= s * m[i] * dy;
+                if constexpr (Dim == 3) {
+                    az[i] += s * m[j] * dz;
+                    az[j] -= s * m[i] * dz;
+                }
+                if constexpr (Potential) {
+                    const double phi = G * soft.potentialFactor(r_squared);
+                    pot[i] += phi * m[j];
+                    pot[j] += phi * m[i];
+                }
+                continue;
+            }
+
+            double r = std::sqrt(r_squared);
+            double force_magnitude = G * m[i] * m[j] / r_squared;
+
+            double fx = force_magnitude * dx / r;
+            double fy = force_magnitude * dy / r;
+
+            ax[i] += fx / m[i];
+            ay[i] += fy / m[i];
+
+            ax[j] -= fx / m[j];
+            ay[j] -= fy / m[j];
+
+            if constexpr (Dim == 3) {
+                double fz = force_magnitude * dz / r;
+                az[i] += fz / m[i];
+                az[j] -= fz / m[j];
+            }
+            if constexpr (Potential) {
+                pot[i] -= G * m[j] / r;
+                pot[j] -= G * m[i] / r;
+            }
+        }
+    }
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "body_state.h"
+#include "diagnostics.h"
+#include "force_backend.h"
+#include "gravity.h"
+#include "integrator.h"
+#include "neighbor_list.h"
+#include "small_system.h"
+#include "softening.h"
+
+// Close pairs on a finer step, for dense scenes that would otherwise need a
+// tiny global dt. See Simulation::setSubcycling().
+struct Subcycling
+{
+    double cutoff = 0.0; // pairs closer than this are split off
+    double skin = 0.0;   // of the neighbor list, rebuilt every ~skin / 2 of motion
+    int substeps = 1;    // close steps per step, 1 is off
+};
+
+// The physics of a scene: bodies, force evaluation and the integrator, with
+// nothing of rendering or input. The window app wraps it in NbodySimulation,
+// the headless runner drives it directly.
+class Simulation
+{
+public:
+    // backend replaces the pair list in derivative(), e.g. make_unique<BarnesHutGravity>(0.5)
+    Simulation(const BodyState& bodies, double gravitationalConstant,
+        std::unique_ptr<ForceBackend> backend = nullptr);
+
+    const BodyState& state() const { return X; }
+    // Changing bodies in place has to be followed by invalidate(), the body
+    // count only changes through addBodies() and removeBodies()
+    BodyState& state() { return X; }
+    int size() const { return X.size(); }
+
+    // Stable body ids: a body keeps its id while others come and go, ids are
+    // never reused. ids()[i] is the id of body i, ascending, since new bodies
+    // are appended and removals keep the order.
+    const std::vector<int>& ids() const { return bodyIds; }
+    // Current index of a body, -1 once it is gone
+    int indexOf(int id) const { return id >= 0 && id < (int)slotOfId.size() ? slotOfId[id] : -1; }
+
+    double gravity() const { return G; }
+    long long steps() const { return stepCount; }
+    double time() const { return elapsed; }
+
+    // Planar mode: z and vz are zeroed before every step
+    void setPlanar(bool on) { planar = on; }
+    bool isPlanar() const { return planar; }
+
+    //Threads and SIMD level of the force evaluation, 1 thread + scalar keeps the serial pair loop
+    void setForceThreads(int n);
+    int forceThreads() const { return direct.threads(); }
+    void setForceSimd(SimdLevel level)
+    {
+        direct.setSimdLevel(level);
+        small.setSimdLevel(level);
+    }
+    // Mixed runs the direct summation in float with double sums, solvers are not affected
+    void setForcePrecision(ForcePrecision p) { direct.setPrecision(p); }
+    ForcePrecision forcePrecision() const { return direct.precision(); }
+
+    void setIntegrator(IntegratorKind kind);
+    const Integrator& activeIntegrator() const { return *integrator; }
+
+    // Softening of every force evaluation, the solvers soften their pair
+    // terms. Off by default, the unsoftened paths keep their bits.
+    void setSoftening(const Softening& s);
+    const Softening& softening() const { return soft; }
+
+    // Leapfrog only: every pair force is split with a smooth changeover that
+    // goes from 1 at cutoff / 2 to 0 at cutoff. The close part kicks on
+    // substeps KDK substeps per step, the far part (every force minus the
+    // close ones) once per step around them. This is the r-RESPA splitting,
+    // still symplectic, and costs one full force evaluation per step plus
+    // substeps passes over the neighbor list.
+    void setSubcycling(const Subcycling& s);
+    const Subcycling& subcycling() const { return sub; }
+    bool usesSubcycling() const;
+    // Rebuilds so far, for overlays and benchmarks
+    long long neighborRebuilds() const { return neighbors.rebuilds(); }
+
+    // Up to SmallSystemMax bodies, direct double forces and no solver, RK4 and
+    // the leapfrogs step through SmallSystemStepper, specialized on the body
+    // count and on 2D / 3D. On by default; 3D leapfrogs keep the generic path
+    // when it has AVX2 or AVX-512 rows, softened runs always do.
+    void setFixedKernels(bool on) { fixedKernels = on; }
+    bool usesFixedKernels() const;
+
+    // Advances every body by dt with the active integrator
+    void step(double dt);
+
+    // Energy, momentum, angular momentum and centre of mass of the state after
+    // every `steps` steps, 0 is off. The potential is summed by the force pass
+    // over the sampled state itself: RK4 makes it at the start of the next
+    // step, the leapfrogs, subcycling and block timesteps at the end of the
+    // step, only on steps that are sampled, on the fixed small-system kernels
+    // as well.
+    void setDiagnosticsInterval(int steps) { diag.setInterval(steps); }
+    Diagnostics& diagnostics() { return diag; }
+    const Diagnostics& diagnostics() const { return diag; }
+    // Samples the current state if it is due and was not yet, with a force
+    // evaluation of its own (a run that ends on RK4 has that sample pending)
+    void finishDiagnostics();
+
+    // Replaces every body and sets the clock, e.g. from a loaded snapshot.
+    // The new bodies get new ids.
+    void reset(const BodyState& state, double G, double time = 0.0, long long steps = 0);
+
+    // Appends bodies, the new ones get the next ids. O(added), nothing is
+    // rebuilt for the bodies already there.
+    void addBodies(const BodyState& bodies);
+    void addBody(double px, double py, double pz, double pvx, double pvy, double pvz, double m);
+
+    // Removes the bodies with the given ids, unknown ids are ignored, the rest
+    // keep their order. kept[k] is the old index of body k afterwards, for
+    // arrays kept next to the state (keepBodies()). O(N) per batch.
+    void removeBodies(const std::vector<int>& ids, std::vector<int>& kept);
+
+    // Has to be called after the state was edited through state()
+    void invalidate();
+
+    // Xdot has to be sized like X, it is filled in place:
+    // positions get the velocities, velocities the accelerations
+    void derivative(const BodyState& X, BodyState& Xdot);
+    // Accelerations of the bodies targets[0..count) only
+    void accelerationsFor(const BodyState& X, const int* targets, int count, double* ax, double* ay, double* az);
+
+    // Every pair i < j in the order the pair loop visits them
+    static std::vector<std::pair<int, int>> combinations(int N);
+
+private:
+    enum class StepPath { Generic, Fixed, Subcycled };
+
+    void assignIds(size_t from);
+    // invalidate() after bodies came or went, kept as in removeBodies()
+    void bodiesChanged(const std::vector<int>& kept);
+    template <int Dim, bool Potential>
+    void pairLoop(const BodyState& S, BodyState& Sdot, double* pot) const;
+    void stepSubcycled(double dt);
+    // accelerations of the close part of every listed pair, into Acc.vx/vy/vz
+    void closeAccelerations(const BodyState& S, BodyState& Acc);
+    // a sample of X through a force evaluation of its own
+    void sampleNow();
+
+    BodyState X;
+    double G;
+    bool planar = false;
+    long long stepCount = 0;
+    double elapsed = 0.0;
+
+    std::vector<int> bodyIds;
+    std::vector<int> slotOfId;  // index of every id ever handed out, -1 when removed
+    std::vector<char> dropping;
+    std::vector<int> unchanged; // 0, 1, ... for the bodies before an add
+    IntegratorKind kind = IntegratorKind::RK4;
+    std::unique_ptr<Integrator> integrator = makeIntegrator(kind);
+    bool fixedKernels = true;
+    StepPath lastPath = StepPath::Generic;
+    SmallSystemStepper small;
+    Softening soft;
+    Subcycling sub;
+    NeighborList neighbors;
+    BodyState farAcc, closeAcc; // accelerations in vx/vy/vz, like CachedForceStepper
+    bool splitValid = false;
+    DirectGravity direct;
+    std::unique_ptr<ForceBackend> solver;
+
+    Diagnostics diag;
+    bool wantPotential = false;    // derivative() of X fills potential
+    bool havePotential = false;
+    std::vector<double> potential;
+    BodyState sampleDot;
+};
@@ -0,0 +1,54 @@
+#include "simulation_thread.h"
+
+void SimulationThread::start(std::function<void()> f)
+{
+    stop();
+    tick = std::move(f);
+    running = true;
+    worker = std::thread([this] { loop(); });
+}
+
+void SimulationThread::stop()
+{
+    running = false;
+    if (worker.joinable())
+        worker.join();
+}
+
+void SimulationThread::post(std::function<void()> f)
+{
+    std::lock_guard<std::mutex> lock(m);
+    pending.push_back(std::move(f));
+}
+
+void SimulationThread::loop()
+{
+    auto next = Clock::now();
+
+    while (running)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            draining.swap(pending);
+        }
+        for (auto& f : draining)
+            f();
+        draining.clear();
+
+        const auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / rate.load()));
+        int done = 0;
+        while (Clock::now() >= next && done < MaxCatchUp) {
+            tick();
+            next += period;
+            ++done;
+            ++tickCount;
+        }
+        if (Clock::now() >= next) {
+            // still behind: give up on the backlog
+            dropped += (Clock::now() - next) / period + 1;
+            next = Clock::now() + period;
+        }
+
+        std::this_thread::sleep_until(next);
+    }
+}
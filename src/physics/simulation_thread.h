@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Calls a tick function at a fixed rate on its own thread.
+// The owner hands over its state once start() is called: everything the tick
+// touches must then only be changed through post(), which queues a function
+// to run on the simulation thread before the next tick. Results go back via
+// a TripleBuffer filled from the tick.
+//
+// A tick that falls behind is caught up, at most MaxCatchUp ticks in a row,
+// after that the backlog is dropped so a slow machine runs the simulation
+// slower instead of locking up.
+class SimulationThread
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit SimulationThread(double tickRate = 120.0)
+    {
+        setTickRate(tickRate);
+    }
+
+    ~SimulationThread()
+    {
+        stop();
+    }
+
+    SimulationThread(const SimulationThread&) = delete;
+    SimulationThread& operator=(const SimulationThread&) = delete;
+
+    void start(std::function<void()> tick);
+    void stop();
+
+    // Ticks per second of wall time
+    double tickRate() const { return rate.load(); }
+    void setTickRate(double hz) { rate.store(hz > 0.0 ? hz : 1.0); }
+
+    // Runs f on the simulation thread before the next tick
+    void post(std::function<void()> f);
+
+    long long ticks() const { return tickCount.load(); }
+    long long droppedTicks() const { return dropped.load(); }
+
+    // Wall clock in seconds, the time base snapshots are stamped with
+    static double now() { return std::chrono::duration<double>(Clock::now().time_since_epoch()).count(); }
+
+    static constexpr int MaxCatchUp = 8;
+
+private:
+    void loop();
+
+    std::function<void()> tick;
+    std::thread worker;
+    std::atomic<bool> running{ false };
+    std::atomic<double> rate{ 120.0 };
+    std::atomic<long long> tickCount{ 0 };
+    std::atomic<long long> dropped{ 0 };
+
+    // commands, the lock is only held to push or swap the queue
+    std::mutex m;
+    std::vector<std::function<void()>> pending, draining;
+};
@@ -0,0 +1,491 @@
+#include "small_system.h"
+
+#include <array>
+#include <cmath>
+#include <utility>
+
+#include "simd_target.h"
+
+namespace
+{
+    // (i, j) of every pair i < j, in the order of Simulation::combinations()
+    template <int N>
+    struct PairTable
+    {
+        static constexpr int Count = N * (N - 1) / 2;
+        int i[Count > 0 ? Count : 1];
+        int j[Count > 0 ? Count : 1];
+
+        constexpr PairTable()
+            : i(), j()
+        {
+            int k = 0;
+            for (int a = 0; a < N; ++a)
+                for (int b = a + 1; b < N; ++b) {
+                    i[k] = a;
+                    j[k] = b;
+                    ++k;
+                }
+        }
+    };
+
+    template <int N>
+    constexpr PairTable<N> PairsOf{};
+
+    using CacheRows = double (*)[SmallSystemMax];
+
+    template <int Dim, int N>
+    struct Fixed
+    {
+        // the widest register blocks that fit: rows [0, Rows8) in AVX-512
+        // registers, [Rows8, Rows4) in AVX2 ones, [Rows4, Rows2) in SSE2 ones,
+        // the rest one row at a time
+        static constexpr int Rows8 = N / 8 * 8;
+        static constexpr int Rows4 = N / 4 * 4;
+        static constexpr int Rows2 = N / 2 * 2;
+
+        using Vec = std::array<double, N>;
+        using Coords = std::array<Vec, Dim>;
+
+        // a state, or its derivative: pos gets the velocities, vel the accelerations
+        struct State
+        {
+            Coords pos, vel;
+        };
+
+        struct Masses
+        {
+            Vec m, gm;
+            double G;
+            SimdLevel level;
+        };
+
+        // Simulation's serial pair loop, same operations in the same order,
+        // with Potential its potential too
+        template <int I, int J, bool Potential>
+        static void pair(const Coords& p, const Masses& M, Coords& a, double* pot)
+        {
+            double d[Dim];
+            for (int c = 0; c < Dim; ++c)
+                d[c] = p[c][J] - p[c][I];
+            double r_squared = d[0] * d[0];
+            for (int c = 1; c < Dim; ++c)
+                r_squared += d[c] * d[c];
+            const double r = std::sqrt(r_squared);
+            const double force_magnitude = M.G * M.m[I] * M.m[J] / r_squared;
+
+            for (int c = 0; c < Dim; ++c) {
+                const double f = force_magnitude * d[c] / r;
+                a[c][I] += f / M.m[I];
+                a[c][J] -= f / M.m[J];
+            }
+            if constexpr (Potential) {
+                pot[I] -= M.G * M.m[J] / r;
+                pot[J] -= M.G * M.m[I] / r;
+            }
+        }
+
+        // rows [Begin, N) like DirectGravity::accelerationOf()
+        template <int Begin, bool Potential>
+        static void rowsScalar(const Coords& p, const Masses& M, Coords& a, double* pot)
+        {
+            for (int i = Begin; i < N; ++i)
+            {
+                double acc[Dim] = {};
+                double phi = 0.0;
+                for (int j = 0; j < N; ++j)
+                {
+                    if (j == i)
+                        continue;
+                    double d[Dim];
+                    for (int c = 0; c < Dim; ++c)
+                        d[c] = p[c][j] - p[c][i];
+                    double r_squared = d[0] * d[0];
+                    for (int c = 1; c < Dim; ++c)
+                        r_squared += d[c] * d[c];
+                    const double inv_r = 1.0 / std::sqrt(r_squared);
+                    const double s = M.gm[j] * inv_r * inv_r * inv_r;
+                    for (int c = 0; c < Dim; ++c)
+                        acc[c] += s * d[c];
+                    if constexpr (Potential)
+                        phi -= M.gm[j] * inv_r;
+                }
+                for (int c = 0; c < Dim; ++c)
+                    a[c][i] = acc[c];
+                if constexpr (Potential)
+                    pot[i] = phi;
+            }
+        }
+
+        template <bool Potential, size_t... K>
+        static void pairs(const Coords& p, const Masses& M, Coords& a, double* pot, std::index_sequence<K...>)
+        {
+            for (int c = 0; c < Dim; ++c)
+                a[c].fill(0.0);
+            if constexpr (Potential) {
+                for (int i = 0; i < N; ++i)
+                    pot[i] = 0.0;
+            }
+            (pair<PairsOf<N>.i[K], PairsOf<N>.j[K], Potential>(p, M, a, pot), ...);
+        }
+
+#if defined(NBODY_X86)
+        // Row kernels as in gravity_simd.cpp: every row sums all N sources,
+        // 1 / r from sqrt and divide with SSE2 and AVX2, from the hardware
+        // estimate and two Newton steps with AVX-512. With Potential -gm / r
+        // goes to pot next to the accelerations.
+        template <int Begin, int End, bool Potential>
+        TARGET_SSE2
+        static void rowsSSE2(const Coords& p, const Masses& M, Coords& a, double* pot)
+        {
+            const __m128d one = _mm_set1_pd(1.0);
+            const __m128d zero = _mm_setzero_pd();
+
+            for (int b = Begin; b < End; b += 2)
+            {
+                __m128d pi[Dim], acc[Dim], phi = zero;
+                for (int c = 0; c < Dim; ++c) {
+                    pi[c] = _mm_loadu_pd(p[c].data() + b);
+                    acc[c] = zero;
+                }
+                for (int j = 0; j < N; ++j)
+                {
+                    __m128d d[Dim];
+                    for (int c = 0; c < Dim; ++c)
+                        d[c] = _mm_sub_pd(_mm_set1_pd(p[c][j]), pi[c]);
+                    __m128d r2 = _mm_mul_pd(d[0], d[0]);
+                    for (int c = 1; c < Dim; ++c)
+                        r2 = _mm_add_pd(r2, _mm_mul_pd(d[c], d[c]));
+
+                    __m128d inv = _mm_div_pd(one, _mm_sqrt_pd(r2));
+                    inv = _mm_and_pd(inv, _mm_cmpgt_pd(r2, zero));
+
+                    const __m128d gm = _mm_set1_pd(M.gm[j]);
+                    __m128d s = _mm_mul_pd(gm, _mm_mul_pd(inv, _mm_mul_pd(inv, inv)));
+                    for (int c = 0; c < Dim; ++c)
+                        acc[c] = _mm_add_pd(acc[c], _mm_mul_pd(s, d[c]));
+                    if constexpr (Potential)
+                        phi = _mm_sub_pd(phi, _mm_mul_pd(gm, inv));
+                }
+                for (int c = 0; c < Dim; ++c)
+                    _mm_storeu_pd(a[c].data() + b, acc[c]);
+                if constexpr (Potential)
+                    _mm_storeu_pd(pot + b, phi);
+            }
+        }
+
+        template <int Begin, int End, bool Potential>
+        TARGET_AVX2
+        static void rowsAVX2(const Coords& p, const Masses& M, Coords& a, double* pot)
+        {
+            const __m256d one = _mm256_set1_pd(1.0);
+            const __m256d zero = _mm256_setzero_pd();
+
+            for (int b = Begin; b < End; b += 4)
+            {
+                __m256d pi[Dim], acc[Dim], phi = zero;
+                for (int c = 0; c < Dim; ++c) {
+                    pi[c] = _mm256_loadu_pd(p[c].data() + b);
+                    acc[c] = zero;
+                }
+                for (int j = 0; j < N; ++j)
+                {
+                    __m256d d[Dim];
+                    for (int c = 0; c < Dim; ++c)
+                        d[c] = _mm256_sub_pd(_mm256_set1_pd(p[c][j]), pi[c]);
+                    __m256d r2 = _mm256_mul_pd(d[0], d[0]);
+                    for (int c = 1; c < Dim; ++c)
+                        r2 = _mm256_fmadd_pd(d[c], d[c], r2);
+
+                    __m256d inv = _mm256_div_pd(one, _mm256_sqrt_pd(r2));
+                    inv = _mm256_and_pd(inv, _mm256_cmp_pd(r2, zero, _CMP_GT_OQ));
+
+                    const __m256d gm = _mm256_set1_pd(M.gm[j]);
+                    __m256d s = _mm256_mul_pd(gm, _mm256_mul_pd(inv, _mm256_mul_pd(inv, inv)));
+                    for (int c = 0; c < Dim; ++c)
+                        acc[c] = _mm256_fmadd_pd(s, d[c], acc[c]);
+                    if constexpr (Potential)
+                        phi = _mm256_fnmadd_pd(gm, inv, phi);
+                }
+                for (int c = 0; c < Dim; ++c)
+                    _mm256_storeu_pd(a[c].data() + b, acc[c]);
+                if constexpr (Potential)
+                    _mm256_storeu_pd(pot + b, phi);
+            }
+        }
+
+        template <int Begin, int End, bool Potential>
+        TARGET_AVX512
+        static void rowsAVX512(const Coords& p, const Masses& M, Coords& a, double* pot)
+        {
+            const __m512d half = _mm512_set1_pd(0.5);
+            const __m512d threeHalves = _mm512_set1_pd(1.5);
+            const __m512d zero = _mm512_setzero_pd();
+
+            for (int b = Begin; b < End; b += 8)
+            {
+                __m512d pi[Dim], acc[Dim], phi = zero;
+                for (int c = 0; c < Dim; ++c) {
+                    pi[c] = _mm512_loadu_pd(p[c].data() + b);
+                    acc[c] = zero;
+                }
+                for (int j = 0; j < N; ++j)
+                {
+                    __m512d d[Dim];
+                    for (int c = 0; c < Dim; ++c)
+                        d[c] = _mm512_sub_pd(_mm512_set1_pd(p[c][j]), pi[c]);
+                    __m512d r2 = _mm512_mul_pd(d[0], d[0]);
+                    for (int c = 1; c < Dim; ++c)
+                        r2 = _mm512_fmadd_pd(d[c], d[c], r2);
+
+                    __mmask8 valid = _mm512_cmp_pd_mask(r2, zero, _CMP_GT_OQ);
+                    __m512d inv = _mm512_maskz_rsqrt14_pd(valid, r2);
+                    __m512d hr2 = _mm512_mul_pd(half, r2);
+                    inv = _mm512_mul_pd(inv, _mm512_fnmadd_pd(hr2, _mm512_mul_pd(inv, inv), threeHalves));
+                    inv = _mm512_mul_pd(inv, _mm512_fnmadd_pd(hr2, _mm512_mul_pd(inv, inv), threeHalves));
+
+                    const __m512d gm = _mm512_set1_pd(M.gm[j]);
+                    __m512d s = _mm512_mul_pd(gm, _mm512_mul_pd(inv, _mm512_mul_pd(inv, inv)));
+                    for (int c = 0; c < Dim; ++c)
+                        acc[c] = _mm512_fmadd_pd(s, d[c], acc[c]);
+                    if constexpr (Potential)
+                        phi = _mm512_fnmadd_pd(gm, inv, phi);
+                }
+                for (int c = 0; c < Dim; ++c)
+                    _mm512_storeu_pd(a[c].data() + b, acc[c]);
+                if constexpr (Potential)
+                    _mm512_storeu_pd(pot + b, phi);
+            }
+        }
+
+        // Rows [Begin, N) one at a time with the sources in the lanes, so a
+        // tail of a few rows costs one or two register iterations each instead
+        // of a scalar pass over all N
+        template <int Begin, bool Potential>
+        TARGET_AVX512
+        static void tailAVX512(const Coords& p, const Masses& M, Coords& a, double* pot)
+        {
+            const __m512d half = _mm512_set1_pd(0.5);
+            const __m512d threeHalves = _mm512_set1_pd(1.5);
+            const __m512d zero = _mm512_setzero_pd();
+
+            for (int i = Begin; i < N; ++i)
+            {
+                __m512d acc[Dim], phi = zero;
+                for (int c = 0; c < Dim; ++c)
+                    acc[c] = zero;
+                for (int b = 0; b < N; b += 8)
+                {
+                    // lanes past N load zeros, their gm = 0 drops them
+                    const __mmask8 lanes = N - b >= 8 ? 0xff : (__mmask8)((1u << (N - b)) - 1);
+                    __m512d d[Dim];
+                    for (int c = 0; c < Dim; ++c)
+                        d[c] = _mm512_sub_pd(_mm512_maskz_loadu_pd(lanes, p[c].data() + b), _mm512_set1_pd(p[c][i]));
+                    __m512d r2 = _mm512_mul_pd(d[0], d[0]);
+                    for (int c = 1; c < Dim; ++c)
+                        r2 = _mm512_fmadd_pd(d[c], d[c], r2);
+
+                    __mmask8 valid = _mm512_cmp_pd_mask(r2, zero, _CMP_GT_OQ);
+                    __m512d inv = _mm512_maskz_rsqrt14_pd(valid, r2);
+                    __m512d hr2 = _mm512_mul_pd(half, r2);
+                    inv = _mm512_mul_pd(inv, _mm512_fnmadd_pd(hr2, _mm512_mul_pd(inv, inv), threeHalves));
+                    inv = _mm512_mul_pd(inv, _mm512_fnmadd_pd(hr2, _mm512_mul_pd(inv, inv), threeHalves));
+
+                    const __m512d gm = _mm512_maskz_loadu_pd(lanes, M.gm.data() + b);
+                    __m512d s = _mm512_mul_pd(gm, _mm512_mul_pd(inv, _mm512_mul_pd(inv, inv)));
+                    for (int c = 0; c < Dim; ++c)
+                        acc[c] = _mm512_fmadd_pd(s, d[c], acc[c]);
+                    if constexpr (Potential)
+                        phi = _mm512_fnmadd_pd(gm, inv, phi);
+                }
+                // through memory, GCC's _mm512_reduce_add_pd trips -Wuninitialized
+                alignas(64) double lanes[8];
+                for (int c = 0; c < Dim; ++c) {
+                    _mm512_store_pd(lanes, acc[c]);
+                    a[c][i] = ((lanes[0] + lanes[4]) + (lanes[1] + lanes[5])) + ((lanes[2] + lanes[6]) + (lanes[3] + lanes[7]));
+                }
+                if constexpr (Potential) {
+                    _mm512_store_pd(lanes, phi);
+                    pot[i] = ((lanes[0] + lanes[4]) + (lanes[1] + lanes[5])) + ((lanes[2] + lanes[6]) + (lanes[3] + lanes[7]));
+                }
+            }
+        }
+#endif
+
+        template <bool Potential>
+        static void accelerations(const Coords& p, const Masses& M, Coords& a, double* pot)
+        {
+#if defined(NBODY_X86)
+            switch (M.level) {
+            case SimdLevel::AVX512:
+                rowsAVX512<0, Rows8, Potential>(p, M, a, pot);
+                if constexpr (N - Rows8 <= 2) {
+                    tailAVX512<Rows8, Potential>(p, M, a, pot);
+                }
+                else {
+                    rowsAVX2<Rows8, Rows4, Potential>(p, M, a, pot);
+                    tailAVX512<Rows4, Potential>(p, M, a, pot);
+                }
+                return;
+            case SimdLevel::AVX2:
+                rowsAVX2<0, Rows4, Potential>(p, M, a, pot);
+                rowsScalar<Rows4, Potential>(p, M, a, pot);
+                return;
+            case SimdLevel::SSE2:
+                rowsSSE2<0, Rows2, Potential>(p, M, a, pot);
+                rowsScalar<Rows2, Potential>(p, M, a, pot);
+                return;
+            default:
+                break;
+            }
+#endif
+            pairs<Potential>(p, M, a, pot, std::make_index_sequence<PairTable<N>::Count>());
+        }
+
+        // the potential into pot[0..N) as well when it is given
+        static void forces(const Coords& p, const Masses& M, Coords& a, double* pot = nullptr)
+        {
+            if (pot)
+                accelerations<true>(p, M, a, pot);
+            else
+                accelerations<false>(p, M, a, nullptr);
+        }
+
+        static void derive(const State& S, const Masses& M, State& Sdot, double* pot = nullptr)
+        {
+            Sdot.pos = S.vel;
+            forces(S.pos, M, Sdot.vel, pot);
+        }
+
+        // t = s + k * h
+        static void stage(const State& s, const State& k, double h, State& t)
+        {
+            for (int c = 0; c < Dim; ++c)
+                for (int i = 0; i < N; ++i) {
+                    t.pos[c][i] = s.pos[c][i] + k.pos[c][i] * h;
+                    t.vel[c][i] = s.vel[c][i] + k.vel[c][i] * h;
+                }
+        }
+
+        // pot gets the potential of the k1 pass, the state at the start
+        static void rk4(State& s, const Masses& M, double dt, double* pot)
+        {
+            State k1, k2, k3, k4, temp;
+            derive(s, M, k1, pot);
+            stage(s, k1, dt / 2, temp);
+            derive(temp, M, k2);
+            stage(s, k2, dt / 2, temp);
+            derive(temp, M, k3);
+            stage(s, k3, dt, temp);
+            derive(temp, M, k4);
+
+            for (int c = 0; c < Dim; ++c)
+                for (int i = 0; i < N; ++i) {
+                    s.pos[c][i] += (k1.pos[c][i] + 2 * k2.pos[c][i] + 2 * k3.pos[c][i] + k4.pos[c][i]) * (dt / 6);
+                    s.vel[c][i] += (k1.vel[c][i] + 2 * k2.vel[c][i] + 2 * k3.vel[c][i] + k4.vel[c][i]) * (dt / 6);
+                }
+        }
+
+        static void leapfrog(State& s, Coords& a, const Masses& M, double dt, double* pot)
+        {
+            const double h = dt / 2;
+            for (int c = 0; c < Dim; ++c)
+                for (int i = 0; i < N; ++i) {
+                    s.vel[c][i] += a[c][i] * h;
+                    s.pos[c][i] += s.vel[c][i] * dt;
+                }
+            forces(s.pos, M, a, pot);
+            for (int c = 0; c < Dim; ++c)
+                for (int i = 0; i < N; ++i)
+                    s.vel[c][i] += a[c][i] * h;
+        }
+
+        static void verlet(State& s, Coords& a, const Masses& M, double dt, double* pot)
+        {
+            const double h = dt * dt / 2;
+            for (int c = 0; c < Dim; ++c)
+                for (int i = 0; i < N; ++i) {
+                    s.pos[c][i] += s.vel[c][i] * dt + a[c][i] * h;
+                    s.vel[c][i] += a[c][i] * (dt / 2);
+                }
+            forces(s.pos, M, a, pot);
+            for (int c = 0; c < Dim; ++c)
+                for (int i = 0; i < N; ++i)
+                    s.vel[c][i] += a[c][i] * (dt / 2);
+        }
+
+        static void run(BodyState& X, double G, double dt, IntegratorKind kind, SimdLevel level,
+            CacheRows cache, bool& valid, double* pot)
+        {
+            double* pos[Dim];
+            double* vel[Dim];
+            for (int c = 0; c < Dim; ++c) {
+                pos[c] = X.component(c).data();
+                vel[c] = X.component(3 + c).data();
+            }
+
+            State s;
+            Masses M;
+            M.G = G;
+            M.level = level;
+            for (int i = 0; i < N; ++i) {
+                for (int c = 0; c < Dim; ++c) {
+                    s.pos[c][i] = pos[c][i];
+                    s.vel[c][i] = vel[c][i];
+                }
+                M.m[i] = X.mass[i];
+                M.gm[i] = G * X.mass[i];
+            }
+
+            if (kind == IntegratorKind::RK4) {
+                rk4(s, M, dt, pot);
+            }
+            else {
+                Coords a;
+                if (valid) {
+                    for (int c = 0; c < Dim; ++c)
+                        for (int i = 0; i < N; ++i)
+                            a[c][i] = cache[c][i];
+                }
+                else {
+                    forces(s.pos, M, a);
+                }
+
+                if (kind == IntegratorKind::VelocityVerlet)
+                    verlet(s, a, M, dt, pot);
+                else
+                    leapfrog(s, a, M, dt, pot);
+
+                // a planar cache has az = 0, so it stays valid when z comes back
+                for (int c = 0; c < 3; ++c)
+                    for (int i = 0; i < N; ++i)
+                        cache[c][i] = c < Dim ? a[c][i] : 0.0;
+                valid = true;
+            }
+
+            for (int c = 0; c < Dim; ++c)
+                for (int i = 0; i < N; ++i) {
+                    pos[c][i] = s.pos[c][i];
+                    vel[c][i] = s.vel[c][i];
+                }
+        }
+    };
+
+    using StepFn = void (*)(BodyState&, double, double, IntegratorKind, SimdLevel, CacheRows, bool&, double*);
+
+    // entry k steps k + 1 bodies
+    template <int Dim, size_t... K>
+    constexpr std::array<StepFn, sizeof...(K)> stepTable(std::index_sequence<K...>)
+    {
+        return { { &Fixed<Dim, (int)K + 1>::run... } };
+    }
+
+    constexpr auto Steps2D = stepTable<2>(std::make_index_sequence<SmallSystemMax>());
+    constexpr auto Steps3D = stepTable<3>(std::make_index_sequence<SmallSystemMax>());
+}
+
+void SmallSystemStepper::step(BodyState& X, double G, double dt, IntegratorKind kind, bool planar, double* pot)
+{
+    const StepFn fn = (planar ? Steps2D : Steps3D)[X.size() - 1];
+    fn(X, G, dt, kind, simd, acc, valid, pot);
+}
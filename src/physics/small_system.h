@@ -0,0 +1,48 @@
+#pragma once
+
+#include "body_state.h"
+#include "gravity_simd.h"
+#include "integrator.h"
+
+// Bodies up to which Simulation steps through the fixed size kernels
+constexpr int SmallSystemMax = 16;
+
+// Integrators specialized at compile time on the dimension (2 or 3) and the
+// body count, for systems the size of the solar system.
+//
+// Every (dimension, N) pair has its own instantiation: the state lives in
+// std::array, every loop has a constant trip count and the 2D one never
+// touches z. step() copies the bodies in, picks the
+// instantiation from a table and copies them back out, which is cheap next to
+// even one force evaluation. Nothing goes through the thread pool, virtual
+// calls or the scalar tail rows of the generic kernels.
+//
+// The forces come from row kernels like DirectGravity's at the chosen SIMD
+// level. With AVX-512 the last few rows put the sources in the lanes instead,
+// below it they go one scalar row at a time. At SimdLevel::Scalar it is Simulation's serial pair loop unrolled
+// over the N(N-1)/2 pairs, same operations in the same order, so a step gives
+// the same bits as the scalar single thread path, 2D included.
+class SmallSystemStepper
+{
+public:
+    static bool supports(int n) { return n >= 1 && n <= SmallSystemMax; }
+
+    // RK4, Leapfrog or VelocityVerlet; planar steps only x and y, z and vz
+    // have to be zero already. With pot the step's full force pass over X
+    // also fills pot[0..N) with the potential, like Simulation's pairLoop():
+    // the k1 pass of RK4, the state before the step, or the closing pass of
+    // the leapfrogs, the state after it. The accelerations keep their bits.
+    void step(BodyState& X, double G, double dt, IntegratorKind kind, bool planar, double* pot = nullptr);
+
+    // Drops the cached accelerations of the leapfrog schemes
+    void invalidate() { valid = false; }
+
+    // Levels above what the CPU supports are clamped to the detected one
+    void setSimdLevel(SimdLevel level) { simd = level < detectSimdLevel() ? level : detectSimdLevel(); }
+
+private:
+    SimdLevel simd = detectSimdLevel();
+    // accelerations at the start of the next step, when valid
+    double acc[3][SmallSystemMax];
+    bool valid = false;
+};
@@ -0,0 +1,186 @@
+#include "snapshot.h"
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+namespace {
+
+constexpr uint64_t Alignment = 64;
+
+uint64_t align(uint64_t n) { return (n + Alignment - 1) & ~(Alignment - 1); }
+
+bool littleEndianHost()
+{
+    const uint16_t one = 1;
+    unsigned char low;
+    memcpy(&low, &one, 1);
+    return low == 1;
+}
+
+size_t elementSize(int a)
+{
+    if (a == SnapRadius)
+        return sizeof(float);
+    if (a == SnapColor)
+        return 4;
+    return sizeof(double);
+}
+
+// Header of a file holding n bodies, offsets filled in
+SnapshotHeader layout(uint64_t n)
+{
+    SnapshotHeader h = {};
+    memcpy(h.magic, SnapshotMagic, sizeof h.magic);
+    h.version = SnapshotVersion;
+    h.headerSize = sizeof(SnapshotHeader);
+    h.bodies = n;
+
+    uint64_t offset = align(sizeof(SnapshotHeader));
+    for (int a = 0; a < SnapshotArrays; ++a) {
+        h.offsets[a] = offset;
+        offset = align(offset + n * elementSize(a));
+    }
+    return h;
+}
+
+bool writeZeros(FILE* f, uint64_t bytes)
+{
+    static const unsigned char zeros[4096] = {};
+    while (bytes > 0) {
+        size_t chunk = bytes < sizeof zeros ? (size_t)bytes : sizeof zeros;
+        if (fwrite(zeros, 1, chunk, f) != chunk)
+            return false;
+        bytes -= chunk;
+    }
+    return true;
+}
+
+}
+
+bool saveSnapshot(const char* path, const BodyState& X, const float* radii, const unsigned char* colors,
+    double G, double time, long long step, bool planar, std::string& error)
+{
+    if (!littleEndianHost()) {
+        error = "snapshots need a little-endian host";
+        return false;
+    }
+
+    const uint64_t n = X.size();
+    SnapshotHeader h = layout(n);
+    h.G = G;
+    h.time = time;
+    h.step = step;
+    h.flags = (planar ? SnapshotPlanar : 0) | (radii && colors ? SnapshotHasAppearance : 0);
+
+    const void* arrays[SnapshotArrays] = {
+        X.x.data(), X.y.data(), X.z.data(), X.vx.data(), X.vy.data(), X.vz.data(), X.mass.data(),
+        radii && colors ? radii : nullptr, radii && colors ? colors : nullptr };
+
+    const std::string temp = std::string(path) + ".tmp";
+    FILE* f = fopen(temp.c_str(), "wb");
+    if (!f) {
+        error = "cannot create " + temp;
+        return false;
+    }
+
+    bool ok = fwrite(&h, sizeof h, 1, f) == 1;
+    uint64_t at = sizeof h;
+    for (int a = 0; a < SnapshotArrays && ok; ++a) {
+        ok = writeZeros(f, h.offsets[a] - at);
+        const size_t bytes = (size_t)n * elementSize(a);
+        if (ok && bytes > 0)
+            ok = arrays[a] ? fwrite(arrays[a], 1, bytes, f) == bytes : writeZeros(f, bytes);
+        at = h.offsets[a] + bytes;
+    }
+    ok = fclose(f) == 0 && ok;
+
+    if (!ok) {
+        remove(temp.c_str());
+        error = "cannot write " + temp;
+        return false;
+    }
+#ifdef _WIN32
+    // rename does not replace an existing file on Windows
+    if (!MoveFileExA(temp.c_str(), path, MOVEFILE_REPLACE_EXISTING)) {
+#else
+    if (rename(temp.c_str(), path) != 0) {
+#endif
+        remove(temp.c_str());
+        error = std::string("cannot replace ") + path;
+        return false;
+    }
+    return true;
+}
+
+bool loadSnapshot(const char* path, Snapshot& out, std::string& error)
+{
+    MappedSnapshot file;
+    if (!file.open(path, error))
+        return false;
+
+    const SnapshotHeader& h = file.header();
+    const size_t n = file.size();
+    file.copyState(out.state);
+    if (file.hasAppearance()) {
+        out.radii.assign(file.radii(), file.radii() + n);
+        out.colors.assign(file.colors(), file.colors() + 4 * n);
+    }
+    else {
+        out.radii.clear();
+        out.colors.clear();
+    }
+    out.G = h.G;
+    out.time = h.time;
+    out.step = h.step;
+    out.planar = (h.flags & SnapshotPlanar) != 0;
+    return true;
+}
+
+bool MappedSnapshot::open(const char* path, std::string& error)
+{
+    close();
+    if (!littleEndianHost()) {
+        error = "snapshots need a little-endian host";
+        return false;
+    }
+    if (!file.open(path, error))
+        return false;
+
+    // a damaged or foreign file must not make the arrays point past the end
+    const size_t bytes = file.size();
+    const char* problem = nullptr;
+    if (bytes < sizeof(SnapshotHeader) || memcmp(header().magic, SnapshotMagic, sizeof SnapshotMagic) != 0)
+        problem = "not a snapshot";
+    else if (header().version != SnapshotVersion || header().headerSize != sizeof(SnapshotHeader))
+        problem = "unsupported snapshot version";
+    else if (header().bodies > bytes)
+        problem = "truncated snapshot";
+    for (int a = 0; a < SnapshotArrays && !problem; ++a) {
+        uint64_t offset = header().offsets[a];
+        if (offset % sizeof(double) != 0 || offset > bytes || header().bodies * elementSize(a) > bytes - offset)
+            problem = "truncated snapshot";
+    }
+    if (problem) {
+        close();
+        error = std::string(path) + ": " + problem;
+        return false;
+    }
+    return true;
+}
+
+void MappedSnapshot::copyState(BodyState& X) const
+{
+    const size_t n = size();
+    for (int a = SnapX; a <= SnapMass; ++a) {
+        // assign copies straight from the mapping, resize() would zero fill first
+        std::vector<double>& dst = a == SnapMass ? X.mass : X.component(a);
+        const double* src = array((SnapshotArray)a);
+        dst.assign(src, src + n);
+    }
+}
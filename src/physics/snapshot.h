@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "body_state.h"
+#include "mapped_file.h"
+
+// Binary checkpoint of a simulation, version 1, little-endian.
+//
+//   SnapshotHeader (128 bytes)
+//   x, y, z, vx, vy, vz, mass   N doubles each
+//   radius                      N floats
+//   color                       N x 4 bytes RGBA
+//
+// Every array starts at the offset the header lists, aligned to 64 bytes, so
+// a mapped file is used in place: each array is written with one call and
+// read back with one copy, nothing per body. Radius and color belong to
+// the window app, runs without them leave SnapshotHasAppearance unset and
+// the arrays zeroed.
+//
+// Only little-endian hosts (x86, ARM) are supported; elsewhere saving and
+// loading fail with an error instead of producing swapped data.
+
+constexpr char SnapshotMagic[8] = { 'N', 'B', 'O', 'D', 'Y', 'S', 'N', 'P' };
+constexpr uint32_t SnapshotVersion = 1;
+constexpr uint32_t SnapshotPlanar = 1;
+constexpr uint32_t SnapshotHasAppearance = 2;
+
+enum SnapshotArray { SnapX, SnapY, SnapZ, SnapVX, SnapVY, SnapVZ, SnapMass, SnapRadius, SnapColor, SnapshotArrays };
+
+struct SnapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t bodies;
+    double G;
+    double time;
+    int64_t step;
+    uint32_t flags;
+    uint32_t reserved;
+    uint64_t offsets[SnapshotArrays];
+};
+static_assert(sizeof(SnapshotHeader) == 128, "snapshot header layout");
+
+// Everything a snapshot holds, unpacked
+struct Snapshot
+{
+    BodyState state;
+    std::vector<float> radii;            // empty when the file has no appearance
+    std::vector<unsigned char> colors;   // RGBA, 4 per body
+    double G = 0.0;
+    double time = 0.0;
+    long long step = 0;
+    bool planar = false;
+};
+
+// radii/colors may be null. The file is written next to path and renamed
+// over it when complete, so a crash never leaves half a checkpoint behind.
+bool saveSnapshot(const char* path, const BodyState& X, const float* radii, const unsigned char* colors,
+    double G, double time, long long step, bool planar, std::string& error);
+
+bool loadSnapshot(const char* path, Snapshot& out, std::string& error);
+
+// Read-only mapping of a snapshot file. Opening checks the header and the
+// array bounds, then the arrays point straight into the page cache, so it
+// takes the same few microseconds for 10 bodies or 10M; pages are read in
+// when touched.
+class MappedSnapshot
+{
+public:
+    bool open(const char* path, std::string& error);
+    void close() { file.close(); }
+    bool isOpen() const { return file.isOpen(); }
+
+    const SnapshotHeader& header() const { return *reinterpret_cast<const SnapshotHeader*>(file.data()); }
+    size_t size() const { return (size_t)header().bodies; }
+    bool hasAppearance() const { return (header().flags & SnapshotHasAppearance) != 0; }
+
+    const double* array(SnapshotArray a) const { return reinterpret_cast<const double*>(file.data() + header().offsets[a]); }
+    const float* radii() const { return reinterpret_cast<const float*>(file.data() + header().offsets[SnapRadius]); }
+    const unsigned char* colors() const { return file.data() + header().offsets[SnapColor]; }
+
+    // Copies the state arrays into X, one pass each
+    void copyState(BodyState& X) const;
+
+private:
+    MappedFile file;
+};
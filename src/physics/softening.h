@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cmath>
+
+enum class SofteningKind { None, Plummer, Spline };
+
+// Force softening, keeps the acceleration of a close pair finite.
+//
+// Plummer: every body acts like a Plummer sphere of scale eps,
+//   a = G m d / (r^2 + eps^2)^(3/2), a little weaker at every distance.
+// Spline: the cubic spline kernel of Monaghan & Lattanzio (1985) as GADGET
+//   uses it, support h = 2.8 eps (the same potential depth as Plummer with
+//   eps), exactly Newtonian from h on.
+//
+// d = x_j - x_i, so a_i = G m_j d forceFactor(r^2). Coincident bodies get a
+// finite factor and d = 0, they contribute nothing.
+struct Softening
+{
+    SofteningKind kind = SofteningKind::None;
+    double eps = 0.0;
+
+    bool enabled() const { return kind != SofteningKind::None && eps > 0.0; }
+
+    // Distance from which a pair is Newtonian, 0 unsoftened. Plummer never
+    // quite is, eps is where it is 1.5^-1.5 = 54% of Newton.
+    double support() const
+    {
+        if (!enabled())
+            return 0.0;
+        return kind == SofteningKind::Spline ? 2.8 * eps : eps;
+    }
+
+    // 1 / r^3 unsoftened
+    double forceFactor(double r2) const
+    {
+        if (kind == SofteningKind::Plummer) {
+            const double e2 = r2 + eps * eps;
+            return 1.0 / (e2 * std::sqrt(e2));
+        }
+        const double r = std::sqrt(r2);
+        if (kind == SofteningKind::Spline) {
+            const double h = 2.8 * eps;
+            if (r < h) {
+                const double u = r / h, ih3 = 1.0 / (h * h * h);
+                if (u < 0.5)
+                    return ih3 * (10.666666666667 + u * u * (32.0 * u - 38.4));
+                return ih3 * (21.333333333333 - 48.0 * u + 38.4 * u * u - 10.666666666667 * u * u * u)
+                    - 0.066666666667 / (r2 * r);
+            }
+        }
+        return 1.0 / (r2 * r);
+    }
+
+    // phi = G m potentialFactor(r^2), -1 / r unsoftened
+    double potentialFactor(double r2) const
+    {
+        if (kind == SofteningKind::Plummer)
+            return -1.0 / std::sqrt(r2 + eps * eps);
+        const double r = std::sqrt(r2);
+        if (kind == SofteningKind::Spline) {
+            const double h = 2.8 * eps;
+            if (r < h) {
+                const double u = r / h;
+                if (u < 0.5)
+                    return (-2.8 + u * u * (5.333333333333 + u * u * (6.4 * u - 9.6))) / h;
+                return (-3.2 + 0.066666666667 / u + u * u * (10.666666666667 + u * (-16.0 + u * (9.6 - 2.133333333333 * u)))) / h;
+            }
+        }
+        return -1.0 / r;
+    }
+};
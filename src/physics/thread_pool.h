@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads that run one job split into numbered tasks.
+// run() blocks until every task is done. The job is passed as a plain
+// function pointer + context, so dispatching it never allocates.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(int threads = 1)
+    {
+        setThreads(threads);
+    }
+
+    ~ThreadPool()
+    {
+        stop();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Total thread count including the calling thread
+    int threads() const { return (int)workers.size() + 1; }
+
+    void setThreads(int n)
+    {
+        if (n < 1)
+            n = 1;
+        if (n == threads())
+            return;
+        stop();
+        quit = false;
+        for (int t = 1; t < n; ++t) {
+            workers.emplace_back([this, seen = generation] { workerLoop(seen); });
+        }
+    }
+
+    // Calls task(0) .. task(count - 1), spread over the pool, the calling
+    // thread takes part too
+    template <class F>
+    void run(int count, F& task)
+    {
+        if (count <= 0)
+            return;
+        if (workers.empty() || count == 1) {
+            for (int i = 0; i < count; ++i)
+                task(i);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m);
+            job = [](void* ctx, int i) { (*static_cast<F*>(ctx))(i); };
+            jobCtx = &task;
+            jobCount = count;
+            next.store(0);
+            active = (int)workers.size();
+            ++generation;
+        }
+        wake.notify_all();
+
+        work();
+
+        std::unique_lock<std::mutex> lock(m);
+        done.wait(lock, [this] { return active == 0; });
+    }
+
+private:
+    void work()
+    {
+        for (int i = next.fetch_add(1); i < jobCount; i = next.fetch_add(1))
+            job(jobCtx, i);
+    }
+
+    void workerLoop(unsigned seen)
+    {
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(m);
+                wake.wait(lock, [&] { return quit || generation != seen; });
+                if (quit)
+                    return;
+                seen = generation;
+            }
+            work();
+            {
+                // run() does not touch the job until every worker checked out
+                std::lock_guard<std::mutex> lock(m);
+                if (--active == 0)
+                    done.notify_all();
+            }
+        }
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            quit = true;
+        }
+        wake.notify_all();
+        for (auto& w : workers)
+            w.join();
+        workers.clear();
+    }
+
+    std::vector<std::thread> workers;
+    std::mutex m;
+    std::condition_variable wake, done;
+    bool quit = false;
+    unsigned generation = 0;
+
+    void (*job)(void*, int) = nullptr;
+    void* jobCtx = nullptr;
+    int jobCount = 0;
+    std::atomic<int> next{ 0 };
+    int active = 0;
+};
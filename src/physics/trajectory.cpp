@@ -0,0 +1,468 @@
+#include "trajectory.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+constexpr char TrajectoryMagic[8] = { 'N', 'B', 'O', 'D', 'Y', 'T', 'R', 'J' };
+constexpr char ChunkMagic[4] = { 'C', 'H', 'N', 'K' };
+constexpr char IndexMagic[8] = { 'N', 'B', 'O', 'D', 'Y', 'I', 'D', 'X' };
+constexpr uint32_t TrajectoryVersion = 2;
+
+uint64_t idBytes(const TrajectoryChunk& c)
+{
+    return (c.flags & ChunkHasIds) ? (uint64_t)c.bodies * sizeof(int32_t) : 0;
+}
+
+// keeps far away or broken values from overflowing the integer deltas
+constexpr double MaxQuantized = 4e18;
+
+int64_t quantize(double v, double quantum)
+{
+    double q = std::round(v / quantum);
+    if (!(q == q))
+        return 0;
+    return (int64_t)std::clamp(q, -MaxQuantized, MaxQuantized);
+}
+
+void putVarint(std::vector<unsigned char>& out, int64_t v)
+{
+    uint64_t z = ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);  // zigzag: small magnitudes, small codes
+    while (z >= 0x80) {
+        out.push_back((unsigned char)(z | 0x80));
+        z >>= 7;
+    }
+    out.push_back((unsigned char)z);
+}
+
+// false when the varint runs past end
+bool getVarint(const unsigned char*& p, const unsigned char* end, int64_t& v)
+{
+    uint64_t z = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (p == end)
+            return false;
+        unsigned char b = *p++;
+        z |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            v = (int64_t)(z >> 1) ^ -(int64_t)(z & 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+template <class T>
+void append(std::vector<unsigned char>& out, const T& v)
+{
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(&v);
+    out.insert(out.end(), p, p + sizeof v);
+}
+
+}
+
+bool TrajectoryWriter::open(const char* path, double G, const Options& options, std::string& error)
+{
+    close();
+    opt = options;
+    opt.every = std::max(opt.every, 1);
+    opt.chunkFrames = std::max(opt.chunkFrames, 1);
+    opt.queueFrames = std::max(opt.queueFrames, 1);
+    // every position is divided by it, 0 or NaN would record garbage without an error
+    if (!std::isfinite(opt.quantum) || opt.quantum <= 0.0) {
+        error = "trajectory quantum has to be a positive number";
+        return false;
+    }
+
+    file = fopen(path, "wb");
+    if (!file) {
+        error = std::string("cannot create ") + path;
+        return false;
+    }
+
+    TrajectoryHeader h = {};
+    memcpy(h.magic, TrajectoryMagic, sizeof h.magic);
+    h.version = TrajectoryVersion;
+    h.headerSize = sizeof h;
+    h.quantum = opt.quantum;
+    h.chunkFrames = opt.chunkFrames;
+    h.every = opt.every;
+    h.G = G;
+
+    quit = false;
+    written = dropped = bytes = 0;
+    failure.clear();
+    index.clear();
+    pendingIndex.clear();
+    chunk.clear();
+    chunkFrames = chunkBodies = 0;
+    chunkIds.clear();
+    chunkHasIds = false;
+
+    if (!write(&h, sizeof h)) {
+        error = failure;
+        fclose(file);
+        file = nullptr;
+        return false;
+    }
+    io = std::thread([this] { ioLoop(); });
+    return true;
+}
+
+void TrajectoryWriter::record(const BodyState& X, long long step, double time, const std::vector<int>* ids)
+{
+    if (!isOpen() || step % opt.every != 0)
+        return;
+
+    std::unique_ptr<Frame> f;
+    {
+        std::lock_guard<std::mutex> lock(m);
+        if (!failure.empty())
+            return;
+        if ((int)queue.size() >= opt.queueFrames) {
+            ++dropped;
+            return;
+        }
+        if (!spare.empty()) {
+            f = std::move(spare.back());
+            spare.pop_back();
+        }
+    }
+    if (!f)
+        f = std::make_unique<Frame>();
+
+    // buffers come back from the io thread, after the first frames this does not allocate
+    f->x.assign(X.x.begin(), X.x.end());
+    f->y.assign(X.y.begin(), X.y.end());
+    f->z.assign(X.z.begin(), X.z.end());
+    f->hasIds = ids != nullptr;
+    if (ids)
+        f->ids.assign(ids->begin(), ids->end());
+    f->step = step;
+    f->time = time;
+
+    {
+        std::lock_guard<std::mutex> lock(m);
+        queue.push_back(std::move(f));
+    }
+    wake.notify_one();
+}
+
+void TrajectoryWriter::close()
+{
+    if (!isOpen())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(m);
+        quit = true;
+    }
+    wake.notify_one();
+    io.join();
+    fclose(file);
+    file = nullptr;
+}
+
+long long TrajectoryWriter::framesWritten() const
+{
+    std::lock_guard<std::mutex> lock(m);
+    return written;
+}
+
+long long TrajectoryWriter::framesDropped() const
+{
+    std::lock_guard<std::mutex> lock(m);
+    return dropped;
+}
+
+long long TrajectoryWriter::bytesWritten() const
+{
+    std::lock_guard<std::mutex> lock(m);
+    return bytes;
+}
+
+std::string TrajectoryWriter::error() const
+{
+    std::lock_guard<std::mutex> lock(m);
+    return failure;
+}
+
+void TrajectoryWriter::ioLoop()
+{
+    std::vector<std::unique_ptr<Frame>> work;
+
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m);
+            wake.wait(lock, [&] { return quit || !queue.empty(); });
+            if (queue.empty())
+                break;
+            work.swap(queue);
+        }
+
+        for (auto& f : work)
+            encode(*f);
+
+        std::lock_guard<std::mutex> lock(m);
+        for (auto& f : work)
+            spare.push_back(std::move(f));
+        work.clear();
+    }
+
+    flushChunk();
+
+    TrajectoryTrailer t = {};
+    t.index = bytes;
+    t.frames = index.size();
+    memcpy(t.magic, IndexMagic, sizeof t.magic);
+    if (!index.empty())
+        write(index.data(), index.size() * sizeof(TrajectoryIndexEntry));
+    write(&t, sizeof t);
+}
+
+void TrajectoryWriter::encode(const Frame& f)
+{
+    const uint32_t N = f.x.size();
+    const bool sameBodies = N == chunkBodies && f.hasIds == chunkHasIds && (!f.hasIds || f.ids == chunkIds);
+    if (chunkFrames > 0 && (!sameBodies || chunkFrames >= (uint32_t)opt.chunkFrames))
+        flushChunk();
+
+    // the first frame of a chunk is a delta against zero, i.e. stored in full
+    if (chunkFrames == 0) {
+        last.assign(3 * (size_t)N, 0);
+        chunkBodies = N;
+        chunkHasIds = f.hasIds;
+        chunkIds = f.ids;
+    }
+
+    const size_t headerAt = chunk.size();
+    TrajectoryFrame h = { f.step, f.time, 0 };
+    append(chunk, h);
+
+    const std::vector<double>* components[3] = { &f.x, &f.y, &f.z };
+    for (int c = 0; c < 3; ++c) {
+        int64_t* prev = last.data() + (size_t)c * N;
+        const double* v = components[c]->data();
+        for (uint32_t i = 0; i < N; ++i) {
+            int64_t q = quantize(v[i], opt.quantum);
+            putVarint(chunk, q - prev[i]);
+            prev[i] = q;
+        }
+    }
+
+    h.bytes = chunk.size() - headerAt - sizeof h;
+    memcpy(chunk.data() + headerAt, &h, sizeof h);
+
+    pendingIndex.push_back({ f.step, f.time, 0, chunkFrames, N });
+    ++chunkFrames;
+}
+
+void TrajectoryWriter::flushChunk()
+{
+    if (chunkFrames == 0)
+        return;
+
+    TrajectoryChunk h = {};
+    memcpy(h.magic, ChunkMagic, sizeof h.magic);
+    h.frames = chunkFrames;
+    h.bodies = chunkBodies;
+    h.flags = chunkHasIds ? ChunkHasIds : 0;
+    h.bytes = idBytes(h) + chunk.size();
+
+    const uint64_t offset = bytes;
+    if (write(&h, sizeof h) && write(chunkIds.data(), idBytes(h)) && write(chunk.data(), chunk.size())) {
+        for (auto& e : pendingIndex) {
+            e.chunk = offset;
+            index.push_back(e);
+        }
+        std::lock_guard<std::mutex> lock(m);
+        written += chunkFrames;
+    }
+
+    pendingIndex.clear();
+    chunk.clear();
+    chunkFrames = 0;
+}
+
+bool TrajectoryWriter::write(const void* p, size_t n)
+{
+    std::lock_guard<std::mutex> lock(m);
+    if (!failure.empty())
+        return false;
+    if (fwrite(p, 1, n, file) != n) {
+        failure = "trajectory write failed";
+        return false;
+    }
+    bytes += n;
+    return true;
+}
+
+bool TrajectoryReader::open(const char* path, std::string& error)
+{
+    close();
+    if (!file.open(path, error))
+        return false;
+
+    if (file.size() < sizeof(TrajectoryHeader) || memcmp(header().magic, TrajectoryMagic, sizeof TrajectoryMagic) != 0
+        || header().version < 1 || header().version > TrajectoryVersion || header().headerSize != sizeof(TrajectoryHeader)
+        || !std::isfinite(header().quantum) || header().quantum <= 0.0) {
+        close();
+        error = std::string(path) + ": not a trajectory";
+        return false;
+    }
+
+    // the index written by close(), or the chunks themselves after a crash
+    TrajectoryTrailer t;
+    bool indexed = false;
+    if (file.size() >= sizeof(TrajectoryHeader) + sizeof t) {
+        memcpy(&t, file.data() + file.size() - sizeof t, sizeof t);
+        indexed = memcmp(t.magic, IndexMagic, sizeof t.magic) == 0 && t.index <= file.size()
+            && t.frames == (file.size() - sizeof t - t.index) / sizeof(TrajectoryIndexEntry)
+            && t.index + t.frames * sizeof(TrajectoryIndexEntry) + sizeof t == file.size();
+    }
+    if (indexed) {
+        index.resize(t.frames);
+        if (t.frames > 0)
+            memcpy(index.data(), file.data() + t.index, t.frames * sizeof(TrajectoryIndexEntry));
+
+        // a damaged index must not point read() past its chunk, the chunks themselves decide then
+        TrajectoryChunk c;
+        for (const TrajectoryIndexEntry& e : index) {
+            if (!chunkAt(e.chunk, c) || e.frame >= c.frames || e.bodies != c.bodies) {
+                indexed = false;
+                break;
+            }
+        }
+    }
+    if (!indexed) {
+        index.clear();
+        rebuildIndex();
+    }
+    return true;
+}
+
+void TrajectoryReader::close()
+{
+    file.close();
+    index.clear();
+    cachedChunk = ~0ull;
+}
+
+bool TrajectoryReader::rebuildIndex()
+{
+    const unsigned char* base = file.data();
+    uint64_t offset = sizeof(TrajectoryHeader);
+
+    TrajectoryChunk c;
+    while (chunkAt(offset, c))
+    {
+        const uint64_t end = offset + sizeof c + c.bytes;
+        uint64_t at = offset + sizeof c + idBytes(c);
+        for (uint32_t k = 0; k < c.frames && at + sizeof(TrajectoryFrame) <= end; ++k) {
+            TrajectoryFrame f;
+            memcpy(&f, base + at, sizeof f);
+            index.push_back({ f.step, f.time, offset, k, c.bodies });
+            if (f.bytes > end - at - sizeof f)
+                break;
+            at += sizeof f + f.bytes;
+        }
+        offset += sizeof c + c.bytes;
+    }
+    return !index.empty();
+}
+
+// every frame has its header and at least one varint byte per coordinate
+bool TrajectoryReader::chunkAt(uint64_t offset, TrajectoryChunk& c) const
+{
+    if (offset < sizeof(TrajectoryHeader) || offset > file.size() || file.size() - offset < sizeof c)
+        return false;
+    memcpy(&c, file.data() + offset, sizeof c);
+    if (memcmp(c.magic, ChunkMagic, sizeof c.magic) != 0 || c.bytes > file.size() - offset - sizeof c
+        || idBytes(c) > c.bytes || c.frames == 0)
+        return false;
+    const uint64_t frameBytes = (c.bytes - idBytes(c)) / c.frames;
+    return frameBytes >= sizeof(TrajectoryFrame) && 3 * (uint64_t)c.bodies <= frameBytes - sizeof(TrajectoryFrame);
+}
+
+int TrajectoryReader::frameAtStep(long long step) const
+{
+    auto it = std::upper_bound(index.begin(), index.end(), step,
+        [](long long s, const TrajectoryIndexEntry& e) { return s < e.step; });
+    return it == index.begin() ? 0 : (int)(it - index.begin()) - 1;
+}
+
+int TrajectoryReader::frameAtTime(double time) const
+{
+    auto it = std::upper_bound(index.begin(), index.end(), time,
+        [](double t, const TrajectoryIndexEntry& e) { return t < e.time; });
+    return it == index.begin() ? 0 : (int)(it - index.begin()) - 1;
+}
+
+void TrajectoryReader::decodeChunk(uint64_t offset)
+{
+    // the sizes come from the file: nothing is allocated for a chunk its bytes cannot hold
+    TrajectoryChunk c;
+    cachedChunk = offset;
+    if (!chunkAt(offset, c)) {
+        decoded.clear();
+        decodedIds.clear();
+        return;
+    }
+    const size_t values = 3 * (size_t)c.bodies;
+    decoded.assign(c.frames * values, 0.0);
+
+    const double quantum = header().quantum;
+    const unsigned char* p = file.data() + offset + sizeof c;
+    const unsigned char* end = file.data() + std::min<uint64_t>(file.size(), offset + sizeof c + c.bytes);
+
+    // version 1 chunks have no ids, their bodies never changed
+    decodedIds.resize(c.bodies);
+    if (idBytes(c) > 0)
+        memcpy(decodedIds.data(), p, idBytes(c));
+    else
+        for (uint32_t i = 0; i < c.bodies; ++i)
+            decodedIds[i] = i;
+    p += idBytes(c);
+
+    std::vector<int64_t> q(values, 0);
+
+    for (uint32_t k = 0; k < c.frames && p + sizeof(TrajectoryFrame) <= end; ++k)
+    {
+        p += sizeof(TrajectoryFrame);
+        double* out = decoded.data() + k * values;
+        for (size_t v = 0; v < values; ++v) {
+            int64_t d;
+            if (!getVarint(p, end, d))
+                break;
+            q[v] += d;
+            out[v] = q[v] * quantum;
+        }
+    }
+}
+
+void TrajectoryReader::read(int frame, std::vector<double>& x, std::vector<double>& y, std::vector<double>& z,
+    std::vector<int>* ids)
+{
+    const TrajectoryIndexEntry& e = index[frame];
+    if (cachedChunk != e.chunk)
+        decodeChunk(e.chunk);
+
+    // open() checked the entries against their chunks, a chunk that still does not decode reads as zeros
+    const size_t N = e.bodies;
+    if (((size_t)e.frame + 1) * 3 * N > decoded.size()) {
+        x.assign(N, 0.0);
+        y.assign(N, 0.0);
+        z.assign(N, 0.0);
+        if (ids)
+            ids->clear();
+        return;
+    }
+    const double* p = decoded.data() + (size_t)e.frame * 3 * N;
+    x.assign(p, p + N);
+    y.assign(p + N, p + 2 * N);
+    z.assign(p + 2 * N, p + 3 * N);
+    if (ids)
+        *ids = decodedIds;
+}
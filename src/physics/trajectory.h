@@ -0,0 +1,194 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "body_state.h"
+#include "mapped_file.h"
+
+// Recorded positions of a run, version 2, little-endian.
+//
+//   TrajectoryHeader (64 bytes)
+//   chunks: TrajectoryChunk header, N int32 body ids when flags has
+//           ChunkHasIds, then per frame a TrajectoryFrame header and 3N
+//           zigzag varints (all x, all y, all z)
+//   index:  one TrajectoryIndexEntry per frame
+//   TrajectoryTrailer (24 bytes)
+//
+// Positions are quantized to integer multiples of `quantum`. The first frame
+// of a chunk stores them as they are, every further frame the difference to
+// the frame before, so a body that moved a few quanta costs a byte or two per
+// coordinate instead of 8. The error is at most quantum / 2 and does not
+// build up, the deltas are exact integers. A chunk ends after chunkFrames
+// frames or when the bodies change (count or ids); to read any frame only its
+// chunk is decoded, so seeking costs at most one chunk whatever the file
+// length. The ids let a player follow bodies across insertions and removals,
+// version 1 files have none and read as ids 0..N-1.
+//
+// The trailer and index are written by close(). A file cut short by a crash
+// is still readable, the reader rebuilds the index from the chunk headers.
+
+struct TrajectoryHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    double quantum;
+    uint32_t chunkFrames;
+    uint32_t every;
+    double G;
+    char reserved[24];
+};
+static_assert(sizeof(TrajectoryHeader) == 64, "trajectory header layout");
+
+struct TrajectoryChunk
+{
+    char magic[4];
+    uint32_t frames;
+    uint32_t bodies;
+    uint32_t flags;
+    uint64_t bytes;  // ids and frames that follow, headers included
+};
+
+constexpr uint32_t ChunkHasIds = 1;
+
+struct TrajectoryFrame
+{
+    int64_t step;
+    double time;
+    uint64_t bytes;  // varint payload
+};
+
+struct TrajectoryIndexEntry
+{
+    int64_t step;
+    double time;
+    uint64_t chunk;  // file offset of the chunk header
+    uint32_t frame;  // position in the chunk
+    uint32_t bodies;
+};
+
+struct TrajectoryTrailer
+{
+    uint64_t index;  // file offset of the first index entry
+    uint64_t frames;
+    char magic[8];
+};
+
+// Appends every k-th step of a run to a trajectory file.
+// record() only copies the positions into a free buffer and queues it, the
+// quantizing, encoding and writing happen on a background thread, so the
+// integrator never waits for the disk. When the disk falls behind by more
+// than queueFrames frames, new frames are dropped and counted rather than
+// blocking the caller.
+class TrajectoryWriter
+{
+public:
+    struct Options
+    {
+        int every = 1;         // keep steps that are multiples of this
+        int chunkFrames = 64;  // frames between two full (non delta) frames
+        double quantum = 1e-3; // position resolution
+        int queueFrames = 256;
+    };
+
+    TrajectoryWriter() = default;
+    ~TrajectoryWriter() { close(); }
+
+    TrajectoryWriter(const TrajectoryWriter&) = delete;
+    TrajectoryWriter& operator=(const TrajectoryWriter&) = delete;
+
+    bool open(const char* path, double G, const Options& options, std::string& error);
+    bool isOpen() const { return io.joinable(); }
+
+    // Called after every step, ignores steps that are not a multiple of every.
+    // ids (Simulation::ids()) are stored when given.
+    void record(const BodyState& X, long long step, double time, const std::vector<int>* ids = nullptr);
+
+    // Waits for the queue to drain, then writes the index
+    void close();
+
+    long long framesWritten() const;
+    long long framesDropped() const;
+    long long bytesWritten() const;
+    // Empty unless a write failed, recording stops at the first failure
+    std::string error() const;
+
+private:
+    struct Frame
+    {
+        std::vector<double> x, y, z;
+        std::vector<int> ids;
+        bool hasIds = false;
+        long long step = 0;
+        double time = 0.0;
+    };
+
+    void ioLoop();
+    void encode(const Frame& f);
+    void flushChunk();
+    bool write(const void* p, size_t n);
+
+    Options opt;
+    FILE* file = nullptr;
+    std::thread io;
+
+    mutable std::mutex m;
+    std::condition_variable wake, drained;
+    std::vector<std::unique_ptr<Frame>> queue, spare;
+    bool quit = false;
+    bool busy = false;
+    long long written = 0, dropped = 0, bytes = 0;
+    std::string failure;
+
+    // io thread only
+    std::vector<int64_t> last;        // quantized positions of the previous frame
+    std::vector<unsigned char> chunk; // frames of the open chunk
+    uint32_t chunkFrames = 0, chunkBodies = 0;
+    std::vector<int> chunkIds;
+    bool chunkHasIds = false;
+    std::vector<TrajectoryIndexEntry> index;
+    std::vector<TrajectoryIndexEntry> pendingIndex;
+};
+
+// Random access to the frames of a trajectory file through a memory mapping.
+// A decoded chunk is kept, so playing forwards or backwards decodes every
+// chunk once.
+class TrajectoryReader
+{
+public:
+    bool open(const char* path, std::string& error);
+    void close();
+
+    const TrajectoryHeader& header() const { return *reinterpret_cast<const TrajectoryHeader*>(file.data()); }
+    int frames() const { return (int)index.size(); }
+    const TrajectoryIndexEntry& entry(int frame) const { return index[frame]; }
+    // Last frame at or before step (time), 0 if there is none
+    int frameAtStep(long long step) const;
+    int frameAtTime(double time) const;
+
+    // Positions of frame i, x/y/z resized to its body count, and the body ids
+    void read(int frame, std::vector<double>& x, std::vector<double>& y, std::vector<double>& z,
+        std::vector<int>* ids = nullptr);
+
+private:
+    bool rebuildIndex();
+    // Header of the chunk at offset into c, false unless the chunk lies in the
+    // mapping and its bytes can hold c.frames frames of c.bodies bodies
+    bool chunkAt(uint64_t offset, TrajectoryChunk& c) const;
+    void decodeChunk(uint64_t offset);
+
+    MappedFile file;
+    std::vector<TrajectoryIndexEntry> index;
+
+    // the decoded chunk, frame after frame, x y z blocks of `bodies` each
+    uint64_t cachedChunk = ~0ull;
+    std::vector<double> decoded;
+    std::vector<int> decodedIds;
+};
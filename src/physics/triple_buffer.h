@@ -0,0 +1,40 @@
+#pragma once
+
+#include <atomic>
+
+// Lock-free single producer / single consumer handoff of the latest value.
+// The producer fills back() and publish()es it, the consumer calls update()
+// and reads front(). Neither side ever waits: the three slots are rotated
+// through one atomic index, values the consumer did not pick up in time are
+// overwritten by newer ones. Slots are reused, so a T made of vectors stops
+// allocating once they reached their size.
+template <class T>
+class TripleBuffer
+{
+public:
+    // Producer side
+    T& back() { return slots[backIndex]; }
+    void publish()
+    {
+        backIndex = middle.exchange(backIndex | Fresh, std::memory_order_acq_rel) & IndexMask;
+    }
+
+    // Consumer side, true when a newer value was taken over
+    bool update()
+    {
+        if (!(middle.load(std::memory_order_relaxed) & Fresh))
+            return false;
+        frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & IndexMask;
+        return true;
+    }
+    const T& front() const { return slots[frontIndex]; }
+
+private:
+    static constexpr int IndexMask = 3;
+    static constexpr int Fresh = 4;
+
+    T slots[3];
+    int backIndex = 0;
+    int frontIndex = 1;
+    std::atomic<int> middle{ 2 };
+};
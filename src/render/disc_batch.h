@@ -0,0 +1,81 @@
+#pragma once
+
+#include "raylib.h"
+#include "raymath.h"
+#include "rlgl.h"
+
+// Flat coloured discs, drawn as textured quads in a single rlgl batch.
+// An unlit DrawSphere looks exactly like a disc facing the camera, but costs
+// hundreds of vertices and its own sin/cos per ring; a quad is 4 vertices and
+// thousands of them go to the GPU in one draw call.
+class DiscBatch
+{
+public:
+    // Quads facing the camera, between BeginMode3D and EndMode3D
+    void begin(const Camera3D& camera)
+    {
+        Vector3 forward = Vector3Normalize(Vector3Subtract(camera.target, camera.position));
+        right = Vector3Normalize(Vector3CrossProduct(forward, camera.up));
+        up = Vector3CrossProduct(right, forward);
+        start();
+    }
+
+    // Quads in the xy plane, between BeginMode2D and EndMode2D. Screen y
+    // points down there, so up is -y: add() then winds counter-clockwise on
+    // screen, the front face raylib keeps with back-face culling on.
+    void begin()
+    {
+        right = { 1.0f, 0.0f, 0.0f };
+        up = { 0.0f, -1.0f, 0.0f };
+        start();
+    }
+
+    void add(Vector3 p, float radius, Color c)
+    {
+        Vector3 r = Vector3Scale(right, radius);
+        Vector3 u = Vector3Scale(up, radius);
+
+        // flushes and continues the batch when it is full
+        rlCheckRenderBatchLimit(4);
+        rlColor4ub(c.r, c.g, c.b, c.a);
+        rlTexCoord2f(0.0f, 0.0f);
+        rlVertex3f(p.x - r.x + u.x, p.y - r.y + u.y, p.z - r.z + u.z);
+        rlTexCoord2f(0.0f, 1.0f);
+        rlVertex3f(p.x - r.x - u.x, p.y - r.y - u.y, p.z - r.z - u.z);
+        rlTexCoord2f(1.0f, 1.0f);
+        rlVertex3f(p.x + r.x - u.x, p.y + r.y - u.y, p.z + r.z - u.z);
+        rlTexCoord2f(1.0f, 0.0f);
+        rlVertex3f(p.x + r.x + u.x, p.y + r.y + u.y, p.z + r.z + u.z);
+    }
+
+    void end()
+    {
+        rlEnd();
+        rlSetTexture(0);
+    }
+
+    // Needs the GL context, so it is called before CloseWindow()
+    void unload()
+    {
+        if (disc.id != 0)
+            UnloadTexture(disc);
+        disc = {};
+    }
+
+private:
+    void start()
+    {
+        if (disc.id == 0) {
+            Image img = GenImageColor(64, 64, BLANK);
+            ImageDrawCircle(&img, 32, 32, 31, WHITE);
+            disc = LoadTextureFromImage(img);
+            UnloadImage(img);
+        }
+        rlSetTexture(disc.id);
+        rlBegin(RL_QUADS);
+    }
+
+    Texture2D disc = {};
+    Vector3 right = { 1.0f, 0.0f, 0.0f };
+    Vector3 up = { 0.0f, 1.0f, 0.0f };
+};
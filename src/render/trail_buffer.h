@@ -0,0 +1,98 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "raylib.h"
+
+// Trails of all bodies in one ring buffer.
+// Every body owns `length` consecutive slots of one array. All bodies get a
+// point at the same time, so a single head index is shared and adding a point
+// is one store per body, nothing is shifted or allocated. Bodies that joined
+// later just have fewer points filled. Trails belong to body ids, so when
+// bodies come and go the survivors keep theirs.
+class TrailBuffer
+{
+public:
+    explicit TrailBuffer(int length = 15)
+        : len(length > 0 ? length : 0)
+    {
+    }
+
+    int length() const { return len; }
+    int bodies() const { return (int)filled.size(); }
+
+    // Points of body i, the oldest is at(i, 0)
+    int size(int i) const { return filled[i]; }
+    const Vector3& at(int i, int k) const
+    {
+        return points[(size_t)i * len + (head - filled[i] + k + len) % len];
+    }
+
+    // Appends positions[0..count) as the newest points of the bodies ids[0..count),
+    // ids ascending like Simulation::ids()
+    void push(const Vector3* positions, const int* ids, int count)
+    {
+        if (count != bodies() || !std::equal(ids, ids + count, owner.begin()))
+            follow(ids, count);
+        if (len == 0)
+            return;
+        for (int i = 0; i < count; ++i) {
+            points[(size_t)i * len + head] = positions[i];
+            filled[i] = std::min(filled[i] + 1, len);
+        }
+        head = (head + 1) % len;
+    }
+
+    // Keeps the newest min(old, new length) points of every body
+    void setLength(int length)
+    {
+        length = std::max(length, 0);
+        if (length == len)
+            return;
+
+        std::vector<Vector3> resized((size_t)bodies() * length);
+        for (int i = 0; i < bodies(); ++i) {
+            int keep = std::min(filled[i], length);
+            for (int k = 0; k < keep; ++k)
+                resized[(size_t)i * length + length - keep + k] = at(i, filled[i] - keep + k);
+            filled[i] = keep;
+        }
+        points.swap(resized);
+        len = length;
+        head = 0;
+    }
+
+    void clear()
+    {
+        std::fill(filled.begin(), filled.end(), 0);
+        head = 0;
+    }
+
+private:
+    // Moves every trail to the new slot of its body, one merge pass over the two
+    // ascending id lists. New bodies start empty, removed ones are dropped.
+    void follow(const int* ids, int count)
+    {
+        std::vector<Vector3> moved((size_t)count * len);
+        std::vector<int> movedFilled(count, 0);
+        size_t k = 0;
+        for (int i = 0; i < count; ++i) {
+            while (k < owner.size() && owner[k] < ids[i])
+                ++k;
+            if (k < owner.size() && owner[k] == ids[i]) {
+                std::copy_n(points.begin() + k * len, len, moved.begin() + (size_t)i * len);
+                movedFilled[i] = filled[k];
+            }
+        }
+        points.swap(moved);
+        filled.swap(movedFilled);
+        owner.assign(ids, ids + count);
+    }
+
+    int len;
+    int head = 0;  // slot the next point goes to
+    std::vector<Vector3> points;
+    std::vector<int> filled;
+    std::vector<int> owner;  // body id of every trail
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cmath>
+
+#include "raylib.h"
+#include "raymath.h"
+#include "rlgl.h"
+
+// Detail levels of a drawn body, picked from its radius on screen
+enum LodLevel { LodHigh, LodMedium, LodLow, LodPoint, LodCount };
+
+// Per frame counters of the culling pass
+struct CullStats
+{
+    int bodiesCulled = 0;
+    int bodiesPerLod[LodCount] = {};
+    int trailPointsCulled = 0;
+    int trailPointsDrawn = 0;
+
+    void reset() { *this = CullStats(); }
+};
+
+// Visibility and projected size of spheres for the active camera.
+// 3D: the perspective frustum of a Camera3D (side planes from fovy and the
+// aspect ratio, near and far from rlgl). 2D: the world rectangle a Camera2D
+// shows. setCamera() once per frame, then the tests are a few dot products.
+class ViewCuller
+{
+public:
+    // Projected radius below which a level is not used anymore
+    static constexpr float LodPixels[LodCount] = { 24.0f, 6.0f, 1.0f, 0.0f };
+
+    void setCamera(const Camera3D& camera, int width, int height)
+    {
+        flat = false;
+        eye = camera.position;
+        forward = Vector3Normalize(Vector3Subtract(camera.target, camera.position));
+        Vector3 right = Vector3Normalize(Vector3CrossProduct(forward, camera.up));
+        Vector3 up = Vector3CrossProduct(right, forward);
+
+        const float tanY = tanf(camera.fovy * DEG2RAD * 0.5f);
+        const float tanX = tanY * width / height;
+        // inward normals of the four side planes through the eye
+        planes[0] = Vector3Normalize(Vector3Add(forward, Vector3Scale(right, 1.0f / tanX)));
+        planes[1] = Vector3Normalize(Vector3Subtract(forward, Vector3Scale(right, 1.0f / tanX)));
+        planes[2] = Vector3Normalize(Vector3Add(forward, Vector3Scale(up, 1.0f / tanY)));
+        planes[3] = Vector3Normalize(Vector3Subtract(forward, Vector3Scale(up, 1.0f / tanY)));
+        nearDist = (float)rlGetCullDistanceNear();
+        farDist = (float)rlGetCullDistanceFar();
+
+        pixelsPerUnit = 0.5f * height / tanY;
+    }
+
+    void setCamera(const Camera2D& camera, int width, int height)
+    {
+        flat = true;
+        Vector2 a = GetScreenToWorld2D({ 0.0f, 0.0f }, camera);
+        Vector2 b = GetScreenToWorld2D({ (float)width, (float)height }, camera);
+        lo = { fminf(a.x, b.x), fminf(a.y, b.y) };
+        hi = { fmaxf(a.x, b.x), fmaxf(a.y, b.y) };
+        pixelsPerUnit = camera.zoom;
+    }
+
+    bool visible(Vector3 p, float radius) const
+    {
+        if (flat) {
+            return p.x + radius >= lo.x && p.x - radius <= hi.x && p.y + radius >= lo.y && p.y - radius <= hi.y;
+        }
+
+        Vector3 d = Vector3Subtract(p, eye);
+        float depth = Vector3DotProduct(d, forward);
+        if (depth < nearDist - radius || depth > farDist + radius)
+            return false;
+        for (const Vector3& n : planes) {
+            if (Vector3DotProduct(d, n) < -radius)
+                return false;
+        }
+        return true;
+    }
+
+    // Size in world units of one pixel at p
+    float pixelSize(Vector3 p) const
+    {
+        if (flat)
+            return 1.0f / pixelsPerUnit;
+        float depth = Vector3DotProduct(Vector3Subtract(p, eye), forward);
+        return fmaxf(depth, nearDist) / pixelsPerUnit;
+    }
+
+    LodLevel lod(Vector3 p, float radius) const
+    {
+        const float pixels = radius / pixelSize(p);
+        int level = LodHigh;
+        while (level < LodPoint && pixels < LodPixels[level])
+            ++level;
+        return (LodLevel)level;
+    }
+
+private:
+    bool flat = false;
+
+    // 3D
+    Vector3 eye = {};
+    Vector3 forward = { 0.0f, 0.0f, -1.0f };
+    Vector3 planes[4] = {};
+    float nearDist = 0.01f, farDist = 1000.0f;
+
+    // 2D
+    Vector2 lo = {}, hi = {};
+
+    float pixelsPerUnit = 1.0f;
+};